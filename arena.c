@@ -0,0 +1,97 @@
+#include "arena.h"
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static ArenaBlock* newBlock(Arena* arena, size_t minSize);
+Arena* newArena();
+void* arenaAlloc(Arena* arena, size_t size);
+void* arenaGrow(Arena* arena, void* ptr, size_t oldSize, size_t newSize);
+char* arenaCopyString(Arena* arena, const char* source, size_t length);
+void freeArena(Arena* arena);
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+// cada bloque nuevo dobla al anterior (hasta ARENA_MAX_BLOCK_SIZE).
+static ArenaBlock* newBlock(Arena* arena, size_t minSize) {
+    size_t size = (arena->blocks == NULL) ? ARENA_FIRST_BLOCK_SIZE : arena->blocks->size * 2;
+    if (size > ARENA_MAX_BLOCK_SIZE) size = ARENA_MAX_BLOCK_SIZE;
+    if (size < minSize) size = minSize;
+
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->bytesReserved += sizeof(ArenaBlock) + size;
+
+    return block;
+}
+
+Arena* newArena() {
+    Arena* arena = createObject(Arena);
+    arena->blocks = NULL;
+    arena->refCount = 1;
+    arena->bytesAllocated = 0;
+    arena->allocations = 0;
+    arena->bytesReserved = 0;
+
+    return arena;
+}
+
+void* arenaAlloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->used + size > block->size) {
+        block = newBlock(arena, size);
+    }
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->bytesAllocated += size;
+    arena->allocations += 1;
+
+    return ptr;
+}
+
+// agranda 'ptr' (reservado en la arena): si es lo último reservado en el bloque
+// actual se extiende en su sitio, si no se copia a un hueco nuevo.
+void* arenaGrow(Arena* arena, void* ptr, size_t oldSize, size_t newSize) {
+    if (ptr == NULL) {
+        return arenaAlloc(arena, newSize);
+    }
+    oldSize = (oldSize + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    newSize = (newSize + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    ArenaBlock* block = arena->blocks;
+    if ((char*)ptr + oldSize == block->data + block->used && block->used - oldSize + newSize <= block->size) {
+        block->used += newSize - oldSize;
+        arena->bytesAllocated += newSize - oldSize;
+        return ptr;
+    }
+    void* grown = arenaAlloc(arena, newSize);
+    memcpy(grown, ptr, oldSize);
+
+    return grown;
+}
+
+char* arenaCopyString(Arena* arena, const char* source, size_t length) {
+    char* str = (char*)arenaAlloc(arena, length + 1);
+    memcpy(str, source, length);
+    str[length] = '\0';
+
+    return str;
+}
+
+void freeArena(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
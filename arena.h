@@ -0,0 +1,43 @@
+#ifndef cmonk_arena_h
+#define cmonk_arena_h
+
+#include "headers.h"
+
+#define ARENA_FIRST_BLOCK_SIZE (4 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT 8
+
+/**
+ * Arena (bump pointer) para los nodos del AST.
+ * Todos los nodos de un parse salen de bloques grandes: reservar es avanzar
+ * un puntero y liberar el programa entero es liberar la lista de bloques.
+ * 'refCount' lo usan los programas cuyas funciones escapan en closures
+ * (ver retainProgram/releaseProgram en ast.c).
+ */
+typedef struct sArenaBlock {
+    struct sArenaBlock* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks; // el bloque actual es el primero de la lista
+    int refCount;
+    size_t bytesAllocated; // bytes pedidos por el parser
+    size_t allocations; // número de reservas
+    size_t bytesReserved; // bytes reservados con malloc (bloques completos)
+} Arena;
+
+#define createNode(arena, type) ((type*)arenaAlloc((arena), sizeof(type)))
+
+/*================================================================/
+* PUBLIC ARENA API
+*=================================================================*/
+Arena* newArena();
+void* arenaAlloc(Arena* arena, size_t size);
+void* arenaGrow(Arena* arena, void* ptr, size_t oldSize, size_t newSize);
+char* arenaCopyString(Arena* arena, const char* source, size_t length);
+void freeArena(Arena* arena);
+
+#endif
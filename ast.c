@@ -11,29 +11,29 @@ static char* printExpression(Expression* exp) {
 	}
     switch (exp->type) {
 	case NT_IDENT:
-		sprintf_s(output, 1024, "%s", "policia extraer literal.");
+		sprintf_s(output, 1024, "%s", symbolName(((IdentifierNode*)exp)->symbol));
 		break;
 	case NT_INTEGER:
-		sprintf_s(output, 1024, "%i", ((IntegerNode*)exp->node)->value);
+		sprintf_s(output, 1024, "%i", ((IntegerNode*)exp)->value);
 		break;
 	case NT_BOOLEAN:
-		sprintf_s(output, 1024, "%s", (((BooleanNode*)exp->node)->value == true) ? "true" : "false");
+		sprintf_s(output, 1024, "%s", (((BooleanNode*)exp)->value == true) ? "true" : "false");
 		break;
 	case NT_STRING:
-		sprintf_s(output, 1024, "\"%s\"", ((StringNode*)exp->node)->value);
+		sprintf_s(output, 1024, "\"%s\"", ((StringNode*)exp)->value);
 		break;
 	case NT_NULL:
 		sprintf_s(output, 1024, "%s", "null");
 		break;
 	case NT_PREFIX: 
 		{
-			PrefixNode* prefix = ((PrefixNode*)exp->node);
+			PrefixNode* prefix = ((PrefixNode*)exp);
 			sprintf_s(output, 1024, "(%c%s)", prefix->operator, printExpression(prefix->right));
 			break;
 		}
 	case NT_INFIX:
 		{
-			InfixNode* infix = ((InfixNode*)exp->node);
+			InfixNode* infix = ((InfixNode*)exp);
 			sprintf_s(output, 1024, "(%s %s %s)", printExpression(infix->left), infix->operator, printExpression(infix->right));
 			break;
 		}
@@ -50,18 +50,18 @@ static char* printStatement(Statement* stmt) {
     switch (stmt->type) {
 	case NT_LET:
 		{
-			LetStatement* letStmt = ((LetStatement*)stmt->node);
-			sprintf_s(output, 1024, "let %s = %s;", "<<policia extraer literal>>", printExpression(letStmt->value));
+			LetStatement* letStmt = ((LetStatement*)stmt);
+			sprintf_s(output, 1024, "let %s = %s;", symbolName(letStmt->name->symbol), printExpression(letStmt->value));
 			break;
 		}
 	case NT_RETURN:
 		{
-			ReturnStatement* returnStmt = ((ReturnStatement*)stmt->node);
+			ReturnStatement* returnStmt = ((ReturnStatement*)stmt);
 			sprintf_s(output, 1024, "return %s;", printExpression(returnStmt->value));
 			break;
 		}
 	case NT_EXPR:
-		sprintf_s(output, 1024, "%s;", printExpression(((ExpressionStatement*)stmt->node)->expression));
+		sprintf_s(output, 1024, "%s;", printExpression(((ExpressionStatement*)stmt)->expression));
 		break;
     }
     return output;
@@ -77,40 +77,10 @@ void printAST(ArrayStmt* program) {
 
 /****************************************************************
 * Rutinas para liberar la memoria de los nodos.
+* Todos los nodos de un programa viven en su arena, así que no se liberan
+* uno a uno: cuando el programa ya no tiene referencias se libera la arena.
 *****************************************************************/
-static void freeExpression(Expression* exp) {
-    switch (exp->type) {
-	case NT_IDENT:
-		break;
-    }
-}
-
-static void freeStatement(Statement* stmt) {
-    switch (stmt->type) {
-	case NT_LET: 
-		{
-			LetStatement* letStmt = ((LetStatement*)stmt->node);
-			if (letStmt->name != NULL) free(letStmt->name);
-			if (letStmt->value != NULL) freeExpression(letStmt->value);
-			free(letStmt);
-			break;
-		}
-	case NT_RETURN: 
-		{
-			ReturnStatement* returnStmt = ((ReturnStatement*)stmt->node);
-			if (returnStmt->value != NULL) freeExpression(returnStmt->value);
-			free(returnStmt);
-			break;
-		}		
-	case NT_EXPR: 
-		{
-			ExpressionStatement* expStmt = ((ExpressionStatement*)stmt->node);
-			if (expStmt->expression != NULL) freeExpression(expStmt->expression);
-			free(expStmt);
-			break;
-		}
-    }
-}
+static Program* livePrograms = NULL; // lista de programas con referencias
 
 void clearArrayStmt(ArrayStmt* array) {
 	array->capacity = 0;
@@ -118,13 +88,43 @@ void clearArrayStmt(ArrayStmt* array) {
 	array->statements = NULL;	
 }
 
-void freeProgram(ArrayStmt* program) {
-	for (int i = 0; i < program->count; i++) {
-		if (program->statements[i] != NULL) {
-			freeStatement(program->statements[i]);
-		}
-	}
-	clearArrayStmt(program);
+// crea un programa vacío (con su arena) y lo agrega a la lista de programas vivos.
+Program* newProgram() {
+	Arena* arena = newArena();
+	Program* program = createNode(arena, Program);
+	program->arena = arena;
+	program->statements = NULL;
+	program->constants.count = 0;
+	program->constants.capacity = 0;
+	program->constants.objects = NULL;
+	program->sharedClosures = 0;
+	program->keepShared = false;
+
+	program->prev = NULL;
+	program->next = livePrograms;
+	if (livePrograms != NULL) livePrograms->prev = program;
+	livePrograms = program;
+
+	return program;
+}
 
-	free(program);
-}
\ No newline at end of file
+// un closure creado a partir de una función del programa lo mantiene vivo.
+void retainProgram(Program* program) {
+	program->arena->refCount += 1;
+}
+
+void releaseProgram(Program* program) {
+	Arena* arena = program->arena;
+	arena->refCount -= 1;
+	if (arena->refCount > 0) return;
+
+	if (program->prev != NULL) program->prev->next = program->next;
+	else livePrograms = program->next;
+	if (program->next != NULL) program->next->prev = program->prev;
+
+	freeArena(arena); // el programa y todos sus nodos de una vez.
+}
+
+Program* firstLiveProgram() {
+	return livePrograms;
+}
@@ -4,12 +4,16 @@
 
 #define FIRST_ARRAY_CAPACITY 8
 #define GROWING_ARRAY_FACTOR 2
+#define GLOBAL_DEPTH -1 // IdentifierNode.depth de las variables globales
+#define MAX_ARGUMENTS 255 // máximo de parámetros de una función y de argumentos de una llamada
 
 #include "lexer.h"
+#include "arena.h"
+#include "value.h"
 
 /**
  * Estructura y funcionamiento del AST:
- * La estructura está formada por 2 wrappers:
+ * Hay 2 familias de nodos:
  * 1. Statement: contiene las sentencias soportadas por el lenguaje.
  * 	a. LetStatement: 	let numero = 7;
  * 	b. ReturnStatement: return 7;
@@ -24,25 +28,30 @@
  * 	f. PrefixNode: -5
  * 	g. InfixNode: a + b
  * 	h. IfNode: if (a) {...} else {...}
+ * 	i. FunctionNode: fn(a, b) {...}
+ * 	j. CallNode: foo(1, 2)
  * 
- * Proceso: cada nodo generado por el Parser deberá ser envuelto en su respectivo wrapper
- * por ejemplo:
- * a. Si la regla de producción es un LetStatement entonces se crea el wrapper Statement con
- * tipo NT_LET y su representación en memoria sería la siguiente:
+ * Todos los nodos empiezan por el campo 'type' (su NodeType), así que un
+ * Statement* o Expression* es directamente un puntero al nodo:
  * 
- * Statement {
- * 	.type = NT_LET,
- * 	.node = LetStatement {...}
- * }
- * b. Si el Parser detecta la expresión a + b entonces el nodo final será un Expression:
- * Expression {
+ * Expression* exp -> InfixNode {
  * 	.type = NT_INFIX,
- * 	.node = InfixExpression {...}
+ * 	.left = ...,
+ * 	...
  * }
  * 
- * Al estar todos los nodos envueltos en un wrapper se hace fácil recorrerlos e
- * interpretarlos ya que solo hay que evaluar el tipo de Statement y Expression.
- * tras ser detectados se procede a 'desemvolver' el nodo.
+ * Para interpretarlo basta con mirar exp->type y convertir el puntero al
+ * nodo concreto: ((InfixNode*)exp)->left. No hay un wrapper intermedio.
+ * Los parámetros de FunctionNode y los argumentos de CallNode van al final
+ * del nodo y ocupan solo lo que se usa.
+ *
+ * Los identificadores, prefix, infix y llamadas se especializan: la primera
+ * vez que el tree walker los evalúa cambia su 'type' por una variante según
+ * lo que ha visto (NT_INFIX_ADD_INT si sumó dos enteros...). El nodo es el
+ * mismo, solo cambia el caso de dispatchExpression() que lo evalúa. Si una
+ * variante ve algo que no esperaba pasa a la genérica (ver interpreter.c).
+ * El resto de pasadas (resolver, compilador) trabajan antes y solo ven los
+ * tipos originales.
  */
 
 // el tipo de nodo es clave para saber el objeto que se está examinando.
@@ -60,19 +69,40 @@ typedef enum {
 	NT_IF,
 	NT_FUNCTION,
 	NT_CALL,
+	// variantes especializadas por el tree walker
+	NT_IDENT_GLOBAL,
+	NT_IDENT_LOCAL, // en el scope de la llamada (depth 0)
+	NT_IDENT_OUTER, // en un scope de fuera (depth > 0)
+	NT_PREFIX_MINUS_INT,
+	NT_PREFIX_BANG_BOOL,
+	NT_PREFIX_GENERIC,
+	NT_INFIX_ADD_INT,
+	NT_INFIX_SUB_INT,
+	NT_INFIX_MUL_INT,
+	NT_INFIX_DIV_INT,
+	NT_INFIX_LT_INT,
+	NT_INFIX_GT_INT,
+	NT_INFIX_EQ_INT,
+	NT_INFIX_NOT_EQ_INT,
+	NT_INFIX_ADD_STRING,
+	NT_INFIX_GENERIC,
+	NT_CALL_FUNCTION, // siempre la misma función (mismo cuerpo)
+	NT_CALL_GENERIC,
 } NodeType;
 
-// Statement ::= letStatement | returnStatement | expressionStatement
-typedef struct {
-	NodeType type;
-	void* node;
-} Statement;
+#define IS_INFIX_NODE(type) ((type) == NT_INFIX || ((type) >= NT_INFIX_ADD_INT && (type) <= NT_INFIX_GENERIC))
+#define IS_CALL_NODE(type) ((type) == NT_CALL || (type) == NT_CALL_FUNCTION || (type) == NT_CALL_GENERIC)
 
-// Expression ::= Integer | Boolean | String | Identifier | Null | Prefix | Infix
+// cabecera común: el primer campo de todos los nodos.
 typedef struct {
 	NodeType type;
-	void* node;
-} Expression;
+} Node;
+
+// Statement ::= letStatement | returnStatement | expressionStatement
+typedef Node Statement;
+
+// Expression ::= Integer | Boolean | String | Identifier | Null | Prefix | Infix | If | Function | Call
+typedef Node Expression;
 
 // ArrayStmt: contiene un array de sentencias (sirve para Program y BlockStatement)
 typedef struct {
@@ -81,61 +111,112 @@ typedef struct {
 	Statement **statements;
 } ArrayStmt;
 
+// los objetos del runtime se definen en object.h
+struct sObject;
+
+/**
+ * ConstantPool: los literales se decodifican una sola vez al parsear. Los
+ * enteros quedan como Value inmediato en su nodo; los strings se crean como
+ * objetos inmutables y se guardan aquí. Evaluar un literal es una sola lectura.
+ */
+typedef struct {
+	int count;
+	int capacity;
+	struct sObject** objects;
+} ConstantPool;
+
+/**
+ * Program: lo que devuelve el parser. El programa, sus nodos y el array del
+ * pool viven en 'arena'. Mientras el programa está vivo sus constantes son
+ * raíces para el GC; los programas vivos forman una lista doblemente enlazada.
+ */
+typedef struct sProgram {
+	ArrayStmt* statements;
+	ConstantPool constants;
+	Arena* arena;
+	int sharedClosures; // closures compartidos que lo retienen (ver newFunction)
+	bool keepShared; // los conserva el GC mayor en curso
+	struct sProgram* prev;
+	struct sProgram* next;
+} Program;
+
 /**********************************************************
 * Nodos para Expresiones
 ***********************************************************/
 // Nodo IntegerNode
 typedef struct {
+	NodeType type;
 	Token token;
 	int value;
+	Value constant; // el entero ya etiquetado
 } IntegerNode;
 
 // Nodo BooleanNode
 typedef struct {
+	NodeType type;
 	Token token;
 	bool value;
 } BooleanNode;
 
 // Nodo NullNode
 typedef struct {
+	NodeType type;
 	Token token;
 } NullNode;
 
 // Nodo StringNode
 typedef struct {
+	NodeType type;
 	Token token;
 	char *value;
+	Value constant; // objeto en el ConstantPool del programa
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
 } StringNode;
 
 // Nodo IdentifierNode
 typedef struct {
+	NodeType type;
 	Token token;
-	//char *value;
+	int symbol; // id en la tabla de símbolos
+	int depth; // scopes de función que hay que subir (GLOBAL_DEPTH: tabla global)
+	int slot; // posición en el environment de ese scope
 } IdentifierNode;
 
 // Nodo ExpressionStatement
 typedef struct {
+	NodeType type;
 	Token token;
 	Expression* expression;
 } ExpressionStatement;
 
 // Nodo PrefixNode
 typedef struct {
+	NodeType type;
 	Token token;
 	TokenType operator;
 	Expression* right;
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
 } PrefixNode;
 
 // Nodo InfixNode
 typedef struct {
+	NodeType type;
+	TokenType operator;
 	Token token;
 	Expression* left;
-	TokenType operator;
 	Expression* right;
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
 } InfixNode;
 
 // Nodo IfNode
 typedef struct {
+	NodeType type;
 	Token token;
 	Expression* condition;
 	ArrayStmt* consequence;
@@ -147,32 +228,64 @@ typedef struct {
 ***********************************************************/
 // Nodo LetStatement
 typedef struct {
+	NodeType type;
 	IdentifierNode* name;
 	Expression* value;
 } LetStatement;
 
 // Nodo ReturnStatement
 typedef struct {
+	NodeType type;
 	Token token;
 	Expression* value;
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
 } ReturnStatement;
 
 // Nodo FunctionNode
 typedef struct {
-	IdentifierNode* parameters[255];
+	NodeType type;
 	int arity;
+	int localCount; // parámetros + variables locales (los pone el resolver)
+	int* locals; // símbolo de cada slot local
 	ArrayStmt* body;
+	Program* program; // dueño de la arena donde vive el cuerpo
+	int profile; // id de la función en el profiler (ver profiler.h)
+	// lo pone el resolver (ver resolver.h)
+	bool closures; // el cuerpo crea funciones
+	bool keepsEnv; // el closure guarda el Environment donde se crea
+	bool needsEnv; // alguna función del cuerpo guarda el Environment de la llamada
+	int captureCount; // copias de variables de fuera: los últimos slots locales
+	int* captures; // slot de la función de fuera que copia cada una
+	struct sObject* shared; // el closure único si no copia ni guarda nada (ver newFunction)
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
+	IdentifierNode* parameters[]; // 'arity' parámetros
 } FunctionNode;
 
 // Nodo CallNode
 typedef struct {
-	Expression* function;
-	Expression* arguments[255];
+	NodeType type;
 	int argc;
+	Expression* function;
+	ArrayStmt* target; // NT_CALL_FUNCTION: el cuerpo de la función que se llama
+	bool tail; // llamada de cola (la marca el resolver)
+#ifdef HEAP_PROFILE
+	int site; // sitio de reserva de lo que crea el nodo (ver heapprof.h)
+#endif
+#ifdef EVAL_STATS
+	int callSite; // contadores de esta llamada (ver evalstats.h)
+#endif
+	Expression* arguments[]; // 'argc' argumentos
 } CallNode;
 
 void printAST(ArrayStmt* program);
 void clearArrayStmt(ArrayStmt* array);
-void freeProgram(ArrayStmt* program);
+Program* newProgram();
+void retainProgram(Program* program);
+void releaseProgram(Program* program);
+Program* firstLiveProgram();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,662 @@
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "interpreter.h"
+#include "heap.h"
+#include "marker.h"
+
+#define SUITE_WARMUP 1 // ejecuciones de cada benchmark que no se cuentan
+#define SUITE_REPETITIONS 7 // las que se cuentan (--reps=N)
+#define SUITE_MAX_REPETITIONS 100
+#define SUITE_TOLERANCE 0.10 // una mediana más de un 10% peor que la de la base es una regresión
+
+typedef enum {
+    SUITE_PROGRAM, // ejecutar un programa Monkey
+    SUITE_TOKENIZE, // tokenize() de un fuente generado
+    SUITE_PARSE, // lexer + parser de un fuente generado
+} SuiteKind;
+
+// un benchmark de la suite (make bench).
+typedef struct {
+    const char* name;
+    SuiteKind kind;
+    const char* source; // el programa, o el fragmento que se repite para generar el fuente
+    size_t size; // bytes del fuente generado
+    Engine engine;
+} SuiteBenchmark;
+
+// resultado de un benchmark. Los contadores del GC son los de una sola ejecución.
+typedef struct {
+    double median;
+    double p95;
+    double min;
+    double megabytesPerSecond; // solo tokenize y parse (con la mediana)
+    size_t allocated;
+    size_t allocatedBytes;
+    int minorCollections;
+    int majorCollections;
+    long peakRSS; // KB
+    bool ok;
+} SuiteResult;
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static double now();
+static char* generateSource(const char* snippet, size_t size);
+static double benchLexer(const char* label, const char* snippet, size_t size);
+static void compareScanModes(const char* label, const char* snippet);
+static double benchTokenize(const char* label, const char* snippet, size_t size, int threads);
+static void benchParse(const char* label, const char* snippet, size_t size);
+static size_t walkExpression(Expression* exp);
+static size_t walkStatements(ArrayStmt* stmts);
+static void benchTreeWalk(const char* label, const char* snippet, size_t size);
+static void benchGC(const char* label, const char* source, Engine selected);
+static void benchMarkers(const char* label, const char* source, int threads);
+static long peakRSS();
+static Object* allocString(bool tenured);
+static void benchAlloc(const char* label, int count, bool tenured);
+static void benchMallocPairs(const char* label, int count);
+static double runOnce(const SuiteBenchmark* bench, const char* input);
+static int compareTimes(const void* a, const void* b);
+static void runBenchmark(const SuiteBenchmark* bench, int repetitions, SuiteResult* result);
+static void runIsolated(const SuiteBenchmark* bench, int repetitions, SuiteResult* result);
+static void writeSuiteJSON(FILE* file, SuiteResult* results, int repetitions);
+static bool readBaseline(const char* path, const char* name, double* median);
+static int compareBaseline(const char* path, SuiteResult* results);
+static int runSuite(int argc, const char* argv[]);
+
+// fragmentos de código Monkey que se repiten para generar las entradas.
+static const char mixedSnippet[] =
+    "let fib = fn(n) { if (n < 2) { return n; } else { return fib(n - 1) + fib(n - 2); }; };\n"
+    "let greeting = \"hello, monkey\"; let total_count = 12345 * 678 / 9;\n"
+    "let check = fn(a, b) { if (a != b) { !true } else { a == b } };\n";
+
+static const char identifierSnippet[] =
+    "let accumulated_total_value = previous_accumulated_value + current_iteration_delta_42;\n"
+    "let normalizedCoordinateX = computeNormalizedCoordinate(rawCoordinateX, viewportWidth);\n";
+
+static const char stringSnippet[] =
+    "let message = \"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod\";\n"
+    "let template = \"<div class='monkey-banner'>     Hello from the machine-generated file!  </div>\";\n";
+
+// strings con saltos de línea: obligan al lexeo paralelo a corregir cortes dentro de un string.
+static const char multilineSnippet[] =
+    "let doc = \"first line\nsecond line\nthird line\"; let n = 42;\n";
+
+// programas que generan basura: ReturnObj, strings intermedios y closures de un solo uso.
+static const char fibProgram[] =
+    "let fib = fn(n) { if (n < 2) { return n; } else { return fib(n - 1) + fib(n - 2); } }; fib(24);";
+
+static const char stringProgram[] =
+    "let churn = fn(n) { if (n == 0) { 0 } else { let t = \"monkey\" + \"-\" + \"gc\"; churn(n - 1) } };\n"
+    "let repeat = fn(k) { if (k == 0) { 0 } else { churn(1000); repeat(k - 1) } }; repeat(500);";
+
+static const char closureProgram[] =
+    "let make = fn(x) { fn() { x } };\n"
+    "let churn = fn(n, keep) { if (n == 0) { keep() } else { churn(n - 1, make(n)) } };\n"
+    "let repeat = fn(k) { if (k == 0) { 0 } else { churn(1000, make(0)); repeat(k - 1) } }; repeat(500);";
+
+// un árbol de closures grande que sigue vivo mientras se crean (y promueven) árboles más pequeños.
+static const char liveHeapProgram[] =
+    "let tree = fn(d) { if (d == 0) { 0 } else { let l = tree(d - 1); let r = tree(d - 1); fn() { l + r } } };\n"
+    "let live = tree(18);\n"
+    "let again = fn(k) { if (k == 0) { 0 } else { tree(14); again(k - 1) } }; again(200);";
+
+// programas de la suite: cada uno tarda del orden de 0.1 s en el tree walker.
+static const char suiteFibProgram[] =
+    "let fib = fn(n) { if (n < 2) { return n; } else { return fib(n - 1) + fib(n - 2); } }; fib(27);";
+
+static const char suiteStringProgram[] =
+    "let grow = fn(n, s) { if (n == 0) { s } else { grow(n - 1, s + \"ab\") } };\n"
+    "let repeat = fn(k) { if (k == 0) { 0 } else { grow(500, \"\"); repeat(k - 1) } }; repeat(1000);";
+
+// cadenas de llamadas largas ('down' es una llamada de cola: mide ese bucle).
+static const char suiteDeepProgram[] =
+    "let down = fn(n) { if (n == 0) { 0 } else { down(n - 1) } };\n"
+    "let repeat = fn(k) { if (k == 0) { 0 } else { down(3000); repeat(k - 1) } }; repeat(300);";
+
+static const char suiteGCProgram[] =
+    "let tree = fn(d) { if (d == 0) { 0 } else { let l = tree(d - 1); let r = tree(d - 1); fn() { l + r } } };\n"
+    "let live = tree(16);\n"
+    "let again = fn(k) { if (k == 0) { 0 } else { tree(12); again(k - 1) } }; again(100);";
+
+static const SuiteBenchmark suite[] = {
+    { "fib-ast", SUITE_PROGRAM, suiteFibProgram, 0, ENGINE_AST },
+    { "fib-vm", SUITE_PROGRAM, suiteFibProgram, 0, ENGINE_VM },
+    { "closures-ast", SUITE_PROGRAM, closureProgram, 0, ENGINE_AST },
+    { "closures-vm", SUITE_PROGRAM, closureProgram, 0, ENGINE_VM },
+    { "strings-ast", SUITE_PROGRAM, suiteStringProgram, 0, ENGINE_AST },
+    { "strings-vm", SUITE_PROGRAM, suiteStringProgram, 0, ENGINE_VM },
+    { "deep-calls-ast", SUITE_PROGRAM, suiteDeepProgram, 0, ENGINE_AST },
+    { "deep-calls-vm", SUITE_PROGRAM, suiteDeepProgram, 0, ENGINE_VM },
+    { "gc-stress-ast", SUITE_PROGRAM, suiteGCProgram, 0, ENGINE_AST },
+    { "gc-stress-vm", SUITE_PROGRAM, suiteGCProgram, 0, ENGINE_VM },
+    { "tokenize-mixed-16MB", SUITE_TOKENIZE, mixedSnippet, 16 * 1024 * 1024, ENGINE_AST },
+    { "tokenize-strings-16MB", SUITE_TOKENIZE, stringSnippet, 16 * 1024 * 1024, ENGINE_AST },
+    { "parse-mixed-4MB", SUITE_PARSE, mixedSnippet, 4 * 1024 * 1024, ENGINE_AST },
+};
+#define SUITE_SIZE ((int)(sizeof(suite) / sizeof(suite[0])))
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// genera 'size' bytes repitiendo 'snippet'; el último trozo se rellena con espacios.
+static char* generateSource(const char* snippet, size_t size) {
+    char* source = (char*)malloc(size);
+    if (source == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    size_t len = strlen(snippet);
+    size_t pos = 0;
+    while (pos + len <= size) {
+        memcpy(source + pos, snippet, len);
+        pos += len;
+    }
+    memset(source + pos, ' ', size - pos);
+
+    return source; // sin '\0' final: se lexea con initLexerN.
+}
+
+static double benchLexer(const char* label, const char* snippet, size_t size) {
+    char* source = generateSource(snippet, size);
+    // repetir las entradas pequeñas para medir al menos ~256 MB en total.
+    size_t iterations = (256u * 1024 * 1024) / size;
+    if (iterations == 0) iterations = 1;
+
+    size_t tokens = 0;
+    double start = now();
+    for (size_t i = 0; i < iterations; i++) {
+        initLexerN(source, size);
+        for (Token tok = nextToken(); tok.type != T_EOF; tok = nextToken()) {
+            tokens++;
+        }
+    }
+    double elapsed = now() - start;
+    double megabytes = (double)size * iterations / (1024.0 * 1024.0);
+
+    fprintf(stdout, "lexer %-18s %-6s %10.1f MB/s  (%zu tokens, %zu iterations, %.3f s)\n",
+        label, scanModeName(scanner.mode), megabytes / elapsed, tokens / iterations, iterations, elapsed);
+    free(source);
+
+    return megabytes / elapsed;
+}
+
+// misma entrada con el escáner escalar y con el mejor escáner vectorial disponible.
+static void compareScanModes(const char* label, const char* snippet) {
+    setScanMode(SCAN_SCALAR);
+    double scalar = benchLexer(label, snippet, 16 * 1024 * 1024);
+    setScanMode(SCAN_AVX2);
+    double vector = benchLexer(label, snippet, 16 * 1024 * 1024);
+    fprintf(stdout, "lexer %-18s speedup %.2fx\n", label, vector / scalar);
+}
+
+// tokenize() completo (buffer struct-of-arrays) con 'threads' hilos.
+static double benchTokenize(const char* label, const char* snippet, size_t size, int threads) {
+    char* source = generateSource(snippet, size);
+    double start = now();
+    TokenBuffer* tokens = tokenize(source, size, threads);
+    double elapsed = now() - start;
+    double megabytes = (double)size / (1024.0 * 1024.0);
+
+    fprintf(stdout, "tokenize %-15s %2d threads %10.1f MB/s  (%d tokens, %.3f s)\n",
+        label, threads, megabytes / elapsed, tokens->count, elapsed);
+    freeTokenBuffer(tokens);
+    free(source);
+
+    return megabytes / elapsed;
+}
+
+// parseProgram() completo, con lo que reservó la arena del programa.
+static void benchParse(const char* label, const char* snippet, size_t size) {
+    char* source = generateSource(snippet, size);
+    double start = now();
+    initLexerN(source, size);
+    Program* program = parseProgram();
+    double elapsed = now() - start;
+    double megabytes = (double)size / (1024.0 * 1024.0);
+
+    Arena* arena = program->arena;
+    fprintf(stdout, "parse %-18s %10.1f MB/s  (%zu bytes in %zu allocations, %zu bytes reserved, %.3f s)\n",
+        label, megabytes / elapsed, arena->bytesAllocated, arena->allocations, arena->bytesReserved, elapsed);
+    releaseProgram(program);
+    free(source);
+}
+
+// recorre el árbol completo contando nodos: mide solo el acceso a los nodos.
+static size_t walkExpression(Expression* exp) {
+    if (exp == NULL) return 0;
+    switch (exp->type) {
+    case NT_PREFIX:
+        return 1 + walkExpression(((PrefixNode*)exp)->right);
+    case NT_INFIX:
+        return 1 + walkExpression(((InfixNode*)exp)->left) + walkExpression(((InfixNode*)exp)->right);
+    case NT_IF: {
+        IfNode* node = (IfNode*)exp;
+        size_t count = 1 + walkExpression(node->condition) + walkStatements(node->consequence);
+        if (node->alternative != NULL) count += walkStatements(node->alternative);
+        return count;
+    }
+    case NT_FUNCTION: {
+        FunctionNode* node = (FunctionNode*)exp;
+        return 1 + node->arity + walkStatements(node->body);
+    }
+    case NT_CALL: {
+        CallNode* node = (CallNode*)exp;
+        size_t count = 1 + walkExpression(node->function);
+        for (int i = 0; i < node->argc; i++) count += walkExpression(node->arguments[i]);
+        return count;
+    }
+    default:
+        return 1;
+    }
+}
+
+static size_t walkStatements(ArrayStmt* stmts) {
+    size_t count = 0;
+    for (int i = 0; i < stmts->count; i++) {
+        Statement* stmt = stmts->statements[i];
+        switch (stmt->type) {
+        case NT_LET:
+            count += 2 + walkExpression(((LetStatement*)stmt)->value);
+            break;
+        case NT_RETURN:
+            count += 1 + walkExpression(((ReturnStatement*)stmt)->value);
+            break;
+        default:
+            count += 1 + walkExpression(((ExpressionStatement*)stmt)->expression);
+        }
+    }
+    return count;
+}
+
+// recorridos completos del árbol de un programa grande.
+static void benchTreeWalk(const char* label, const char* snippet, size_t size) {
+    char* source = generateSource(snippet, size);
+    initLexerN(source, size);
+    Program* program = parseProgram();
+
+    int iterations = 20;
+    size_t nodes = 0;
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        nodes = walkStatements(program->statements);
+    }
+    double elapsed = now() - start;
+
+    fprintf(stdout, "walk %-19s %10.1f Mnodes/s  (%zu nodes, %zu bytes/node, %.3f s)\n",
+        label, nodes * (double)iterations / elapsed / 1e6, nodes, program->arena->bytesAllocated / nodes, elapsed);
+    releaseProgram(program);
+    free(source);
+}
+
+// pausas y ritmo de reserva del GC mientras se ejecuta 'source'.
+static void benchGC(const char* label, const char* source, Engine selected) {
+    setEngine(selected);
+    resetGcStats();
+    double start = now();
+    interpret(source);
+    double elapsed = now() - start;
+    GcStats stats = getGcStats();
+
+    fprintf(stdout, "gc   %-19s %10.1f Mobj/s  (%zu objects, %.1f%% promoted, %.3f s)\n",
+        label, stats.allocated / elapsed / 1e6, stats.allocated,
+        stats.allocated ? 100.0 * stats.promoted / stats.allocated : 0.0, elapsed);
+    fprintf(stdout, "     minor: %6d collections, avg %8.1f us, max %8.1f us\n", stats.minorCollections,
+        stats.minorCollections ? stats.minorPauseTotal / stats.minorCollections * 1e6 : 0.0, stats.minorPauseMax * 1e6);
+    fprintf(stdout, "     major: %6d collections, avg %8.1f us, max %8.1f us\n", stats.majorCollections,
+        stats.majorCollections ? stats.majorPauseTotal / stats.majorCollections * 1e6 : 0.0, stats.majorPauseMax * 1e6);
+    fprintf(stdout, "     pauses (us): minor p50 %.1f p90 %.1f p99 %.1f, major p50 %.1f p90 %.1f p99 %.1f\n",
+        stats.minorPauseP50 * 1e6, stats.minorPauseP90 * 1e6, stats.minorPauseP99 * 1e6,
+        stats.majorPauseP50 * 1e6, stats.majorPauseP90 * 1e6, stats.majorPauseP99 * 1e6);
+}
+
+// el mismo programa marcando con 'threads' hilos (0: uno por CPU).
+static void benchMarkers(const char* label, const char* source, int threads) {
+    setMarkerThreads(threads);
+    benchGC(label, source, ENGINE_VM);
+    setMarkerThreads(0);
+}
+
+// pico de memoria residente del proceso en KB (0 si no se sabe medir).
+static long peakRSS() {
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// un string de 8 caracteres sin raíces: muere en cuanto se reserva el siguiente.
+static Object* allocString(bool tenured) {
+    size_t size = sizeof(Object) + sizeof(StringObj) + 9;
+    Object* object = tenured ? newTenuredObject(STRING_OBJ, size) : newObject(STRING_OBJ, size);
+    StringObj* str = (StringObj*)OBJ_PAYLOAD(object);
+    str->length = 8;
+    memcpy(str->value, "monkey!!", 9);
+    return object;
+}
+
+// coste de reservar (y recolectar) objetos en la nursery o en los pools del heap viejo.
+static void benchAlloc(const char* label, int count, bool tenured) {
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        allocString(tenured);
+    }
+    double elapsed = now() - start;
+
+    fprintf(stdout, "alloc %-18s %10.1f ns/object (%d objects, %zu KB in heap pages)\n",
+        label, elapsed / count * 1e9, count, heapBytesReserved() / 1024);
+}
+
+// referencia: la cabecera y el objeto envuelto con dos malloc y dos free, como antes.
+static void benchMallocPairs(const char* label, int count) {
+    void* live[1024];
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        int slot = i % 1024;
+        if (i >= 1024) {
+            free(((void**)live[slot])[1]);
+            free(live[slot]);
+        }
+        void** header = (void**)malloc(32);
+        char* payload = (char*)malloc(16);
+        memcpy(payload, "monkey!!", 9);
+        header[1] = payload;
+        live[slot] = header;
+    }
+    double elapsed = now() - start;
+    for (int i = 0; i < 1024 && i < count; i++) {
+        free(((void**)live[i])[1]);
+        free(live[i]);
+    }
+
+    fprintf(stdout, "alloc %-18s %10.1f ns/object (%d objects)\n", label, elapsed / count * 1e9, count);
+}
+
+/*================================================================/
+* Suite (make bench).
+*=================================================================*/
+// una ejecución del benchmark. 'input' es el fuente generado (tokenize y parse).
+static double runOnce(const SuiteBenchmark* bench, const char* input) {
+    double start = now();
+    switch (bench->kind) {
+    case SUITE_PROGRAM:
+        interpret(bench->source);
+        break;
+    case SUITE_TOKENIZE:
+        freeTokenBuffer(tokenize(input, bench->size, cpuCount()));
+        break;
+    case SUITE_PARSE:
+        initLexerN(input, bench->size);
+        releaseProgram(parseProgram());
+        break;
+    }
+    return now() - start;
+}
+
+static int compareTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// calentamiento, repeticiones y percentiles (por rango: con 7 repeticiones el p95 es la peor).
+static void runBenchmark(const SuiteBenchmark* bench, int repetitions, SuiteResult* result) {
+    double times[SUITE_MAX_REPETITIONS];
+    char* input = (bench->kind == SUITE_PROGRAM) ? NULL : generateSource(bench->source, bench->size);
+    setEngine(bench->engine);
+    for (int i = 0; i < SUITE_WARMUP; i++) {
+        runOnce(bench, input);
+    }
+    for (int i = 0; i < repetitions; i++) {
+        resetGcStats();
+        times[i] = runOnce(bench, input);
+    }
+    GcStats stats = getGcStats();
+    free(input);
+
+    qsort(times, repetitions, sizeof(double), compareTimes);
+    memset(result, 0, sizeof(SuiteResult));
+    result->min = times[0];
+    result->median = (repetitions % 2) ? times[repetitions / 2]
+        : (times[repetitions / 2 - 1] + times[repetitions / 2]) / 2;
+    int rank = (95 * repetitions + 99) / 100; // ceil(0.95 * n)
+    result->p95 = times[rank - 1];
+    if (bench->kind != SUITE_PROGRAM) {
+        result->megabytesPerSecond = bench->size / (1024.0 * 1024.0) / result->median;
+    }
+    result->allocated = stats.allocated;
+    result->allocatedBytes = stats.allocatedBytes;
+    result->minorCollections = stats.minorCollections;
+    result->majorCollections = stats.majorCollections;
+    result->ok = true;
+}
+
+/**
+ * Cada benchmark corre en un proceso hijo recién creado: el pico de RSS es
+ * solo el suyo y el heap de uno no afecta al siguiente. El resultado vuelve
+ * por un pipe. En Windows corren todos en el mismo proceso.
+ */
+static void runIsolated(const SuiteBenchmark* bench, int repetitions, SuiteResult* result) {
+    memset(result, 0, sizeof(SuiteResult));
+#ifndef _WIN32
+    int fds[2];
+    if (pipe(fds) != 0) return;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL) _exit(1); // los programas imprimen su resultado
+        initEvaluator();
+        initScanner();
+        runBenchmark(bench, repetitions, result);
+        _exit(write(fds[1], result, sizeof(SuiteResult)) == sizeof(SuiteResult) ? 0 : 1);
+    }
+    close(fds[1]);
+    SuiteResult received;
+    bool complete = read(fds[0], &received, sizeof(SuiteResult)) == sizeof(SuiteResult);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == pid && complete && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        *result = received;
+        result->peakRSS = usage.ru_maxrss;
+    }
+#else
+    runBenchmark(bench, repetitions, result);
+    result->peakRSS = peakRSS();
+#endif
+}
+
+// un benchmark por línea, para que readBaseline() no necesite un parser de JSON.
+static void writeSuiteJSON(FILE* file, SuiteResult* results, int repetitions) {
+    fprintf(file, "{\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"benchmarks\": [\n", SUITE_WARMUP, repetitions);
+    bool first = true;
+    for (int i = 0; i < SUITE_SIZE; i++) {
+        SuiteResult* r = &results[i];
+        if (!r->ok) continue;
+        fprintf(file, "%s    {\"name\": \"%s\", \"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f, "
+            "\"mb_per_s\": %.1f, \"allocated\": %zu, \"allocated_bytes\": %zu, \"minor_gcs\": %d, "
+            "\"major_gcs\": %d, \"peak_rss_kb\": %ld}",
+            first ? "" : ",\n", suite[i].name, r->median * 1e3, r->p95 * 1e3, r->min * 1e3,
+            r->megabytesPerSecond, r->allocated, r->allocatedBytes, r->minorCollections,
+            r->majorCollections, r->peakRSS);
+        first = false;
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+// la mediana de 'name' en un JSON escrito por writeSuiteJSON(). Devuelve false si no está.
+static bool readBaseline(const char* path, const char* name, double* median) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+    char key[256];
+    sprintf_s(key, sizeof(key), "\"name\": \"%s\",", name);
+    char line[1024];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        const char* value = strstr(line, key) ? strstr(line, "\"median_ms\": ") : NULL;
+        found = value != NULL && sscanf(value + 13, "%lf", median) == 1;
+    }
+    fclose(file);
+    return found;
+}
+
+// compara las medianas con las de la base. Devuelve cuántas regresiones hay.
+static int compareBaseline(const char* path, SuiteResult* results) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stdout, "no baseline at %s (make bench-baseline writes one)\n", path);
+        return 0;
+    }
+    fclose(file);
+
+    int regressions = 0;
+    fprintf(stdout, "compared with %s (tolerance %.0f%%):\n", path, SUITE_TOLERANCE * 100);
+    for (int i = 0; i < SUITE_SIZE; i++) {
+        double base;
+        if (!results[i].ok || !readBaseline(path, suite[i].name, &base) || base <= 0) continue;
+        double current = results[i].median * 1e3;
+        double change = current / base - 1;
+        bool regression = change > SUITE_TOLERANCE;
+        fprintf(stdout, "  %-22s %10.3f ms -> %10.3f ms  %+6.1f%%%s\n", suite[i].name, base, current,
+            change * 100, regression ? "  REGRESSION" : "");
+        regressions += regression ? 1 : 0;
+    }
+    return regressions;
+}
+
+/**
+ * cmonk-bench suite [--reps=N] [--out=file] [--baseline=file] [nombre...]
+ * Corre la suite (o solo los benchmarks nombrados), escribe los resultados en
+ * JSON y los compara con la base. Sale con 1 si alguno empeoró más de
+ * SUITE_TOLERANCE.
+ */
+static int runSuite(int argc, const char* argv[]) {
+    int repetitions = SUITE_REPETITIONS;
+    const char* outPath = NULL;
+    const char* baselinePath = NULL;
+    int selected = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--reps=", 7) == 0) {
+            repetitions = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            outPath = argv[i] + 6;
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            baselinePath = argv[i] + 11;
+        } else {
+            selected += 1;
+        }
+    }
+    if (repetitions < 1 || repetitions > SUITE_MAX_REPETITIONS) {
+        fprintf(stderr, "Usage: cmonk-bench suite [--reps=1..%d] [--out=file] [--baseline=file] [name...]\n",
+            SUITE_MAX_REPETITIONS);
+        return 74;
+    }
+
+    SuiteResult results[SUITE_SIZE];
+    memset(results, 0, sizeof(results));
+    for (int i = 0; i < SUITE_SIZE; i++) {
+        bool wanted = (selected == 0);
+        for (int j = 0; j < argc && !wanted; j++) {
+            wanted = strcmp(argv[j], suite[i].name) == 0;
+        }
+        if (!wanted) continue;
+        runIsolated(&suite[i], repetitions, &results[i]);
+        SuiteResult* r = &results[i];
+        if (!r->ok) {
+            fprintf(stdout, "suite %-22s FAILED\n", suite[i].name);
+            continue;
+        }
+        fprintf(stdout, "suite %-22s median %9.3f ms  p95 %9.3f ms  %10zu objects  %8ld KB peak RSS",
+            suite[i].name, r->median * 1e3, r->p95 * 1e3, r->allocated, r->peakRSS);
+        if (r->megabytesPerSecond > 0) fprintf(stdout, "  %8.1f MB/s", r->megabytesPerSecond);
+        fprintf(stdout, "\n");
+    }
+
+    if (outPath != NULL) {
+        FILE* file = fopen(outPath, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open file \"%s\".\n", outPath);
+            return 74;
+        }
+        writeSuiteJSON(file, results, repetitions);
+        fclose(file);
+    } else {
+        writeSuiteJSON(stdout, results, repetitions);
+    }
+    if (baselinePath != NULL && compareBaseline(baselinePath, results) > 0) return 1;
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    // la suite inicializa el evaluador en cada proceso hijo.
+    if (argc > 1 && strcmp(argv[1], "suite") == 0) {
+#ifdef _WIN32
+        initEvaluator();
+        initScanner();
+#endif
+        return runSuite(argc - 2, argv + 2);
+    }
+
+    initEvaluator();
+    initScanner();
+
+    // 'cmonk-bench gc': solo el GC, para que el pico de RSS sea el de estos programas.
+    if (argc > 1 && strcmp(argv[1], "gc") == 0) {
+        benchAlloc("nursery", 10 * 1000 * 1000, false);
+        benchAlloc("tenured", 10 * 1000 * 1000, true);
+        benchMallocPairs("malloc-pairs", 10 * 1000 * 1000);
+        benchGC("strings-ast", stringProgram, ENGINE_AST);
+        benchGC("strings-vm", stringProgram, ENGINE_VM);
+        benchMarkers("live-heap-1-marker", liveHeapProgram, 1);
+        benchMarkers("live-heap-n-markers", liveHeapProgram, 0);
+        fprintf(stdout, "peak RSS %ld KB\n", peakRSS());
+        return 0;
+    }
+    benchLexer("mixed-1KB", mixedSnippet, 1024);
+    benchLexer("mixed-1MB", mixedSnippet, 1024 * 1024);
+    benchLexer("mixed-100MB", mixedSnippet, 100 * 1024 * 1024);
+
+    compareScanModes("mixed-16MB", mixedSnippet);
+    compareScanModes("identifiers-16MB", identifierSnippet);
+    compareScanModes("strings-16MB", stringSnippet);
+
+    int threads = cpuCount();
+    benchTokenize("mixed-100MB", mixedSnippet, 100 * 1024 * 1024, 1);
+    benchTokenize("mixed-100MB", mixedSnippet, 100 * 1024 * 1024, threads);
+    benchTokenize("multiline-100MB", multilineSnippet, 100 * 1024 * 1024, 1);
+    benchTokenize("multiline-100MB", multilineSnippet, 100 * 1024 * 1024, threads);
+
+    benchParse("mixed-1MB", mixedSnippet, 1024 * 1024);
+    benchParse("mixed-16MB", mixedSnippet, 16 * 1024 * 1024);
+    benchTreeWalk("mixed-16MB", mixedSnippet, 16 * 1024 * 1024);
+
+    benchGC("fib-ast", fibProgram, ENGINE_AST);
+    benchGC("strings-ast", stringProgram, ENGINE_AST);
+    benchGC("strings-vm", stringProgram, ENGINE_VM);
+    benchGC("closures-ast", closureProgram, ENGINE_AST);
+    benchGC("closures-vm", closureProgram, ENGINE_VM);
+    benchMarkers("live-heap-1-marker", liveHeapProgram, 1);
+    benchMarkers("live-heap-n-markers", liveHeapProgram, 0);
+    return 0;
+}
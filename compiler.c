@@ -0,0 +1,511 @@
+#include "compiler.h"
+#include "heapprof.h"
+
+/**
+ * Compiler: estado de la función que se está compilando. Los arrays crecen
+ * con realloc y al terminar se copian a la arena del programa.
+ */
+typedef struct sCompiler {
+    uint8_t* code;
+    int count;
+    int capacity;
+    Value* constants;
+    int constantCount;
+    int constantCapacity;
+    CompiledFunction** functions;
+    int functionCount;
+    int functionCapacity;
+    int stackDepth; // temporales en la pila en este punto del código
+    int maxStack;
+    bool needsEnv;
+#ifdef HEAP_PROFILE
+    int* sites; // sitio de cada byte emitido
+#endif
+    struct sCompiler* enclosing;
+} Compiler;
+
+// con HEAP_PROFILE cada byte emitido recuerda el sitio del nodo que lo generó.
+#ifdef HEAP_PROFILE
+#define EMIT_SITE(site) (emitSite = (site))
+#else
+#define EMIT_SITE(site) ((void)0)
+#endif
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void* growArray(void* array, int* capacity, size_t size);
+static void* copyToArena(const void* source, size_t size);
+static void initCompiler(Compiler* compiler, bool needsEnv);
+static void emitByte(uint8_t byte);
+static void emitShort(int value);
+static void emitLong(uint32_t value);
+static void emitOp(OpCode op, int stackEffect);
+static int addConstant(Value constant);
+static void emitConstant(Value constant);
+static int emitJump(OpCode op, int stackEffect);
+static void patchJump(int offset);
+static void compileGet(IdentifierNode* node);
+static void compileSet(IdentifierNode* node);
+static void compileBlock(ArrayStmt* stmts);
+static void compileStatement(Statement* stmt);
+static void compileExpression(Expression* exp);
+static bool isLocalConstant(InfixNode* infix);
+static void emitLocalConstant(OpCode op, InfixNode* infix);
+static void compileCondition(IfNode* node, int* elseJump);
+static void compileReturn(Expression* value, int stackEffect);
+static void compileCall(CallNode* node);
+static void compileFunctionBody(ArrayStmt* body);
+static void compileFunctionLiteral(FunctionNode* node);
+static CompiledFunction* endCompiler(FunctionNode* node);
+CompiledFunction* compileProgram(Program* program);
+
+static Compiler* current = NULL; // función que se está compilando
+static Arena* arena; // arena del programa que se está compilando
+#ifdef HEAP_PROFILE
+static int emitSite; // sitio de los siguientes bytes
+#endif
+
+// operador binario de cada token (solo los que tienen un infix).
+static OpCode infixOps[] = {
+    [T_PLUS]     = OP_ADD,
+    [T_MINUS]    = OP_SUB,
+    [T_ASTERISK] = OP_MUL,
+    [T_SLASH]    = OP_DIV,
+    [T_LT]       = OP_LT,
+    [T_GT]       = OP_GT,
+    [T_EQ]       = OP_EQ,
+    [T_NOT_EQ]   = OP_NOT_EQ,
+};
+
+// superinstrucciones de cada operador (ver compiler.h); OP_CONSTANT si no la tiene.
+static OpCode localConstOps[T_NOT_EQ + 1] = {
+    [T_PLUS]     = OP_ADD_LOCAL_CONST,
+    [T_MINUS]    = OP_SUB_LOCAL_CONST,
+    [T_LT]       = OP_LT_LOCAL_CONST,
+    [T_EQ]       = OP_EQ_LOCAL_CONST,
+};
+static OpCode compareJumps[T_NOT_EQ + 1] = {
+    [T_LT]       = OP_JUMP_IF_NOT_LT,
+    [T_GT]       = OP_JUMP_IF_NOT_GT,
+    [T_EQ]       = OP_JUMP_IF_NOT_EQ,
+    [T_NOT_EQ]   = OP_JUMP_IF_EQ,
+};
+static OpCode returnOps[T_NOT_EQ + 1] = {
+    [T_PLUS]     = OP_ADD_RETURN,
+    [T_MINUS]    = OP_SUB_RETURN,
+};
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void* growArray(void* array, int* capacity, size_t size) {
+    *capacity = (*capacity == 0) ? FIRST_ARRAY_CAPACITY : *capacity * GROWING_ARRAY_FACTOR;
+    array = realloc(array, size * (*capacity));
+    if (array == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    return array;
+}
+
+static void* copyToArena(const void* source, size_t size) {
+    if (size == 0) return NULL;
+    void* copy = arenaAlloc(arena, size);
+    memcpy(copy, source, size);
+    return copy;
+}
+
+static void initCompiler(Compiler* compiler, bool needsEnv) {
+    compiler->code = NULL;
+    compiler->count = 0;
+    compiler->capacity = 0;
+    compiler->constants = NULL;
+    compiler->constantCount = 0;
+    compiler->constantCapacity = 0;
+    compiler->functions = NULL;
+    compiler->functionCount = 0;
+    compiler->functionCapacity = 0;
+    compiler->stackDepth = 0;
+    compiler->maxStack = 0;
+    compiler->needsEnv = needsEnv;
+#ifdef HEAP_PROFILE
+    compiler->sites = NULL;
+#endif
+    compiler->enclosing = current;
+    current = compiler;
+}
+
+static void emitByte(uint8_t byte) {
+    if (current->capacity < (current->count + 1)) {
+        current->code = growArray(current->code, &current->capacity, sizeof(uint8_t));
+#ifdef HEAP_PROFILE
+        current->sites = realloc(current->sites, sizeof(int) * current->capacity);
+        if (current->sites == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+#endif
+    }
+#ifdef HEAP_PROFILE
+    current->sites[current->count] = emitSite;
+#endif
+    current->code[current->count++] = byte;
+}
+
+static void emitShort(int value) {
+    if (value > UINT16_MAX) {
+        fprintf(stderr, "ERROR: too many local variables in one function.\n");
+        exit(74);
+    }
+    emitByte(value & 0xff);
+    emitByte((value >> 8) & 0xff);
+}
+
+static void emitLong(uint32_t value) {
+    emitByte(value & 0xff);
+    emitByte((value >> 8) & 0xff);
+    emitByte((value >> 16) & 0xff);
+    emitByte((value >> 24) & 0xff);
+}
+
+// emite el opcode y lleva la cuenta de la profundidad de la pila.
+static void emitOp(OpCode op, int stackEffect) {
+    emitByte(op);
+    current->stackDepth += stackEffect;
+    if (current->stackDepth > current->maxStack) {
+        current->maxStack = current->stackDepth;
+    }
+}
+
+static int addConstant(Value constant) {
+    if (current->constantCapacity < (current->constantCount + 1)) {
+        current->constants = growArray(current->constants, &current->constantCapacity, sizeof(Value));
+    }
+    current->constants[current->constantCount] = constant;
+    return current->constantCount++;
+}
+
+static void emitConstant(Value constant) {
+    int index = addConstant(constant);
+    if (index <= UINT16_MAX) {
+        emitOp(OP_CONSTANT, 1);
+        emitShort(index);
+    } else {
+        emitOp(OP_CONSTANT_LONG, 1);
+        emitLong(index);
+    }
+}
+
+// emite un salto con la distancia por rellenar; devuelve dónde está el operando.
+static int emitJump(OpCode op, int stackEffect) {
+    emitOp(op, stackEffect);
+    emitByte(0xff);
+    emitByte(0xff);
+    return current->count - 2;
+}
+
+static void patchJump(int offset) {
+    int jump = current->count - offset - 2;
+    if (jump > UINT16_MAX) {
+        fprintf(stderr, "ERROR: too much code to jump over.\n");
+        exit(74);
+    }
+    current->code[offset] = jump & 0xff;
+    current->code[offset + 1] = (jump >> 8) & 0xff;
+}
+
+/**
+ * Lectura de una variable con el (depth, slot) que dejó el resolver.
+ * En OP_GET_ENV los saltos se cuentan desde el Environment del frame: el
+ * propio si la función lo necesita, o el del closure si los locales están
+ * en la pila (y entonces hay un scope menos que subir).
+ */
+static void compileGet(IdentifierNode* node) {
+    if (node->depth == GLOBAL_DEPTH) {
+        emitOp(OP_GET_GLOBAL, 1);
+        emitLong(node->slot);
+    } else if (node->depth == 0 && !current->needsEnv) {
+        emitOp(OP_GET_LOCAL, 1);
+        emitShort(node->slot);
+    } else {
+        emitOp(OP_GET_ENV, 1);
+        emitShort(current->needsEnv ? node->depth : node->depth - 1);
+        emitShort(node->slot);
+    }
+}
+
+// un 'let' siempre define en el scope actual (depth 0) o en el global.
+static void compileSet(IdentifierNode* node) {
+    if (node->depth == GLOBAL_DEPTH) {
+        emitOp(OP_SET_GLOBAL, 0);
+        emitLong(node->slot);
+    } else if (!current->needsEnv) {
+        emitOp(OP_SET_LOCAL, 0);
+        emitShort(node->slot);
+    } else {
+        emitOp(OP_SET_ENV, 0);
+        emitShort(node->slot);
+    }
+}
+
+// un bloque deja en la pila el valor de su última sentencia (null si está vacío).
+static void compileBlock(ArrayStmt* stmts) {
+    if (stmts->count == 0) {
+        emitOp(OP_NULL, 1);
+        return;
+    }
+    for (int i = 0; i < stmts->count; i++) {
+        if (i > 0) emitOp(OP_POP, -1);
+        compileStatement(stmts->statements[i]);
+    }
+}
+
+static void compileStatement(Statement* stmt) {
+    switch (stmt->type) {
+    case NT_LET:
+        compileExpression(((LetStatement*)stmt)->value);
+        compileSet(((LetStatement*)stmt)->name);
+        break;
+    case NT_RETURN:
+        compileReturn(((ReturnStatement*)stmt)->value, 0); // el valor sigue contando para el resto del bloque.
+        break;
+    case NT_EXPR:
+        compileExpression(((ExpressionStatement*)stmt)->expression);
+        break;
+    }
+}
+
+static void compileExpression(Expression* exp) {
+    if (exp == NULL) {
+        emitOp(OP_NULL, 1);
+        return;
+    }
+    switch (exp->type) {
+    case NT_INTEGER:
+        emitConstant(((IntegerNode*)exp)->constant);
+        break;
+    case NT_STRING:
+        emitConstant(((StringNode*)exp)->constant);
+        break;
+    case NT_NULL:
+        emitOp(OP_NULL, 1);
+        break;
+    case NT_BOOLEAN:
+        emitOp(((BooleanNode*)exp)->value ? OP_TRUE : OP_FALSE, 1);
+        break;
+    case NT_IDENT:
+        compileGet((IdentifierNode*)exp);
+        break;
+    case NT_PREFIX:
+        {
+            PrefixNode* prefix = (PrefixNode*)exp;
+            compileExpression(prefix->right);
+            EMIT_SITE(prefix->site);
+            if (prefix->operator == T_BANG) emitOp(OP_NOT, 0);
+            else if (prefix->operator == T_MINUS) emitOp(OP_NEGATE, 0);
+            else {
+                emitOp(OP_POP, -1); // evalPrefixExpression devuelve null
+                emitOp(OP_NULL, 1);
+            }
+            break;
+        }
+    case NT_INFIX:
+        {
+            InfixNode* infix = (InfixNode*)exp;
+            if (localConstOps[infix->operator] != OP_CONSTANT && isLocalConstant(infix)) {
+                EMIT_SITE(infix->site);
+                emitLocalConstant(localConstOps[infix->operator], infix);
+                break;
+            }
+            compileExpression(infix->left);
+            compileExpression(infix->right);
+            EMIT_SITE(infix->site);
+            emitOp(infixOps[infix->operator], -1);
+            break;
+        }
+    case NT_IF:
+        {
+            IfNode* node = (IfNode*)exp;
+            int elseJump;
+            compileCondition(node, &elseJump);
+            compileBlock(node->consequence);
+            int endJump = emitJump(OP_JUMP, 0);
+            current->stackDepth -= 1; // solo una de las dos ramas deja su valor
+            patchJump(elseJump);
+            if (node->alternative != NULL) {
+                compileBlock(node->alternative);
+            } else {
+                emitOp(OP_NULL, 1);
+            }
+            patchJump(endJump);
+            break;
+        }
+    case NT_FUNCTION:
+        compileFunctionLiteral((FunctionNode*)exp);
+        break;
+    case NT_CALL:
+        compileCall((CallNode*)exp);
+        break;
+    default:
+        emitOp(OP_NULL, 1);
+    }
+}
+
+/**
+ * ¿Se puede compilar el infix como 'local op constante'? El local tiene que
+ * estar en la pila (como en OP_GET_LOCAL) y la constante ser un entero.
+ */
+static bool isLocalConstant(InfixNode* infix) {
+    if (infix->left == NULL || infix->right == NULL) return false;
+    if (infix->left->type != NT_IDENT || infix->right->type != NT_INTEGER) return false;
+    IdentifierNode* local = (IdentifierNode*)infix->left;
+    return local->depth == 0 && !current->needsEnv && IS_INT(((IntegerNode*)infix->right)->constant)
+        && current->constantCount <= UINT16_MAX;
+}
+
+static void emitLocalConstant(OpCode op, InfixNode* infix) {
+    int index = addConstant(((IntegerNode*)infix->right)->constant);
+    emitOp(op, 1);
+    emitShort(((IdentifierNode*)infix->left)->slot);
+    emitShort(index);
+}
+
+/**
+ * Condición de un if y su salto a la rama else. 'local < constante' y
+ * 'local == constante' van con su superinstrucción y OP_JUMP_IF_FALSE; el
+ * resto de comparaciones saltan con su propio opcode sin apilar el booleano.
+ */
+static void compileCondition(IfNode* node, int* elseJump) {
+    Expression* condition = node->condition;
+    if (condition != NULL && condition->type == NT_INFIX) {
+        InfixNode* infix = (InfixNode*)condition;
+        OpCode jump = compareJumps[infix->operator];
+        if (jump != OP_CONSTANT && !(localConstOps[infix->operator] != OP_CONSTANT && isLocalConstant(infix))) {
+            compileExpression(infix->left);
+            compileExpression(infix->right);
+            EMIT_SITE(infix->site);
+            *elseJump = emitJump(jump, -2);
+            return;
+        }
+    }
+    compileExpression(condition);
+    *elseJump = emitJump(OP_JUMP_IF_FALSE, -1);
+}
+
+// 'return a + b' y 'return a - b' operan y vuelven en un solo opcode.
+static void compileReturn(Expression* value, int stackEffect) {
+    if (value != NULL && value->type == NT_INFIX) {
+        InfixNode* infix = (InfixNode*)value;
+        OpCode op = returnOps[infix->operator];
+        if (op != OP_CONSTANT && !isLocalConstant(infix)) {
+            compileExpression(infix->left);
+            compileExpression(infix->right);
+            EMIT_SITE(infix->site);
+            emitOp(op, stackEffect - 1);
+            return;
+        }
+    }
+    compileExpression(value);
+    emitOp(OP_RETURN, stackEffect);
+}
+
+/**
+ * f(local - constante): el argumento y la llamada en OP_CALL_SUB_LOCAL_CONST.
+ * Las llamadas de cola que marcó el resolver van con OP_TAIL_CALL; el código
+ * que vuelve con su valor se emite igual (lo usan las llamadas a builtins).
+ */
+static void compileCall(CallNode* node) {
+    compileExpression(node->function);
+    if (!node->tail && node->argc == 1 && node->arguments[0] != NULL && node->arguments[0]->type == NT_INFIX) {
+        InfixNode* argument = (InfixNode*)node->arguments[0];
+        if (argument->operator == T_MINUS && isLocalConstant(argument)) {
+            EMIT_SITE(node->site);
+            emitLocalConstant(OP_CALL_SUB_LOCAL_CONST, argument);
+            current->stackDepth -= 1; // el resultado ocupa el sitio de la función
+            return;
+        }
+    }
+    for (int i = 0; i < node->argc; i++) {
+        compileExpression(node->arguments[i]);
+    }
+    EMIT_SITE(node->site);
+    emitOp(node->tail ? OP_TAIL_CALL : OP_CALL, -node->argc);
+    emitByte(node->argc);
+}
+
+// como compileBlock() y OP_RETURN, pero el valor de la última sentencia vuelve con compileReturn().
+static void compileFunctionBody(ArrayStmt* body) {
+    int last = body->count - 1;
+    if (last < 0 || body->statements[last]->type != NT_EXPR) {
+        compileBlock(body);
+        emitOp(OP_RETURN, -1);
+        return;
+    }
+    for (int i = 0; i < last; i++) {
+        compileStatement(body->statements[i]);
+        emitOp(OP_POP, -1);
+    }
+    compileReturn(((ExpressionStatement*)body->statements[last])->expression, -1);
+}
+
+static void compileFunctionLiteral(FunctionNode* node) {
+    Compiler compiler;
+    initCompiler(&compiler, node->needsEnv); // lo decide el resolver (ver resolver.h)
+    compileFunctionBody(node->body);
+    CompiledFunction* function = endCompiler(node);
+
+    if (current->functionCapacity < (current->functionCount + 1)) {
+        current->functions = growArray(current->functions, &current->functionCapacity, sizeof(CompiledFunction*));
+    }
+    int index = current->functionCount++;
+    current->functions[index] = function;
+    EMIT_SITE(node->site);
+    emitOp(OP_CLOSURE, 1);
+    emitShort(index);
+}
+
+// pasa el código de 'current' a la arena y vuelve a la función que lo contiene.
+static CompiledFunction* endCompiler(FunctionNode* node) {
+    CompiledFunction* function = createNode(arena, CompiledFunction);
+    function->code = copyToArena(current->code, current->count);
+    function->count = current->count;
+    function->constants = copyToArena(current->constants, sizeof(Value) * current->constantCount);
+    function->constantCount = current->constantCount;
+    function->functions = copyToArena(current->functions, sizeof(CompiledFunction*) * current->functionCount);
+    function->functionCount = current->functionCount;
+    function->node = node;
+    function->arity = (node != NULL) ? node->arity : 0;
+    function->localCount = (node != NULL) ? node->localCount : 0;
+    function->locals = (node != NULL) ? node->locals : NULL;
+    function->maxStack = current->maxStack;
+    function->needsEnv = current->needsEnv;
+    function->simpleParams = true;
+    for (int i = 0; i < function->arity; i++) {
+        if (node->parameters[i]->slot != i) function->simpleParams = false;
+    }
+#ifdef HEAP_PROFILE
+    function->sites = copyToArena(current->sites, sizeof(int) * current->count);
+    free(current->sites);
+#endif
+
+    free(current->code);
+    free(current->constants);
+    free(current->functions);
+    current = current->enclosing;
+
+    return function;
+}
+
+// el programa ya pasó por el resolver: las variables tienen su (depth, slot).
+CompiledFunction* compileProgram(Program* program) {
+    arena = program->arena;
+    Compiler compiler;
+    initCompiler(&compiler, false);
+    compileBlock(program->statements);
+    emitOp(OP_RETURN, -1);
+    CompiledFunction* function = endCompiler(NULL);
+    arena = NULL;
+
+    return function;
+}
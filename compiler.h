@@ -0,0 +1,94 @@
+#ifndef cmonk_compiler_h
+#define cmonk_compiler_h
+
+#include <stdint.h>
+#include "resolver.h"
+#include "object.h"
+
+/**
+ * Bytecode para la máquina virtual (vm.c).
+ * Cada instrucción es un byte de opcode seguido de sus operandos en little
+ * endian. Los comentarios indican los operandos y el efecto sobre la pila.
+ *
+ * Las superinstrucciones del final juntan en un opcode las secuencias que más
+ * se ejecutan (medidas con -DEVAL_STATS, ver evalstats.h): el compilador las
+ * emite en lugar de la secuencia y hacen lo mismo que ella.
+ */
+typedef enum {
+    OP_CONSTANT,        // u16 índice        -> valor
+    OP_CONSTANT_LONG,   // u32 índice        -> valor
+    OP_NULL,            //                   -> null
+    OP_TRUE,            //                   -> true
+    OP_FALSE,           //                   -> false
+    OP_POP,             // valor             ->
+    OP_GET_LOCAL,       // u16 slot          -> valor       (slot en la pila)
+    OP_SET_LOCAL,       // u16 slot          valor -> valor
+    OP_GET_ENV,         // u16 saltos, u16 slot -> valor    (slot en un Environment)
+    OP_SET_ENV,         // u16 slot          valor -> valor
+    OP_GET_GLOBAL,      // u32 símbolo       -> valor
+    OP_SET_GLOBAL,      // u32 símbolo       valor -> valor
+    OP_NEGATE,          // valor             -> -valor
+    OP_NOT,             // valor             -> !valor
+    OP_ADD,             // a b               -> a + b
+    OP_SUB,             // a b               -> a - b
+    OP_MUL,             // a b               -> a * b
+    OP_DIV,             // a b               -> a / b
+    OP_LT,              // a b               -> a < b
+    OP_GT,              // a b               -> a > b
+    OP_EQ,              // a b               -> a == b
+    OP_NOT_EQ,          // a b               -> a != b
+    OP_JUMP,            // u16 distancia hacia adelante
+    OP_JUMP_IF_FALSE,   // u16 distancia     condición ->
+    OP_CLOSURE,         // u16 índice de la función -> closure
+    OP_CALL,            // u8 argc           función args... -> resultado
+    OP_TAIL_CALL,       // u8 argc           función args... -> resultado   (reutiliza el frame, ver vm.c)
+    OP_RETURN,          // valor             -> (vuelve al llamador)
+    // superinstrucciones ('local' es un slot en la pila, 'const' un índice de constante entera)
+    OP_LT_LOCAL_CONST,  // u16 slot, u16 índice -> local < const
+    OP_EQ_LOCAL_CONST,  // u16 slot, u16 índice -> local == const
+    OP_ADD_LOCAL_CONST, // u16 slot, u16 índice -> local + const
+    OP_SUB_LOCAL_CONST, // u16 slot, u16 índice -> local - const
+    OP_CALL_SUB_LOCAL_CONST, // u16 slot, u16 índice  función -> resultado de función(local - const)
+    OP_JUMP_IF_NOT_LT,  // u16 distancia     a b ->   (salta si no a < b)
+    OP_JUMP_IF_NOT_GT,  // u16 distancia     a b ->   (salta si no a > b)
+    OP_JUMP_IF_NOT_EQ,  // u16 distancia     a b ->   (salta si no a == b)
+    OP_JUMP_IF_EQ,      // u16 distancia     a b ->   (salta si no a != b)
+    OP_ADD_RETURN,      // a b               -> (vuelve con a + b)
+    OP_SUB_RETURN,      // a b               -> (vuelve con a - b)
+} OpCode;
+
+/**
+ * CompiledFunction: el código de una función (o del nivel superior de un
+ * programa). Vive en la arena del programa, igual que el FunctionNode del que
+ * sale, así que dura lo mismo que los closures que la usan.
+ *
+ * Si algún closure del cuerpo guarda su Environment ('needsEnv') las
+ * variables locales de cada llamada van en un Environment, como en el tree
+ * walker. Si no, van directamente en la pila de la VM (los closures que solo
+ * copian variables las leen de ahí).
+ */
+typedef struct sCompiledFunction {
+    uint8_t* code;
+    int count;
+    Value* constants;
+    int constantCount;
+    struct sCompiledFunction** functions; // funciones anidadas (OP_CLOSURE)
+    int functionCount;
+    FunctionNode* node; // NULL en el nivel superior
+    int arity;
+    int localCount;
+    const int* locals; // símbolo de cada slot local
+    int maxStack; // máximo de temporales en la pila (sin contar los locales)
+    bool needsEnv;
+    bool simpleParams; // el parámetro i está en el slot i (sin nombres repetidos)
+#ifdef HEAP_PROFILE
+    int* sites; // sitio de reserva de cada byte de 'code' (ver heapprof.h)
+#endif
+} CompiledFunction;
+
+/*================================================================/
+* PUBLIC COMPILER API
+*=================================================================*/
+CompiledFunction* compileProgram(Program* program);
+
+#endif
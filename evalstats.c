@@ -0,0 +1,324 @@
+#include "evalstats.h"
+#include "gcstats.h"
+#include "compiler.h"
+
+EvalStats evalCounters;
+uint64_t evalChildTicks;
+int evalLastOpcode;
+
+static CallSite* callSites; // el 0 es el de las llamadas sin registrar
+static int callSiteCount;
+static int callSiteCapacity;
+// para pasar ticks a segundos: ticks y segundos desde resetEvalStats()
+static uint64_t startTicks;
+static double startTime;
+
+// nombres de los NodeType para el informe del tree walker.
+static const char* nodeTypeNames[EVAL_NODE_TYPES] = {
+    [NT_EXPR] = "expression statement",
+    [NT_LET] = "let",
+    [NT_RETURN] = "return",
+    [NT_IDENT] = "identifier",
+    [NT_INTEGER] = "integer",
+    [NT_STRING] = "string",
+    [NT_BOOLEAN] = "boolean",
+    [NT_NULL] = "null",
+    [NT_PREFIX] = "prefix",
+    [NT_INFIX] = "infix",
+    [NT_IF] = "if",
+    [NT_FUNCTION] = "function",
+    [NT_CALL] = "call",
+    [NT_IDENT_GLOBAL] = "identifier (global)",
+    [NT_IDENT_LOCAL] = "identifier (local)",
+    [NT_IDENT_OUTER] = "identifier (outer)",
+    [NT_PREFIX_MINUS_INT] = "prefix (-int)",
+    [NT_PREFIX_BANG_BOOL] = "prefix (!bool)",
+    [NT_PREFIX_GENERIC] = "prefix (generic)",
+    [NT_INFIX_ADD_INT] = "infix (int + int)",
+    [NT_INFIX_SUB_INT] = "infix (int - int)",
+    [NT_INFIX_MUL_INT] = "infix (int * int)",
+    [NT_INFIX_DIV_INT] = "infix (int / int)",
+    [NT_INFIX_LT_INT] = "infix (int < int)",
+    [NT_INFIX_GT_INT] = "infix (int > int)",
+    [NT_INFIX_EQ_INT] = "infix (int == int)",
+    [NT_INFIX_NOT_EQ_INT] = "infix (int != int)",
+    [NT_INFIX_ADD_STRING] = "infix (string + string)",
+    [NT_INFIX_GENERIC] = "infix (generic)",
+    [NT_CALL_FUNCTION] = "call (monomorphic)",
+    [NT_CALL_GENERIC] = "call (generic)",
+};
+
+// nombres de los OpCode para el informe de la VM.
+static const char* opcodeNames[EVAL_OPCODES] = {
+    [OP_CONSTANT] = "CONSTANT",
+    [OP_CONSTANT_LONG] = "CONSTANT_LONG",
+    [OP_NULL] = "NULL",
+    [OP_TRUE] = "TRUE",
+    [OP_FALSE] = "FALSE",
+    [OP_POP] = "POP",
+    [OP_GET_LOCAL] = "GET_LOCAL",
+    [OP_SET_LOCAL] = "SET_LOCAL",
+    [OP_GET_ENV] = "GET_ENV",
+    [OP_SET_ENV] = "SET_ENV",
+    [OP_GET_GLOBAL] = "GET_GLOBAL",
+    [OP_SET_GLOBAL] = "SET_GLOBAL",
+    [OP_NEGATE] = "NEGATE",
+    [OP_NOT] = "NOT",
+    [OP_ADD] = "ADD",
+    [OP_SUB] = "SUB",
+    [OP_MUL] = "MUL",
+    [OP_DIV] = "DIV",
+    [OP_LT] = "LT",
+    [OP_GT] = "GT",
+    [OP_EQ] = "EQ",
+    [OP_NOT_EQ] = "NOT_EQ",
+    [OP_JUMP] = "JUMP",
+    [OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE",
+    [OP_CLOSURE] = "CLOSURE",
+    [OP_CALL] = "CALL",
+    [OP_TAIL_CALL] = "TAIL_CALL",
+    [OP_RETURN] = "RETURN",
+    [OP_LT_LOCAL_CONST] = "LT_LOCAL_CONST",
+    [OP_EQ_LOCAL_CONST] = "EQ_LOCAL_CONST",
+    [OP_ADD_LOCAL_CONST] = "ADD_LOCAL_CONST",
+    [OP_SUB_LOCAL_CONST] = "SUB_LOCAL_CONST",
+    [OP_CALL_SUB_LOCAL_CONST] = "CALL_SUB_LOCAL_CONST",
+    [OP_JUMP_IF_NOT_LT] = "JUMP_IF_NOT_LT",
+    [OP_JUMP_IF_NOT_GT] = "JUMP_IF_NOT_GT",
+    [OP_JUMP_IF_NOT_EQ] = "JUMP_IF_NOT_EQ",
+    [OP_JUMP_IF_EQ] = "JUMP_IF_EQ",
+    [OP_ADD_RETURN] = "ADD_RETURN",
+    [OP_SUB_RETURN] = "SUB_RETURN",
+};
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void initCallSites();
+static int compareCallSites(const void* a, const void* b);
+static void writeHops(FILE* file, const char* label, const uint64_t* hops);
+static const char* opcodeName(int op);
+static int compareOpcodePairs(const void* a, const void* b);
+static void writeOpcodes(FILE* file);
+static uint64_t ticksNow();
+uint64_t evalTicks();
+void countEvaluation(const Node* node, uint64_t elapsed, uint64_t self);
+int newCallSite(int symbol, int position);
+void resetEvalStats();
+void writeEvalStats(FILE* file);
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void initCallSites() {
+    if (callSiteCount > 0) return;
+    callSiteCapacity = 64;
+    callSites = malloc(sizeof(CallSite) * callSiteCapacity);
+    if (callSites == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    callSites[callSiteCount++] = (CallSite){ NO_SYMBOL, 0, 0, 0, 0 };
+}
+
+// de más a menos tiempo.
+static int compareCallSites(const void* a, const void* b) {
+    const CallSite* x = *(const CallSite* const*)a;
+    const CallSite* y = *(const CallSite* const*)b;
+    return (x->ticks < y->ticks) - (x->ticks > y->ticks);
+}
+
+static void writeHops(FILE* file, const char* label, const uint64_t* hops) {
+    fprintf(file, "  %-10s", label);
+    for (int i = 0; i <= EVAL_MAX_HOPS; i++) {
+        fprintf(file, " %s%d: %llu", (i == EVAL_MAX_HOPS) ? ">=" : "", i, (unsigned long long)hops[i]);
+    }
+    fprintf(file, "\n");
+}
+
+static const char* opcodeName(int op) {
+    return (opcodeNames[op] != NULL) ? opcodeNames[op] : "?";
+}
+
+// de más a menos veces.
+static int compareOpcodePairs(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Opcodes que ejecutó la VM y las parejas de opcodes seguidos que más se
+ * repiten (incluida la del CALL con el primer opcode de la función llamada).
+ */
+static void writeOpcodes(FILE* file) {
+    uint64_t executed = 0;
+    for (int i = 0; i < EVAL_OPCODES; i++) {
+        executed += evalCounters.opcodes[i];
+    }
+    if (executed == 0) return;
+    fprintf(file, "vm opcodes: %llu executed\n%14s %7s  %s\n", (unsigned long long)executed, "count", "%", "opcode");
+    for (int i = 0; i < EVAL_OPCODES; i++) {
+        uint64_t count = evalCounters.opcodes[i];
+        if (count == 0) continue;
+        fprintf(file, "%14llu %6.2f%%  %s\n", (unsigned long long)count, 100.0 * count / executed, opcodeName(i));
+    }
+
+    // cada pareja como { veces, anterior * EVAL_OPCODES + siguiente }.
+    uint64_t (*pairs)[2] = malloc(sizeof(uint64_t[2]) * EVAL_OPCODES * EVAL_OPCODES);
+    if (pairs == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    int pairCount = 0;
+    for (int i = 0; i < EVAL_OPCODES; i++) {
+        for (int j = 0; j < EVAL_OPCODES; j++) {
+            if (evalCounters.opcodePairs[i][j] == 0) continue;
+            pairs[pairCount][0] = evalCounters.opcodePairs[i][j];
+            pairs[pairCount][1] = (uint64_t)(i * EVAL_OPCODES + j);
+            pairCount += 1;
+        }
+    }
+    qsort(pairs, pairCount, sizeof(uint64_t[2]), compareOpcodePairs);
+    fprintf(file, "vm opcode pairs:\n%14s %7s  %s\n", "count", "%", "pair");
+    for (int i = 0; i < pairCount && i < EVAL_TOP_OPCODE_PAIRS; i++) {
+        int first = (int)(pairs[i][1] / EVAL_OPCODES);
+        int second = (int)(pairs[i][1] % EVAL_OPCODES);
+        fprintf(file, "%14llu %6.2f%%  %s %s\n", (unsigned long long)pairs[i][0], 100.0 * pairs[i][0] / executed,
+            opcodeName(first), opcodeName(second));
+    }
+    free(pairs);
+}
+
+// los mismos ticks que EVAL_TICKS().
+static uint64_t ticksNow() {
+#ifdef EVAL_STATS
+    return EVAL_TICKS();
+#else
+    return evalTicks();
+#endif
+}
+
+// ticks en nanosegundos donde no hay contador de ciclos.
+uint64_t evalTicks() {
+    return (uint64_t)(gcClock() * 1e9);
+}
+
+/**
+ * Se llama al terminar de evaluar cada nodo: 'elapsed' es todo lo que tardó
+ * y 'self' lo que tardó sin contar a sus hijos.
+ */
+void countEvaluation(const Node* node, uint64_t elapsed, uint64_t self) {
+    evalCounters.byNode[node->type].count += 1;
+    evalCounters.byNode[node->type].ticks += self;
+    if (IS_INFIX_NODE(node->type)) {
+        TokenType operator = ((const InfixNode*)node)->operator;
+        evalCounters.byOperator[operator].count += 1;
+        evalCounters.byOperator[operator].ticks += self;
+    }
+#ifdef EVAL_STATS
+    if (IS_CALL_NODE(node->type)) {
+        CallSite* site = &callSites[((const CallNode*)node)->callSite];
+        site->count += 1;
+        site->ticks += elapsed;
+    }
+#else
+    (void)elapsed;
+#endif
+}
+
+/**
+ * El parser da de alta cada llamada del fuente. 'position' es el byte del '('
+ * y 'symbol' el nombre de la función si se llama a un identificador.
+ */
+int newCallSite(int symbol, int position) {
+    initCallSites();
+    if (callSiteCount == callSiteCapacity) {
+        callSiteCapacity *= 2;
+        callSites = realloc(callSites, sizeof(CallSite) * callSiteCapacity);
+        if (callSites == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    CallSite* site = &callSites[callSiteCount];
+    site->symbol = symbol;
+    sourcePosition(position, &site->line, &site->column);
+    site->count = 0;
+    site->ticks = 0;
+    return callSiteCount++;
+}
+
+// pone los contadores a cero (las llamadas registradas se quedan, sin contar).
+void resetEvalStats() {
+    initCallSites();
+    memset(&evalCounters, 0, sizeof(EvalStats));
+    evalLastOpcode = 0;
+    for (int i = 0; i < callSiteCount; i++) {
+        callSites[i].count = 0;
+        callSites[i].ticks = 0;
+    }
+    evalChildTicks = 0;
+    startTime = gcClock();
+    startTicks = ticksNow();
+}
+
+void writeEvalStats(FILE* file) {
+    initCallSites();
+    uint64_t nowTicks = ticksNow();
+    double seconds = gcClock() - startTime;
+    double ticksPerMs = (seconds > 0 && nowTicks > startTicks) ? (nowTicks - startTicks) / (seconds * 1e3) : 1e6;
+
+    uint64_t nodes = 0;
+    uint64_t ticks = 0;
+    for (int i = 0; i < EVAL_NODE_TYPES; i++) {
+        nodes += evalCounters.byNode[i].count;
+        ticks += evalCounters.byNode[i].ticks;
+    }
+    double total = (ticks > 0) ? (double)ticks : 1;
+    fprintf(file, "eval stats (tree walker): %llu nodes, %.3f ms measured in %.3f s\n",
+        (unsigned long long)nodes, ticks / ticksPerMs, seconds);
+
+    fprintf(file, "by node type (self time):\n%14s %12s %7s %9s  %s\n", "count", "ms", "%", "ns/node", "type");
+    for (int i = 0; i < EVAL_NODE_TYPES; i++) {
+        EvalCounter* c = &evalCounters.byNode[i];
+        if (c->count == 0) continue;
+        fprintf(file, "%14llu %12.3f %6.2f%% %9.1f  %s\n", (unsigned long long)c->count, c->ticks / ticksPerMs,
+            100.0 * c->ticks / total, c->ticks / ticksPerMs * 1e6 / c->count, nodeTypeNames[i]);
+    }
+
+    fprintf(file, "by infix operator (self time):\n%14s %12s %7s %9s  %s\n", "count", "ms", "%", "ns/node", "operator");
+    for (int i = 0; i < EVAL_TOKEN_TYPES; i++) {
+        EvalCounter* c = &evalCounters.byOperator[i];
+        if (c->count == 0) continue;
+        fprintf(file, "%14llu %12.3f %6.2f%% %9.1f  %s\n", (unsigned long long)c->count, c->ticks / ticksPerMs,
+            100.0 * c->ticks / total, c->ticks / ticksPerMs * 1e6 / c->count, tokenNames[i] + 2);
+    }
+
+    CallSite** sorted = malloc(sizeof(CallSite*) * callSiteCount);
+    if (sorted == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    for (int i = 0; i < callSiteCount; i++) {
+        sorted[i] = &callSites[i];
+    }
+    qsort(sorted, callSiteCount, sizeof(CallSite*), compareCallSites);
+    fprintf(file, "call sites (time including the callee; recursive calls count again):\n%14s %12s %9s  %s\n",
+        "count", "ms", "us/call", "site");
+    for (int i = 0; i < callSiteCount && i < EVAL_TOP_CALL_SITES; i++) {
+        CallSite* site = sorted[i];
+        if (site->count == 0) break;
+        fprintf(file, "%14llu %12.3f %9.3f  %s%s at %d:%d\n", (unsigned long long)site->count,
+            site->ticks / ticksPerMs, site->ticks / ticksPerMs * 1e3 / site->count,
+            (site->symbol == NO_SYMBOL) ? "call" : symbolName(site->symbol),
+            (site->symbol == NO_SYMBOL) ? "" : "()", site->line, site->column);
+    }
+    free(sorted);
+
+    fprintf(file, "scopes walked to read a variable:\n  global     %llu\n", (unsigned long long)evalCounters.globalReads);
+    writeHops(file, "resolved", evalCounters.scopeHops);
+    fprintf(file, "  get()      %llu lookups by name\n", (unsigned long long)evalCounters.getCalls);
+    writeHops(file, "get() hops", evalCounters.getHops);
+    writeOpcodes(file);
+}
@@ -0,0 +1,113 @@
+#ifndef cmonk_evalstats_h
+#define cmonk_evalstats_h
+
+#include <stdint.h>
+#include "ast.h"
+
+/**
+ * Contadores del tree walker.
+ * Compilando con -DEVAL_STATS evalExpression() y evalStatements() cuentan
+ * cuántas veces se evalúa cada tipo de nodo y el tiempo propio (sin el de sus
+ * hijos), lo mismo por operador de los infix, y cuántas veces y cuánto
+ * tiempo (incluido el del cuerpo) se ejecuta cada llamada del fuente.
+ * También cuentan los scopes que se suben para leer una variable: los del
+ * resolver en evalIdentifier() y los que recorre get() buscando por nombre.
+ * El tiempo se mide en ticks del contador de ciclos (rdtsc) y se pasa a
+ * segundos al escribir el informe. Sin EVAL_STATS las macros no hacen nada.
+ * En la VM se cuentan los opcodes ejecutados y las parejas de opcodes
+ * seguidos, que son las candidatas a superinstrucción.
+ */
+#define EVAL_MAX_HOPS 8 // histograma de scopes subidos; el último cubo es "8 o más"
+#define EVAL_NODE_TYPES (NT_CALL_GENERIC + 1)
+#define EVAL_TOKEN_TYPES (T_RETURN + 1)
+#define EVAL_TOP_CALL_SITES 20 // llamadas del informe
+#define EVAL_OPCODES 64 // más que opcodes hay en OpCode
+#define EVAL_TOP_OPCODE_PAIRS 20 // parejas de opcodes del informe
+
+// veces y ticks propios de un tipo de nodo (o de un operador).
+typedef struct {
+    uint64_t count;
+    uint64_t ticks;
+} EvalCounter;
+
+// una llamada del fuente: 'ticks' incluye el cuerpo (y, si es recursiva, se vuelve a contar).
+typedef struct {
+    int symbol; // la función llamada si es un identificador (si no NO_SYMBOL)
+    int line;
+    int column;
+    uint64_t count;
+    uint64_t ticks;
+} CallSite;
+
+typedef struct {
+    EvalCounter byNode[EVAL_NODE_TYPES];
+    EvalCounter byOperator[EVAL_TOKEN_TYPES]; // solo los infix
+    uint64_t globalReads; // variables globales (sin subir scopes)
+    uint64_t scopeHops[EVAL_MAX_HOPS + 1]; // variables locales por scopes subidos
+    uint64_t getCalls; // búsquedas por nombre (get())
+    uint64_t getHops[EVAL_MAX_HOPS + 1]; // y los scopes que recorrieron
+    uint64_t opcodes[EVAL_OPCODES]; // opcodes ejecutados por la VM
+    uint64_t opcodePairs[EVAL_OPCODES][EVAL_OPCODES]; // [anterior][siguiente]
+} EvalStats;
+
+#ifdef EVAL_STATS
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define EVAL_TICKS() __rdtsc()
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define EVAL_TICKS() __rdtsc()
+#else
+#define EVAL_TICKS() evalTicks()
+#endif
+
+extern EvalStats evalCounters;
+extern uint64_t evalChildTicks; // ticks de los hijos ya evaluados del nodo en curso
+extern int evalLastOpcode; // el último opcode que ejecutó la VM
+
+// el nodo que se empieza a evaluar guarda lo que llevaban medido sus hermanos.
+typedef struct {
+    uint64_t start;
+    uint64_t siblings;
+} EvalTimer;
+
+#define EVAL_ENTER(timer) \
+    do { \
+        (timer).siblings = evalChildTicks; \
+        evalChildTicks = 0; \
+        (timer).start = EVAL_TICKS(); \
+    } while (false)
+
+#define EVAL_LEAVE(timer, node) \
+    do { \
+        uint64_t elapsed_ = EVAL_TICKS() - (timer).start; \
+        countEvaluation((const Node*)(node), elapsed_, elapsed_ - evalChildTicks); \
+        evalChildTicks = (timer).siblings + elapsed_; \
+    } while (false)
+
+#define EVAL_HOPS(counters, hops) ((counters)[((hops) < EVAL_MAX_HOPS) ? (hops) : EVAL_MAX_HOPS] += 1)
+#define COUNT_SCOPE_HOPS(depth) \
+    ((depth) == GLOBAL_DEPTH ? (void)(evalCounters.globalReads += 1) : (void)EVAL_HOPS(evalCounters.scopeHops, (depth)))
+#define COUNT_GET_HOPS(hops) \
+    ((void)(evalCounters.getCalls += 1), (void)EVAL_HOPS(evalCounters.getHops, (hops)))
+#define NODE_CALL_SITE(node, symbol, position) ((node)->callSite = newCallSite((symbol), (position)))
+#define COUNT_OPCODE(op) \
+    ((void)(evalCounters.opcodes[(op)] += 1), (void)(evalCounters.opcodePairs[evalLastOpcode][(op)] += 1), \
+        (void)(evalLastOpcode = (op)))
+#else
+#define COUNT_SCOPE_HOPS(depth) ((void)0)
+#define COUNT_GET_HOPS(hops) ((void)(hops))
+#define NODE_CALL_SITE(node, symbol, position) ((void)(position))
+#define COUNT_OPCODE(op) ((void)0)
+#endif
+
+/*================================================================/
+* PUBLIC EVALSTATS API
+*=================================================================*/
+uint64_t evalTicks();
+void countEvaluation(const Node* node, uint64_t elapsed, uint64_t self);
+int newCallSite(int symbol, int position);
+void resetEvalStats();
+void writeEvalStats(FILE* file);
+
+#endif
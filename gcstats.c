@@ -0,0 +1,292 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include "gcstats.h"
+#include "heap.h"
+
+GcStats gcCounters;
+
+// duración de cada pausa, para los percentiles de getGcStats()
+static double* minorPauses;
+static int minorPauseCount;
+static int minorPauseCapacity;
+static double* majorPauses;
+static int majorPauseCount;
+static int majorPauseCapacity;
+// las últimas GC_LOG_SIZE recolecciones (buffer circular)
+static GcCollection collections[GC_LOG_SIZE];
+static int collectionCount; // recolecciones registradas en total
+
+// contadores que se pueden consultar por nombre (el builtin gcStats de Monkey).
+typedef enum {
+    FIELD_SIZE,
+    FIELD_INT,
+    FIELD_SECONDS,
+} FieldKind;
+
+typedef struct {
+    const char* name;
+    FieldKind kind;
+    size_t offset;
+} Field;
+
+static const Field fields[] = {
+    { "allocated", FIELD_SIZE, offsetof(GcStats, allocated) },
+    { "allocatedBytes", FIELD_SIZE, offsetof(GcStats, allocatedBytes) },
+    { "promoted", FIELD_SIZE, offsetof(GcStats, promoted) },
+    { "promotedBytes", FIELD_SIZE, offsetof(GcStats, promotedBytes) },
+    { "minorCollections", FIELD_INT, offsetof(GcStats, minorCollections) },
+    { "minorPauseTotal", FIELD_SECONDS, offsetof(GcStats, minorPauseTotal) },
+    { "minorPauseMax", FIELD_SECONDS, offsetof(GcStats, minorPauseMax) },
+    { "minorPauseP50", FIELD_SECONDS, offsetof(GcStats, minorPauseP50) },
+    { "minorPauseP90", FIELD_SECONDS, offsetof(GcStats, minorPauseP90) },
+    { "minorPauseP99", FIELD_SECONDS, offsetof(GcStats, minorPauseP99) },
+    { "majorCollections", FIELD_INT, offsetof(GcStats, majorCollections) },
+    { "majorPauseTotal", FIELD_SECONDS, offsetof(GcStats, majorPauseTotal) },
+    { "majorPauseMax", FIELD_SECONDS, offsetof(GcStats, majorPauseMax) },
+    { "majorPauseP50", FIELD_SECONDS, offsetof(GcStats, majorPauseP50) },
+    { "majorPauseP90", FIELD_SECONDS, offsetof(GcStats, majorPauseP90) },
+    { "majorPauseP99", FIELD_SECONDS, offsetof(GcStats, majorPauseP99) },
+    { "liveObjects", FIELD_SIZE, offsetof(GcStats, liveObjects) },
+    { "liveBytes", FIELD_SIZE, offsetof(GcStats, liveBytes) },
+    { "peakLiveBytes", FIELD_SIZE, offsetof(GcStats, peakLiveBytes) },
+    { "heapLimit", FIELD_SIZE, offsetof(GcStats, heapLimit) },
+    { "heapGrowths", FIELD_INT, offsetof(GcStats, heapGrowths) },
+    { "heapShrinks", FIELD_INT, offsetof(GcStats, heapShrinks) },
+};
+
+// texto que crece a medida que se escribe el JSON.
+typedef struct {
+    char* chars;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void recordPause(double** samples, int* count, int* capacity, double pause);
+static int pauseBucket(double pause);
+static int comparePauses(const void* a, const void* b);
+static double percentile(double* sorted, int count, int p);
+static void pausePercentiles(double* samples, int count, double* p50, double* p90, double* p99);
+static void appendf(Buffer* buffer, const char* format, ...);
+static void appendPauses(Buffer* buffer, const char* name, int collections, double total, double max,
+    double p50, double p90, double p99, const int* histogram);
+double gcClock();
+void recordCollection(GcKind kind, double pause, size_t liveObjects, size_t liveBytes, size_t heapLimit);
+GcStats getGcStats();
+void resetGcStats();
+bool gcStatsField(const char* name, long long* value);
+char* gcStatsJSON();
+void writeGcStatsJSON(FILE* file);
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void recordPause(double** samples, int* count, int* capacity, double pause) {
+    if (*capacity < (*count + 1)) {
+        *capacity = (*capacity == 0) ? 256 : *capacity * 2;
+        *samples = realloc(*samples, sizeof(double) * *capacity);
+        if (*samples == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    (*samples)[(*count)++] = pause;
+}
+
+// cubo 0: menos de 1 us. Cubo i: de 2^(i-1) a 2^i us. El último se queda con el resto.
+static int pauseBucket(double pause) {
+    double us = pause * 1e6;
+    int bucket = 0;
+    for (double limit = 1; us >= limit && bucket < GC_PAUSE_BUCKETS - 1; limit *= 2) {
+        bucket += 1;
+    }
+    return bucket;
+}
+
+static int comparePauses(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// percentil 'p' (por rango más cercano) de unas muestras ya ordenadas.
+static double percentile(double* sorted, int count, int p) {
+    if (count == 0) return 0;
+    int rank = (p * count + 99) / 100;
+    return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+static void pausePercentiles(double* samples, int count, double* p50, double* p90, double* p99) {
+    if (count == 0) { // sin recolecciones 'samples' puede ser NULL
+        *p50 = *p90 = *p99 = 0;
+        return;
+    }
+    double* sorted = malloc(sizeof(double) * count);
+    if (sorted == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    memcpy(sorted, samples, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), comparePauses);
+    *p50 = percentile(sorted, count, 50);
+    *p90 = percentile(sorted, count, 90);
+    *p99 = percentile(sorted, count, 99);
+    free(sorted);
+}
+
+static void appendf(Buffer* buffer, const char* format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer->chars + buffer->length, buffer->capacity - buffer->length, format, args);
+        va_end(args);
+        if (written >= 0 && buffer->length + written < buffer->capacity) {
+            buffer->length += written;
+            return;
+        }
+        buffer->capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity * 2;
+        buffer->chars = realloc(buffer->chars, buffer->capacity);
+        if (buffer->chars == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+}
+
+// las pausas se escriben en microsegundos.
+static void appendPauses(Buffer* buffer, const char* name, int collections, double total, double max,
+    double p50, double p90, double p99, const int* histogram) {
+    appendf(buffer, "  \"%s\": {\"collections\": %d, \"pauseTotalUs\": %.1f, \"pauseMaxUs\": %.1f, "
+        "\"pauseP50Us\": %.1f, \"pauseP90Us\": %.1f, \"pauseP99Us\": %.1f, \"histogram\": [",
+        name, collections, total * 1e6, max * 1e6, p50 * 1e6, p90 * 1e6, p99 * 1e6);
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        appendf(buffer, (i == 0) ? "%d" : ", %d", histogram[i]);
+    }
+    appendf(buffer, "]},\n");
+}
+
+double gcClock() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Se llama al terminar cada recolección. En una mayor 'heapLimit' es el umbral
+ * recién decidido para la siguiente: se cuenta si el heap crece o se encoge.
+ */
+void recordCollection(GcKind kind, double pause, size_t liveObjects, size_t liveBytes, size_t heapLimit) {
+    if (kind == GC_MINOR) {
+        gcCounters.minorCollections += 1;
+        gcCounters.minorPauseTotal += pause;
+        if (pause > gcCounters.minorPauseMax) gcCounters.minorPauseMax = pause;
+        gcCounters.minorPauseHistogram[pauseBucket(pause)] += 1;
+        recordPause(&minorPauses, &minorPauseCount, &minorPauseCapacity, pause);
+    } else {
+        gcCounters.majorCollections += 1;
+        gcCounters.majorPauseTotal += pause;
+        if (pause > gcCounters.majorPauseMax) gcCounters.majorPauseMax = pause;
+        gcCounters.majorPauseHistogram[pauseBucket(pause)] += 1;
+        recordPause(&majorPauses, &majorPauseCount, &majorPauseCapacity, pause);
+
+        gcCounters.liveObjects = liveObjects;
+        gcCounters.liveBytes = liveBytes;
+        if (liveBytes > gcCounters.peakLiveBytes) gcCounters.peakLiveBytes = liveBytes;
+        if (heapLimit > gcCounters.heapLimit) gcCounters.heapGrowths += 1;
+        if (heapLimit < gcCounters.heapLimit) gcCounters.heapShrinks += 1;
+    }
+    gcCounters.heapLimit = heapLimit;
+
+    GcCollection* collection = &collections[collectionCount % GC_LOG_SIZE];
+    collection->kind = kind;
+    collection->pause = pause;
+    collection->liveObjects = liveObjects;
+    collection->liveBytes = liveBytes;
+    collection->heapLimit = heapLimit;
+    collectionCount += 1;
+}
+
+GcStats getGcStats() {
+    pausePercentiles(minorPauses, minorPauseCount, &gcCounters.minorPauseP50, &gcCounters.minorPauseP90, &gcCounters.minorPauseP99);
+    pausePercentiles(majorPauses, majorPauseCount, &gcCounters.majorPauseP50, &gcCounters.majorPauseP90, &gcCounters.majorPauseP99);
+    return gcCounters;
+}
+
+// el umbral del GC mayor no es un contador: sigue valiendo lo mismo.
+void resetGcStats() {
+    size_t heapLimit = gcCounters.heapLimit;
+    memset(&gcCounters, 0, sizeof(GcStats));
+    gcCounters.heapLimit = heapLimit;
+    minorPauseCount = 0;
+    majorPauseCount = 0;
+    collectionCount = 0;
+}
+
+// un contador por su nombre, como entero (los tiempos en microsegundos). Devuelve false si no existe.
+bool gcStatsField(const char* name, long long* value) {
+    GcStats stats = getGcStats();
+    for (size_t i = 0; i < sizeof(fields) / sizeof(Field); i++) {
+        if (strcmp(fields[i].name, name) != 0) continue;
+        const char* field = (const char*)&stats + fields[i].offset;
+        switch (fields[i].kind) {
+        case FIELD_SIZE:
+            *value = (long long)*(const size_t*)field;
+            break;
+        case FIELD_INT:
+            *value = *(const int*)field;
+            break;
+        case FIELD_SECONDS:
+            *value = (long long)(*(const double*)field * 1e6);
+            break;
+        }
+        return true;
+    }
+    return false;
+}
+
+// todos los contadores y las últimas recolecciones como JSON. Lo libera quien llama.
+char* gcStatsJSON() {
+    GcStats stats = getGcStats();
+    Buffer buffer = { NULL, 0, 0 };
+
+    appendf(&buffer, "{\n  \"allocated\": {\"objects\": %zu, \"bytes\": %zu, \"byType\": {",
+        stats.allocated, stats.allocatedBytes);
+    bool first = true;
+    for (int type = 0; type < OBJECT_TYPES; type++) {
+        if (stats.allocatedByType[type] == 0) continue;
+        appendf(&buffer, "%s\"%s\": {\"objects\": %zu, \"bytes\": %zu}", first ? "" : ", ",
+            objectTypeName(type), stats.allocatedByType[type], stats.bytesByType[type]);
+        first = false;
+    }
+    appendf(&buffer, "}},\n  \"promoted\": {\"objects\": %zu, \"bytes\": %zu},\n", stats.promoted, stats.promotedBytes);
+    appendPauses(&buffer, "minor", stats.minorCollections, stats.minorPauseTotal, stats.minorPauseMax,
+        stats.minorPauseP50, stats.minorPauseP90, stats.minorPauseP99, stats.minorPauseHistogram);
+    appendPauses(&buffer, "major", stats.majorCollections, stats.majorPauseTotal, stats.majorPauseMax,
+        stats.majorPauseP50, stats.majorPauseP90, stats.majorPauseP99, stats.majorPauseHistogram);
+    appendf(&buffer, "  \"live\": {\"objects\": %zu, \"bytes\": %zu, \"peakBytes\": %zu},\n",
+        stats.liveObjects, stats.liveBytes, stats.peakLiveBytes);
+    appendf(&buffer, "  \"heap\": {\"limit\": %zu, \"growths\": %d, \"shrinks\": %d, \"reserved\": %zu, \"inUse\": %zu},\n",
+        stats.heapLimit, stats.heapGrowths, stats.heapShrinks, heapBytesReserved(), heapBytesInUse());
+
+    // las recolecciones que siguen en el buffer circular, de la más antigua a la más nueva.
+    int start = (collectionCount > GC_LOG_SIZE) ? collectionCount - GC_LOG_SIZE : 0;
+    appendf(&buffer, "  \"collections\": [");
+    for (int i = start; i < collectionCount; i++) {
+        GcCollection* collection = &collections[i % GC_LOG_SIZE];
+        appendf(&buffer, "%s\n    {\"kind\": \"%s\", \"pauseUs\": %.1f, \"liveObjects\": %zu, \"liveBytes\": %zu, \"heapLimit\": %zu}",
+            (i == start) ? "" : ",", (collection->kind == GC_MINOR) ? "minor" : "major", collection->pause * 1e6,
+            collection->liveObjects, collection->liveBytes, collection->heapLimit);
+    }
+    appendf(&buffer, (collectionCount > start) ? "\n  ]\n}\n" : "]\n}\n");
+
+    return buffer.chars;
+}
+
+void writeGcStatsJSON(FILE* file) {
+    char* json = gcStatsJSON();
+    fputs(json, file);
+    free(json);
+}
@@ -0,0 +1,81 @@
+#ifndef cmonk_gcstats_h
+#define cmonk_gcstats_h
+
+#include "object.h"
+
+#define GC_PAUSE_BUCKETS 20 // cubos del histograma de pausas (ver recordCollection)
+#define GC_LOG_SIZE 256 // últimas recolecciones que se guardan una a una
+
+typedef enum {
+    GC_MINOR,
+    GC_MAJOR,
+} GcKind;
+
+// una recolección: lo que duró, lo que quedó vivo y el umbral que se decidió después.
+typedef struct {
+    GcKind kind;
+    double pause;
+    size_t liveObjects; // en una menor, los promovidos
+    size_t liveBytes;
+    size_t heapLimit; // bytes ocupados en el heap viejo a partir de los que salta el GC mayor
+} GcCollection;
+
+// contadores acumulados del GC desde initEvaluator() (o el último resetGcStats()). Los tiempos en segundos.
+typedef struct {
+    size_t allocated; // objetos creados (nursery + heap viejo)
+    size_t allocatedBytes;
+    size_t allocatedByType[OBJECT_TYPES];
+    size_t bytesByType[OBJECT_TYPES];
+    size_t promoted; // objetos copiados de la nursery al heap viejo
+    size_t promotedBytes;
+    int minorCollections;
+    double minorPauseTotal;
+    double minorPauseMax;
+    double minorPauseP50; // percentiles de las pausas (se calculan en getGcStats)
+    double minorPauseP90;
+    double minorPauseP99;
+    int minorPauseHistogram[GC_PAUSE_BUCKETS];
+    int majorCollections;
+    double majorPauseTotal;
+    double majorPauseMax;
+    double majorPauseP50;
+    double majorPauseP90;
+    double majorPauseP99;
+    int majorPauseHistogram[GC_PAUSE_BUCKETS];
+    size_t liveObjects; // lo que sobrevivió al último GC mayor
+    size_t liveBytes;
+    size_t peakLiveBytes;
+    size_t heapLimit; // umbral actual del GC mayor
+    int heapGrowths; // GC mayores tras los que el umbral subió
+    int heapShrinks; // y tras los que bajó
+} GcStats;
+
+extern GcStats gcCounters;
+
+// en cada reserva: solo sumas, para no encarecer newObject().
+#define COUNT_ALLOCATION(type, size) \
+    do { \
+        gcCounters.allocated += 1; \
+        gcCounters.allocatedBytes += (size); \
+        gcCounters.allocatedByType[(type)] += 1; \
+        gcCounters.bytesByType[(type)] += (size); \
+    } while (false)
+
+#define COUNT_PROMOTION(size) \
+    do { \
+        gcCounters.promoted += 1; \
+        gcCounters.promotedBytes += (size); \
+    } while (false)
+
+/*================================================================/
+* PUBLIC GCSTATS API
+*=================================================================*/
+double gcClock();
+void recordCollection(GcKind kind, double pause, size_t liveObjects, size_t liveBytes, size_t heapLimit);
+GcStats getGcStats();
+void resetGcStats();
+bool gcStatsField(const char* name, long long* value);
+char* gcStatsJSON();
+void writeGcStatsJSON(FILE* file);
+
+#endif
@@ -0,0 +1,220 @@
+#include "heap.h"
+
+// tamaños de hueco: cabecera (16 bytes) + el objeto envuelto más frecuente de cada tipo.
+static const size_t sizeClasses[HEAP_SIZE_CLASSES] = { 24, 32, 48, 64, 80, 96, 128, 192, 256, 384, 512 };
+
+static Page* pages[HEAP_SIZE_CLASSES]; // páginas barridas; la primera es la más nueva
+static Page* unswept[HEAP_SIZE_CLASSES]; // páginas pendientes de barrer
+static Object* freeLists[HEAP_SIZE_CLASSES];
+static Page* largePages; // una página por objeto grande
+static size_t bytesReserved; // páginas pedidas al sistema
+static size_t bytesInUse; // huecos ocupados por objetos
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static int sizeClass(size_t size);
+static Page* newPage(size_t slotSize, size_t size);
+static void freePage(Page* page);
+static Object* allocLarge(size_t size);
+static int sweepPage(Page* page, Object** freeList);
+static bool sweepNextPage(int c);
+Object* heapAlloc(size_t size);
+size_t heapSlotSize(size_t size);
+void heapStartSweep(size_t liveBytes);
+void heapFinishSweep();
+void heapFreeAll();
+size_t heapBytesReserved();
+size_t heapBytesInUse();
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static int sizeClass(size_t size) {
+    int i = 0;
+    while (sizeClasses[i] < size) i++;
+    return i;
+}
+
+static Page* newPage(size_t slotSize, size_t size) {
+    Page* page = (Page*)malloc(sizeof(Page) + size);
+    if (page == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    page->next = NULL;
+    page->slotSize = slotSize;
+    page->top = page->slots;
+    page->end = page->slots + size - (size % slotSize);
+    bytesReserved += sizeof(Page) + size;
+
+    return page;
+}
+
+static void freePage(Page* page) {
+    bytesReserved -= sizeof(Page) + (page->end - page->slots);
+    free(page);
+}
+
+static Object* allocLarge(size_t size) {
+    size = heapSlotSize(size);
+    Page* page = newPage(size, size);
+    page->top = page->end;
+    page->next = largePages;
+    largePages = page;
+    bytesInUse += size;
+
+    return (Object*)page->slots;
+}
+
+/**
+ * Libera los objetos sin marcar de una página, desmarca el resto y añade sus
+ * huecos libres a 'freeList' (si la página sigue teniendo algún objeto vivo).
+ * Devuelve cuántos objetos siguen vivos.
+ */
+static int sweepPage(Page* page, Object** freeList) {
+    Object* pageFree = NULL;
+    Object* pageFreeTail = NULL;
+    int live = 0;
+    for (char* slot = page->slots; slot < page->top; slot += page->slotSize) {
+        Object* object = (Object*)slot;
+        if (!object->free && object->marked) {
+            object->marked = false;
+            live += 1;
+            continue;
+        }
+        if (!object->free) {
+            finalizeObject(object);
+            object->free = true;
+        }
+        object->next = pageFree;
+        pageFree = object;
+        if (pageFreeTail == NULL) pageFreeTail = object;
+    }
+    if (live > 0 && pageFree != NULL && freeList != NULL) {
+        pageFreeTail->next = *freeList;
+        *freeList = pageFree;
+    }
+    return live;
+}
+
+// barre la siguiente página pendiente de la clase 'c'. Devuelve false si no quedaba ninguna.
+static bool sweepNextPage(int c) {
+    Page* page = unswept[c];
+    if (page == NULL) return false;
+    unswept[c] = page->next;
+
+    if (sweepPage(page, &freeLists[c]) == 0) {
+        freePage(page);
+    } else if (pages[c] == NULL) {
+        page->next = NULL;
+        pages[c] = page;
+    } else {
+        // detrás de la primera: la más nueva sigue siendo la de reservar avanzando el puntero.
+        page->next = pages[c]->next;
+        pages[c]->next = page;
+    }
+    return true;
+}
+
+// hueco para un objeto de 'size' bytes (cabecera incluida). La cabecera la rellena quien llama.
+Object* heapAlloc(size_t size) {
+    if (size > HEAP_MAX_SMALL_SIZE) return allocLarge(size);
+
+    int c = sizeClass(size);
+    bytesInUse += sizeClasses[c];
+    while (freeLists[c] == NULL && sweepNextPage(c)) {
+        // barrer hasta encontrar huecos libres
+    }
+    Object* object = freeLists[c];
+    if (object != NULL) {
+        freeLists[c] = object->next;
+        return object;
+    }
+    Page* page = pages[c];
+    if (page == NULL || page->top + page->slotSize > page->end) {
+        page = newPage(sizeClasses[c], HEAP_PAGE_SIZE - sizeof(Page));
+        page->next = pages[c];
+        pages[c] = page;
+    }
+    object = (Object*)page->top;
+    page->top += page->slotSize;
+
+    return object;
+}
+
+// lo que ocupa de verdad en el heap un objeto de 'size' bytes.
+size_t heapSlotSize(size_t size) {
+    if (size > HEAP_MAX_SMALL_SIZE) return (size + 7) & ~(size_t)7;
+    return sizeClasses[sizeClass(size)];
+}
+
+/**
+ * Se llama al terminar el marcado: barre ya los objetos grandes y la página
+ * más nueva de cada clase, y deja el resto pendiente. 'liveBytes' es lo que
+ * ocupan los objetos marcados.
+ */
+void heapStartSweep(size_t liveBytes) {
+    for (int c = 0; c < HEAP_SIZE_CLASSES; c++) {
+        freeLists[c] = NULL;
+        Page* newest = pages[c];
+        if (newest == NULL) continue;
+        unswept[c] = newest->next;
+        newest->next = NULL;
+        if (sweepPage(newest, &freeLists[c]) == 0) {
+            freePage(newest);
+            pages[c] = NULL;
+        }
+    }
+    Page** link = &largePages;
+    while (*link) {
+        Page* page = *link;
+        if (sweepPage(page, NULL) == 0) {
+            *link = page->next;
+            freePage(page);
+        } else {
+            link = &page->next;
+        }
+    }
+    bytesInUse = liveBytes;
+}
+
+// barre lo que quede pendiente: los bits de marca tienen que estar limpios antes de marcar.
+void heapFinishSweep() {
+    for (int c = 0; c < HEAP_SIZE_CLASSES; c++) {
+        while (sweepNextPage(c)) {
+            // página a página
+        }
+    }
+}
+
+// libera todo el heap viejo, vivo o no.
+void heapFreeAll() {
+    heapFinishSweep();
+    for (int c = 0; c < HEAP_SIZE_CLASSES; c++) {
+        for (Page* page = pages[c]; page != NULL; page = page->next) {
+            for (char* slot = page->slots; slot < page->top; slot += page->slotSize) {
+                ((Object*)slot)->marked = false;
+            }
+        }
+        // todas las páginas pasan a pendientes y, sin nada marcado, se liberan al barrerlas.
+        unswept[c] = pages[c];
+        pages[c] = NULL;
+        freeLists[c] = NULL;
+        while (sweepNextPage(c)) {
+            // página a página
+        }
+    }
+    for (Page* page = largePages; page != NULL; page = page->next) {
+        ((Object*)page->slots)->marked = false;
+    }
+    heapStartSweep(0);
+}
+
+size_t heapBytesReserved() {
+    return bytesReserved;
+}
+
+size_t heapBytesInUse() {
+    return bytesInUse;
+}
@@ -0,0 +1,42 @@
+#ifndef cmonk_heap_h
+#define cmonk_heap_h
+
+#include "object.h"
+
+#define HEAP_PAGE_SIZE (64 * 1024)
+#define HEAP_SIZE_CLASSES 11
+#define HEAP_MAX_SMALL_SIZE 512 // los objetos más grandes van cada uno en su propia página
+
+/**
+ * Heap viejo del GC: pools de huecos del mismo tamaño (una clase por tamaño)
+ * sacados de páginas grandes. Reservar es sacar el primer hueco libre de la
+ * clase o avanzar un puntero en su página más nueva, y el sweep recorre las
+ * páginas de forma contigua en lugar de perseguir una lista de objetos.
+ * Los huecos libres llevan 'free' a true en la cabecera y se encadenan por 'next'.
+ *
+ * El sweep es perezoso: al terminar el marcado solo se barre la página más
+ * nueva de cada clase; el resto queda pendiente y se barre página a página
+ * cuando la clase se queda sin huecos libres (o todo de golpe antes del
+ * siguiente marcado). Solo se reserva en páginas ya barridas, así que lo
+ * nuevo nunca se confunde con basura sin barrer.
+ */
+typedef struct sPage {
+    struct sPage* next; // siguiente página de la misma clase
+    size_t slotSize;
+    char* top; // huecos usados hasta aquí
+    char* end;
+    char slots[];
+} Page;
+
+/*================================================================/
+* PUBLIC HEAP API
+*=================================================================*/
+Object* heapAlloc(size_t size);
+size_t heapSlotSize(size_t size);
+void heapStartSweep(size_t liveBytes);
+void heapFinishSweep();
+void heapFreeAll();
+size_t heapBytesReserved();
+size_t heapBytesInUse();
+
+#endif
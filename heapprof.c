@@ -0,0 +1,539 @@
+#include <stdint.h>
+#include "heapprof.h"
+#include "interpreter.h"
+
+// aristas que no son un slot de un Environment (los slots van con su índice, >= 0)
+#define EDGE_GLOBAL -1
+#define EDGE_STACK  -2
+#define EDGE_OUTER  -3
+#define EDGE_ENV    -4
+#define EDGE_VALUE  -5
+#define NO_NODE     -1
+
+#ifdef HEAP_PROFILE
+int allocationSite;
+#endif
+
+static AllocationSite* sites; // el 0 es el sitio desconocido
+static int siteCount;
+static int siteCapacity;
+
+/**
+ * Grafo del snapshot. El nodo 0 es la raíz (el global y la pila); el resto,
+ * cada objeto alcanzable en el orden en que los encuentra un recorrido en
+ * anchura, así que 'parent' da el camino más corto desde las raíces.
+ * Las aristas de cada nodo son edges[edgeStart[i] .. edgeStart[i + 1]).
+ */
+typedef struct {
+    Object* object;
+    int parent;
+    int via; // arista por la que se llegó desde 'parent'
+    size_t size;
+    size_t retained;
+    int site;
+} SnapshotNode;
+
+static SnapshotNode* nodes;
+static int nodeCount;
+static int nodeCapacity;
+static int* table; // Object* -> nodo (direccionamiento abierto)
+static int tableSize;
+static int* edges;
+static int edgeCount;
+static int edgeCapacity;
+static int* edgeStart;
+static int expanding; // nodo cuyas aristas se están añadiendo
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void* growArray(void* array, int* capacity, int needed, size_t size);
+static void* allocArray(int count, size_t size);
+static unsigned hashObject(Object* object);
+static int findNode(Object* object);
+static void growTable();
+static void reach(Object* object, int via);
+static void reachValue(Value value, int via);
+static void reachStackValue(Value* slot);
+static void reachStackEnv(Environment* env);
+static void expand(int index);
+static void buildGraph(Environment* globals);
+static int* postorder(int* order);
+static int* dominators(int* order, int* number);
+static void computeRetained(int* order, int* idom);
+static void aggregate(int* idom, size_t* typeRetained, size_t* siteRetained);
+static const char* describe(int index, char* out, size_t size);
+static const char* edgeName(int index, char* out, size_t size);
+static void writePath(FILE* file, int index);
+static void freeGraph();
+static void initSites();
+int newAllocationSite(const char* kind, int position);
+bool writeHeapSnapshot(const char* path, Environment* globals);
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void* growArray(void* array, int* capacity, int needed, size_t size) {
+    if (*capacity >= needed) return array;
+    while (*capacity < needed) {
+        *capacity = (*capacity == 0) ? 256 : *capacity * 2;
+    }
+    array = realloc(array, size * *capacity);
+    if (array == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    return array;
+}
+
+static void* allocArray(int count, size_t size) {
+    void* array = calloc(count > 0 ? count : 1, size);
+    if (array == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    return array;
+}
+
+static unsigned hashObject(Object* object) {
+    return (unsigned)(((uintptr_t)object >> 3) * 2654435761u);
+}
+
+static int findNode(Object* object) {
+    unsigned index = hashObject(object) & (tableSize - 1);
+    while (table[index] != NO_NODE && nodes[table[index]].object != object) {
+        index = (index + 1) & (tableSize - 1);
+    }
+    return index;
+}
+
+static void growTable() {
+    free(table);
+    tableSize = (tableSize == 0) ? 1024 : tableSize * 2;
+    table = (int*)malloc(sizeof(int) * tableSize);
+    if (table == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    for (int i = 0; i < tableSize; i++) {
+        table[i] = NO_NODE;
+    }
+    for (int i = 1; i < nodeCount; i++) {
+        table[findNode(nodes[i].object)] = i;
+    }
+}
+
+// arista de 'expanding' a 'object'; si es la primera vez que se ve, nodo nuevo.
+static void reach(Object* object, int via) {
+    if ((nodeCount + 1) * 2 > tableSize) growTable();
+    int slot = findNode(object);
+    if (table[slot] == NO_NODE) {
+        nodes = growArray(nodes, &nodeCapacity, nodeCount + 1, sizeof(SnapshotNode));
+        SnapshotNode* node = &nodes[nodeCount];
+        node->object = object;
+        node->parent = expanding;
+        node->via = via;
+        node->size = objectSize(object);
+        if (object->type == ENVIRONMENT_OBJ) {
+            Environment* env = (Environment*)OBJ_PAYLOAD(object);
+            if (env->slots != (Value*)(env + 1)) node->size += sizeof(Value) * env->count; // los del global
+        }
+#ifdef HEAP_PROFILE
+        node->site = object->site;
+#else
+        node->site = 0;
+#endif
+        table[slot] = nodeCount++;
+    }
+    edges = growArray(edges, &edgeCapacity, edgeCount + 1, sizeof(int));
+    edges[edgeCount++] = table[slot];
+}
+
+static void reachValue(Value value, int via) {
+    if (IS_OBJ(value)) reach(AS_OBJ(value), via);
+}
+
+static void reachStackValue(Value* slot) {
+    reachValue(*slot, EDGE_STACK);
+}
+
+static void reachStackEnv(Environment* env) {
+    if (env != NULL) reach(ENV_OBJECT(env), EDGE_STACK);
+}
+
+static void expand(int index) {
+    Object* object = nodes[index].object;
+    switch (object->type) {
+    case FUNCTION_OBJ: {
+        FunctionObj* func = (FunctionObj*)OBJ_PAYLOAD(object);
+        for (int i = 0; i < func->captureCount; i++) {
+            reachValue(func->captures[i], i);
+        }
+        if (func->env != NULL) reach(ENV_OBJECT(func->env), EDGE_ENV);
+        break;
+    }
+    case RETURN_OBJ:
+        reachValue(((ReturnObj*)OBJ_PAYLOAD(object))->value, EDGE_VALUE);
+        break;
+    case ENVIRONMENT_OBJ: {
+        Environment* env = (Environment*)OBJ_PAYLOAD(object);
+        for (int i = 0; i < env->count; i++) {
+            reachValue(env->slots[i], i);
+        }
+        if (env->outer != NULL) reach(ENV_OBJECT(env->outer), EDGE_OUTER);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// recorrido en anchura desde las raíces. El heap no cambia mientras dura.
+static void buildGraph(Environment* globals) {
+    nodes = growArray(nodes, &nodeCapacity, 1, sizeof(SnapshotNode));
+    memset(&nodes[0], 0, sizeof(SnapshotNode));
+    nodes[0].parent = NO_NODE;
+    nodeCount = 1;
+    edgeCount = 0;
+    growTable();
+
+    int startCapacity = 0;
+    for (expanding = 0; expanding < nodeCount; expanding++) {
+        edgeStart = growArray(edgeStart, &startCapacity, expanding + 2, sizeof(int));
+        edgeStart[expanding] = edgeCount;
+        if (expanding == 0) {
+            reach(ENV_OBJECT(globals), EDGE_GLOBAL);
+            visitStackRoots(reachStackValue, reachStackEnv);
+        } else {
+            expand(expanding);
+        }
+    }
+    edgeStart[nodeCount] = edgeCount;
+}
+
+// numera los nodos en postorden (recorrido en profundidad sin recursión). 'order' queda con los nodos por número.
+static int* postorder(int* order) {
+    int* number = (int*)allocArray(nodeCount, sizeof(int));
+    int* next = (int*)allocArray(nodeCount, sizeof(int)); // siguiente arista por visitar
+    int* stack = (int*)allocArray(nodeCount, sizeof(int));
+    bool* seen = (bool*)allocArray(nodeCount, sizeof(bool));
+    int count = 0;
+    int top = 0;
+    stack[top++] = 0;
+    seen[0] = true;
+    next[0] = edgeStart[0];
+    while (top > 0) {
+        int node = stack[top - 1];
+        if (next[node] < edgeStart[node + 1]) {
+            int child = edges[next[node]++];
+            if (!seen[child]) {
+                seen[child] = true;
+                next[child] = edgeStart[child];
+                stack[top++] = child;
+            }
+            continue;
+        }
+        top -= 1;
+        number[node] = count;
+        order[count++] = node;
+    }
+    free(next);
+    free(stack);
+    free(seen);
+    return number;
+}
+
+/**
+ * Dominador inmediato de cada nodo (Cooper, Harvey y Kennedy, "A Simple, Fast
+ * Dominance Algorithm"): se itera en postorden inverso hasta que no cambia.
+ */
+static int* dominators(int* order, int* number) {
+    // predecesores de cada nodo, en el mismo formato que las aristas
+    int* predStart = (int*)allocArray(nodeCount + 1, sizeof(int));
+    int* preds = (int*)allocArray(edgeCount, sizeof(int));
+    for (int i = 0; i < edgeCount; i++) {
+        predStart[edges[i] + 1] += 1;
+    }
+    for (int i = 0; i < nodeCount; i++) {
+        predStart[i + 1] += predStart[i];
+    }
+    int* fill = (int*)allocArray(nodeCount, sizeof(int));
+    for (int node = 0; node < nodeCount; node++) {
+        for (int e = edgeStart[node]; e < edgeStart[node + 1]; e++) {
+            int child = edges[e];
+            preds[predStart[child] + fill[child]++] = node;
+        }
+    }
+    free(fill);
+
+    int* idom = (int*)allocArray(nodeCount, sizeof(int));
+    for (int i = 0; i < nodeCount; i++) {
+        idom[i] = NO_NODE;
+    }
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = nodeCount - 1; k >= 0; k--) {
+            int node = order[k];
+            if (node == 0) continue;
+            int newIdom = NO_NODE;
+            for (int p = predStart[node]; p < predStart[node + 1]; p++) {
+                int pred = preds[p];
+                if (idom[pred] == NO_NODE) continue;
+                if (newIdom == NO_NODE) {
+                    newIdom = pred;
+                    continue;
+                }
+                int a = pred;
+                int b = newIdom;
+                while (a != b) {
+                    while (number[a] < number[b]) a = idom[a];
+                    while (number[b] < number[a]) b = idom[b];
+                }
+                newIdom = a;
+            }
+            if (idom[node] != newIdom) {
+                idom[node] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    free(predStart);
+    free(preds);
+    return idom;
+}
+
+// lo que retiene un objeto: él mismo y todo lo que domina. El dominador va siempre después en postorden.
+static void computeRetained(int* order, int* idom) {
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].retained = nodes[i].size;
+    }
+    for (int k = 0; k < nodeCount; k++) {
+        int node = order[k];
+        if (node != 0) nodes[idom[node]].retained += nodes[node].retained;
+    }
+}
+
+/**
+ * Memoria retenida por tipo y por sitio. Un objeto solo suma si ninguno de
+ * sus dominadores es del mismo tipo (o sitio): así no se cuenta dos veces lo
+ * que ya retiene otro objeto del grupo.
+ */
+static void aggregate(int* idom, size_t* typeRetained, size_t* siteRetained) {
+    int* childStart = (int*)allocArray(nodeCount + 1, sizeof(int));
+    int* children = (int*)allocArray(nodeCount, sizeof(int));
+    for (int i = 1; i < nodeCount; i++) {
+        childStart[idom[i] + 1] += 1;
+    }
+    for (int i = 0; i < nodeCount; i++) {
+        childStart[i + 1] += childStart[i];
+    }
+    int* fill = (int*)allocArray(nodeCount, sizeof(int));
+    for (int i = 1; i < nodeCount; i++) {
+        children[childStart[idom[i]] + fill[idom[i]]++] = i;
+    }
+
+    int typeActive[OBJECT_TYPES] = { 0 };
+    int* siteActive = (int*)allocArray(siteCount, sizeof(int));
+    int* stack = (int*)allocArray(nodeCount, sizeof(int));
+    int* next = fill; // siguiente hijo por visitar
+    int top = 0;
+    stack[top++] = 0;
+    next[0] = childStart[0];
+    while (top > 0) {
+        int node = stack[top - 1];
+        if (next[node] < childStart[node + 1]) {
+            int child = children[next[node]++];
+            ObjectType type = nodes[child].object->type;
+            if (typeActive[type]++ == 0) typeRetained[type] += nodes[child].retained;
+            if (siteActive[nodes[child].site]++ == 0) siteRetained[nodes[child].site] += nodes[child].retained;
+            next[child] = childStart[child];
+            stack[top++] = child;
+            continue;
+        }
+        top -= 1;
+        if (node != 0) {
+            typeActive[nodes[node].object->type] -= 1;
+            siteActive[nodes[node].site] -= 1;
+        }
+    }
+    free(childStart);
+    free(children);
+    free(fill);
+    free(siteActive);
+    free(stack);
+}
+
+static const char* describe(int index, char* out, size_t size) {
+    SnapshotNode* node = &nodes[index];
+    if (node->site == 0) {
+        snprintf(out, size, "%s", objectTypeName(node->object->type));
+    } else {
+        AllocationSite* site = &sites[node->site];
+        snprintf(out, size, "%s [%s %d:%d]", objectTypeName(node->object->type), site->kind, site->line, site->column);
+    }
+    return out;
+}
+
+// la arista por la que se llega a un nodo, con el nombre de la variable si es un slot.
+static const char* edgeName(int index, char* out, size_t size) {
+    SnapshotNode* node = &nodes[index];
+    switch (node->via) {
+    case EDGE_GLOBAL: return "global";
+    case EDGE_STACK: return "(stack)";
+    case EDGE_OUTER: return "outer";
+    case EDGE_ENV: return "env";
+    case EDGE_VALUE: return "value";
+    default: {
+        Object* parent = nodes[node->parent].object;
+        int symbol;
+        if (parent->type == FUNCTION_OBJ) { // una variable copiada por el closure
+            FunctionObj* func = (FunctionObj*)OBJ_PAYLOAD(parent);
+            symbol = func->locals[func->localCount - func->captureCount + node->via];
+        } else {
+            Environment* env = (Environment*)OBJ_PAYLOAD(parent);
+            symbol = (env->symbols == NULL) ? node->via : env->symbols[node->via];
+        }
+        snprintf(out, size, ".%s", symbolName(symbol));
+        return out;
+    }
+    }
+}
+
+// el camino más corto desde las raíces; si es muy largo, el principio y el final.
+static void writePath(FILE* file, int index) {
+    int length = 0;
+    for (int node = index; node != 0; node = nodes[node].parent) {
+        length += 1;
+    }
+    int* path = (int*)allocArray(length, sizeof(int));
+    int i = length;
+    for (int node = index; node != 0; node = nodes[node].parent) {
+        path[--i] = node;
+    }
+    char edge[256];
+    char object[256];
+    for (i = 0; i < length; i++) {
+        if (length > SNAPSHOT_MAX_PATH && i == SNAPSHOT_MAX_PATH / 2) {
+            fprintf(file, "      ... %d more\n", length - SNAPSHOT_MAX_PATH);
+            i = length - SNAPSHOT_MAX_PATH / 2;
+        }
+        fprintf(file, "      %-20s %s\n", edgeName(path[i], edge, sizeof(edge)), describe(path[i], object, sizeof(object)));
+    }
+    free(path);
+}
+
+static void freeGraph() {
+    free(nodes);
+    free(table);
+    free(edges);
+    free(edgeStart);
+    nodes = NULL;
+    table = NULL;
+    edges = NULL;
+    edgeStart = NULL;
+    nodeCount = nodeCapacity = tableSize = edgeCount = edgeCapacity = 0;
+}
+
+static void initSites() {
+    if (siteCount > 0) return;
+    sites = growArray(sites, &siteCapacity, 1, sizeof(AllocationSite));
+    sites[siteCount++] = (AllocationSite){ "(runtime)", 0, 0 };
+}
+
+// el parser da de alta un sitio por cada nodo que reserva objetos. 'position' es el byte del fuente donde empieza.
+int newAllocationSite(const char* kind, int position) {
+    initSites();
+    sites = growArray(sites, &siteCapacity, siteCount + 1, sizeof(AllocationSite));
+    AllocationSite* site = &sites[siteCount];
+    site->kind = kind;
+    sourcePosition(position, &site->line, &site->column);
+    return siteCount++;
+}
+
+// escribe el snapshot en 'path'. No reserva en el heap del GC, así que no mueve nada.
+bool writeHeapSnapshot(const char* path, Environment* globals) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+    initSites();
+    buildGraph(globals);
+    int* order = (int*)allocArray(nodeCount, sizeof(int));
+    int* number = postorder(order);
+    int* idom = dominators(order, number);
+    computeRetained(order, idom);
+
+    size_t typeRetained[OBJECT_TYPES] = { 0 };
+    size_t typeSelf[OBJECT_TYPES] = { 0 };
+    int typeCount[OBJECT_TYPES] = { 0 };
+    size_t* siteRetained = (size_t*)allocArray(siteCount, sizeof(size_t));
+    size_t* siteSelf = (size_t*)allocArray(siteCount, sizeof(size_t));
+    int* siteObjects = (int*)allocArray(siteCount, sizeof(int));
+    aggregate(idom, typeRetained, siteRetained);
+    for (int i = 1; i < nodeCount; i++) {
+        typeSelf[nodes[i].object->type] += nodes[i].size;
+        typeCount[nodes[i].object->type] += 1;
+        siteSelf[nodes[i].site] += nodes[i].size;
+        siteObjects[nodes[i].site] += 1;
+    }
+
+    fprintf(file, "heap snapshot: %d objects, %zu bytes reachable\n\n", nodeCount - 1, nodes[0].retained);
+    fprintf(file, "by type:\n  %12s %12s %10s  type\n", "retained", "self", "objects");
+    for (int type = 0; type < OBJECT_TYPES; type++) {
+        if (typeCount[type] == 0) continue;
+        fprintf(file, "  %12zu %12zu %10d  %s\n", typeRetained[type], typeSelf[type], typeCount[type], objectTypeName(type));
+    }
+
+    fprintf(file, "\nby allocation site:\n");
+#ifndef HEAP_PROFILE
+    fprintf(file, "  (build with -DHEAP_PROFILE to record allocation sites)\n");
+#endif
+    fprintf(file, "  %12s %12s %10s  site\n", "retained", "self", "objects");
+    // de más a menos retenido (selección: hay pocos sitios con objetos)
+    bool* written = (bool*)allocArray(siteCount, sizeof(bool));
+    for (;;) {
+        int best = -1;
+        for (int s = 0; s < siteCount; s++) {
+            if (written[s] || siteObjects[s] == 0) continue;
+            if (best < 0 || siteRetained[s] > siteRetained[best]) best = s;
+        }
+        if (best < 0) break;
+        written[best] = true;
+        AllocationSite* site = &sites[best];
+        if (best == 0) {
+            fprintf(file, "  %12zu %12zu %10d  %s\n", siteRetained[best], siteSelf[best], siteObjects[best], site->kind);
+        } else {
+            fprintf(file, "  %12zu %12zu %10d  %s at %d:%d\n", siteRetained[best], siteSelf[best], siteObjects[best],
+                site->kind, site->line, site->column);
+        }
+    }
+    free(written);
+
+    // los objetos que más retienen (sin contar el environment global, que lo retiene todo)
+    fprintf(file, "\nlargest objects (retaining path from the roots):\n");
+    bool* listed = (bool*)allocArray(nodeCount, sizeof(bool));
+    char object[256];
+    for (int k = 0; k < SNAPSHOT_TOP_OBJECTS; k++) {
+        int best = -1;
+        for (int i = 1; i < nodeCount; i++) {
+            if (listed[i] || nodes[i].object == ENV_OBJECT(globals)) continue;
+            if (best < 0 || nodes[i].retained > nodes[best].retained) best = i;
+        }
+        if (best < 0) break;
+        listed[best] = true;
+        fprintf(file, "  #%d %s: %zu bytes retained, %zu self\n", k + 1, describe(best, object, sizeof(object)),
+            nodes[best].retained, nodes[best].size);
+        writePath(file, best);
+    }
+    free(listed);
+
+    free(order);
+    free(number);
+    free(idom);
+    free(siteRetained);
+    free(siteSelf);
+    free(siteObjects);
+    freeGraph();
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef cmonk_heapprof_h
+#define cmonk_heapprof_h
+
+#include "object.h"
+
+/**
+ * Profiler de memoria.
+ * Compilando con -DHEAP_PROFILE cada Object guarda su sitio de reserva: el
+ * nodo del AST que lo creó (una función, una llamada, un operador, un return
+ * o un literal). El parser da de alta un sitio por nodo con su línea y
+ * columna, el tree walker y la VM apuntan en 'allocationSite' el del nodo que
+ * están ejecutando y newObject() lo copia en la cabecera. Sin HEAP_PROFILE
+ * las macros no hacen nada: ni la cabecera ni los nodos crecen.
+ *
+ * El snapshot recorre el heap desde el environment global (y las llamadas en
+ * curso), calcula el árbol de dominadores y escribe cuánta memoria retiene
+ * cada tipo de objeto y cada sitio, y el camino desde las raíces hasta los
+ * objetos que más retienen. Funciona también sin HEAP_PROFILE, solo que sin
+ * sitios.
+ */
+#define SNAPSHOT_TOP_OBJECTS 10 // objetos de los que se escribe el camino
+#define SNAPSHOT_MAX_PATH 16 // pasos del camino que se escriben
+
+#ifdef HEAP_PROFILE
+extern int allocationSite; // sitio del nodo que se está ejecutando (0: desconocido)
+#define NODE_SITE(node, kind, position) ((node)->site = newAllocationSite((kind), (position)))
+#define SET_ALLOCATION_SITE(site) (allocationSite = (site))
+#else
+#define NODE_SITE(node, kind, position) ((void)(position))
+#define SET_ALLOCATION_SITE(site) ((void)0)
+#endif
+
+// un sitio de reserva: el nodo del AST, por su posición en el fuente.
+typedef struct {
+    const char* kind;
+    int line;
+    int column;
+} AllocationSite;
+
+/*================================================================/
+* PUBLIC HEAPPROF API
+*=================================================================*/
+int newAllocationSite(const char* kind, int position);
+bool writeHeapSnapshot(const char* path, Environment* globals);
+
+#endif
@@ -1,390 +1,999 @@
 #include "interpreter.h"
+#include "heap.h"
+#include "marker.h"
+#include "vm.h"
+#include "heapprof.h"
+#include "evalstats.h"
 
-Object* TrueObj;
-Object* FalseObj;
-Object* NilObj;
+static size_t nextGC; // bytes ocupados en el heap viejo a partir de los que se lanza el GC mayor
 
-// Creamos el primer objeto en la lista enlazada de objetos.
-static Object* firstObject;
-static int numObjects; // número de objetos creados actualmente (malloc)
-static int maxObjects; // número máximo de objetos para lanzar el GC.
+/**
+ * Generación joven (nursery). Casi todos los objetos (strings intermedios,
+ * los ReturnObj, los closures de un solo uso) mueren enseguida, así que nacen
+ * aquí reservándose con un simple incremento de puntero. Cuando se llena, la
+ * recolección menor copia los vivos al heap viejo (heap.c, con su mark &
+ * sweep) y la nursery vuelve a empezar vacía. Los objetos muy grandes nacen
+ * directamente en el heap viejo.
+ * Las únicas referencias de lo viejo a lo joven son los slots de los
+ * Environment. Los Environment de las llamadas nacen "jóvenes" (con
+ * 'remembered' a true, así que la barrera no hace nada con ellos) y la
+ * recolección menor los encuentra recorriendo desde las raíces; después pasan
+ * a viejos. En un Environment viejo la barrera de escritura (SET_SLOT) lo
+ * apunta en 'remembered' la primera vez que recibe un objeto joven.
+ */
+static char* nurseryStart;
+static char* nurseryTop; // siguiente hueco libre
+static char* nurseryEnd;
+static Environment** remembered;
+static int rememberedCount;
+static int rememberedCapacity;
+static Object** gray; // objetos promovidos cuyos hijos faltan por copiar
+static int grayCount;
+static int grayCapacity;
+
+/**
+ * Raíces del tree walker. El GC puede saltar en cualquier newObject(), en
+ * medio de una expresión, así que lo que el evaluador tiene a medio usar en
+ * variables de C se registra aquí:
+ * 	roots: direcciones de los Value temporales (el operando izquierdo de un
+ * 	       infix, la función y los argumentos de una llamada...).
+ * 	envs:  los Environment de las llamadas en curso.
+ * Ambas son pilas: se apilan al empezar a usar el valor y se desapilan al terminar.
+ * Junto a cada Environment va el id de la función llamada (calls), que es la
+ * pila de llamadas que lee el profiler (sampleCallStack).
+ */
+static Value** roots;
+static int rootCount;
+static int rootCapacity;
+static Environment** envs;
+static int envCount;
+static int envCapacity;
+static int* calls;
+static Value tailFunction; // la llamada de cola pendiente (ver tailCall)
+static Environment* tailEnv;
+/**
+ * Funciones con el closure compartido en su nodo (FunctionNode.shared). El
+ * closure es el mismo mientras su programa pueda ejecutarse (ver
+ * markSharedFunctions): así '==' no depende de cuándo salte el GC.
+ */
+static FunctionNode** sharedFunctions;
+static int sharedCount;
+static int sharedCapacity;
 // Environment global
 static Environment* globalEnv;
+static Engine engine = ENGINE_AST; // motor con el que se ejecutan los programas
 
 /*================================================================/
 * Forwarded declarations.
 *=================================================================*/
-static void mark(Object* object);
+void markValue(Value value);
+static void markSlot(Value* slot);
+void markObject(Object* object);
 static void markAll();
-static void markEnvironment(Environment* env);
-static void sweep();
+void markEnvironment(Environment* env);
+void visitStackRoots(void (*visitValue)(Value*), void (*visitEnv)(Environment*));
+int sampleCallStack(int* out, int max);
+static bool isYoung(Object* object);
+void writeBarrier(Environment* env, Value value);
+static Object* promote(Object* object);
+static void evacuate(Value* slot);
+static void evacuateEnvironment(Environment* env);
+static void sweepNursery();
+static void minorGC();
+static void majorGC();
+static void markSharedFunctions();
+static void clearSharedFunctions();
+static void pushRoot(Value* value);
+static void popRoots(int count);
+static void pushEnv(Environment* env, int function);
+static void popEnv();
 void gc();
-static Object* newObject(ObjectType type, void* value);
-static Object* newBoolean(bool value);
-static Object* newNull();
-Object* interpret(const char* source);
+Object* newObject(ObjectType type, size_t size);
+Object* newTenuredObject(ObjectType type, size_t size);
+static Value runProgram(Program* program);
+Value interpret(const char* source);
+Value interpretTokens(const char* source, size_t length, int threads);
+void setEngine(Engine selected);
 void initEvaluator();
 void freeEvaluator();
-static Object* newInteger(int value);
-static Object* newString(char* value);
-static Object* newReturn(Object* value);
-static Object* newError(char* message);
-static Object* newFunction(FunctionNode* node, Environment* env);
-static Object* evalBangOperatorExpression(Object* obj);
-static Object* nativeBoolToBooleanObject(bool value);
-static Object* evalMinusPrefixOperatorExpression(Object* obj);
-static Object* evalPrefixExpression(TokenType ope, Object* right);
+static void defineBuiltin(const char* name, BuiltinFn function);
+static Value builtinGcStats(int argc, Value* args);
+static Value builtinHeapSnapshot(int argc, Value* args);
+bool heapSnapshot(const char* path);
+static Value newString(int length);
+static Value newReturn(Value value);
+Value newError(char* message);
+Value newFunction(FunctionNode* node, Environment* env, const Value* slots);
+static Value evalBangOperatorExpression(Value value);
+static Value evalMinusPrefixOperatorExpression(Value value);
+Value evalPrefixExpression(TokenType ope, Value right);
 static bool inlist(const char* src, int argc, ...);
-static Object* evalIntegerInfixExpression(TokenType ope, Object* left, Object* right);
-static Object* evalStringInfixExpression(TokenType ope, Object* left, Object* right);
-static Object* evalInfixExpression(TokenType ope, Object* left, Object* right);
-static Arguments* evalArguments(CallNode* node, Environment* env);
-static Object* applyFunction(Object* function, Arguments* args);
-static Environment* extendFunctionEnv(FunctionObj* funObj, Arguments* args);
-static Object* unwrapReturnValue(Object* evaluated);
-static bool isTruthy(Object* object);
-static bool isError(Object* object);
-Object* evalIfExpression(IfNode* node, Environment* env);
-Object* evalIdentifier(IdentifierNode* node,Environment* env);
-Object* evalExpression(Expression* exp, Environment* env);
-Object* evalBlockStatements(ArrayStmt* stmts, Environment* env);
-Object* evalStatements(Statement* stmt, Environment* env);
-Object* evalProgram(ArrayStmt* program, Environment* env);
+static Value evalIntegerInfixExpression(TokenType ope, Value left, Value right);
+static Value evalStringInfixExpression(TokenType ope, Value left, Value right);
+Value evalInfixExpression(TokenType ope, Value left, Value right);
+static Value evalBuiltinCall(CallNode* node, Value builtin, Environment* env);
+static Value evalCallExpression(CallNode* node, Environment* env);
+static Value evalCall(CallNode* node, Value function, Environment* env);
+static void bindCaptures(Environment* callEnv, FunctionObj* funObj);
+static Value tailCall(CallNode* node, Value function, Environment* env);
+static Value applyFunction(CallNode* node, Value function, Environment* env);
+static Value unwrapReturnValue(Value evaluated);
+bool isTruthy(Value value);
+static bool isAbrupt(Value value);
+Value evalIfExpression(IfNode* node, Environment* env);
+Value evalIdentifier(IdentifierNode* node,Environment* env);
+static void specializeIdentifier(IdentifierNode* node);
+static void specializePrefix(PrefixNode* node, Value right);
+static void specializeInfix(InfixNode* node, Value left, Value right);
+static Value evalInfixRight(InfixNode* node, Value left, Environment* env);
+static Value dispatchExpression(Expression* exp, Environment* env);
+Value evalExpression(Expression* exp, Environment* env);
+Value evalBlockStatements(ArrayStmt* stmts, Environment* env);
+static Value dispatchStatement(Statement* stmt, Environment* env);
+Value evalStatements(Statement* stmt, Environment* env);
+Value evalProgram(ArrayStmt* program, Environment* env);
 
 /*================================================================/
 * Implementation
 *=================================================================*/
-static void mark(Object* object) {
-   if (object->marked) return;
-   object->marked = true;
-   if (object->type == FUNCTION_OBJ) {
-      markEnvironment(((FunctionObj*)object->value)->env);
-   }
+// marcar solo apila el objeto: marker.c recorre los hijos sin recursión (y en paralelo si el heap es grande).
+// los inmediatos (enteros, booleanos, null) no ocupan el heap: no hay nada que marcar.
+void markValue(Value value) {
+    if (IS_OBJ(value)) markerPush(AS_OBJ(value));
+}
+
+static void markSlot(Value* slot) {
+    markValue(*slot);
+}
+
+void markObject(Object* object) {
+    markerPush(object);
+}
+
+void markEnvironment(Environment* env) {
+    if (env != NULL) markerPush(ENV_OBJECT(env));
 }
 
-static void markEnvironment(Environment* env) {
-    for (int i = 0; i < env->store->count; i++) {
-        mark(env->store->items[i]->value);
+static void markAll() {
+    // las constantes de los programas vivos
+    for (Program* program = firstLiveProgram(); program != NULL; program = program->next) {
+        for (int i = 0; i < program->constants.count; i++) {
+            markObject(program->constants.objects[i]);
+        }
+    }
+    // marcar el environment global (NULL mientras se crea en initEvaluator)
+    if (globalEnv != NULL) markEnvironment(globalEnv);
+    visitStackRoots(markSlot, markEnvironment);
+}
+
+// las raíces de las llamadas en curso: los temporales del tree walker y la pila y los frames de la VM.
+void visitStackRoots(void (*visitValue)(Value*), void (*visitEnv)(Environment*)) {
+    for (int i = 0; i < rootCount; i++) {
+        visitValue(roots[i]);
     }
-    if (env->outer != NULL) {
-        markEnvironment(env->outer);
+    for (int i = 0; i < envCount; i++) {
+        visitEnv(envs[i]);
     }
+    visitVMRoots(visitValue, visitEnv);
 }
 
-static void markAll() {
-    mark(TrueObj);
-    mark(FalseObj);
-    mark(NilObj);
-    // marcar el environment global
-    markEnvironment(globalEnv);
-}
-
-static void sweep() {
-    Object** object = &firstObject;
-    while (*object) {
-        if (!(*object)->marked) {
-            // Este objeto es inalcalzable así que lo liberamos.
-            Object* unreached = *object;
-            *object = unreached->next; // desvincular el objeto
-            freeObject(unreached); // libera el objeto envuelto y a sí mismo.            
-            numObjects -= 1;
+/**
+ * La pila de llamadas de Monkey para el profiler, de la más interna a la más
+ * externa: los ids de las funciones (ver profiler.h). Escribe como mucho
+ * 'max' y devuelve cuántas llamadas hay. Se llama desde un manejador de
+ * señal: solo lee.
+ */
+int sampleCallStack(int* out, int max) {
+    int depth = sampleVMCallStack(out, max);
+    for (int i = envCount - 1; i >= 0; i--, depth++) {
+        if (depth < max) out[depth] = calls[i];
+    }
+    return depth;
+}
+
+static bool isYoung(Object* object) {
+    return (char*)object >= nurseryStart && (char*)object < nurseryEnd;
+}
+
+// un Environment viejo guarda un objeto joven: hasta la próxima recolección menor es raíz.
+void writeBarrier(Environment* env, Value value) {
+    if (!isYoung(AS_OBJ(value))) return;
+    if (rememberedCapacity < (rememberedCount + 1)) {
+        rememberedCapacity = (rememberedCapacity == 0) ? 256 : rememberedCapacity * 2;
+        remembered = realloc(remembered, sizeof(Environment*) * rememberedCapacity);
+        if (remembered == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    env->remembered = true;
+    remembered[rememberedCount++] = env;
+}
+
+// copia un objeto joven al heap viejo y deja en el original la dirección de la copia.
+static Object* promote(Object* object) {
+    size_t size = objectSize(object);
+    Object* copy = heapAlloc(size);
+    memcpy(copy, object, size);
+    copy->marked = false;
+    copy->free = false;
+    copy->next = NULL;
+    object->next = copy;
+
+    if (grayCapacity < (grayCount + 1)) {
+        grayCapacity = (grayCapacity == 0) ? 256 : grayCapacity * 2;
+        gray = realloc(gray, sizeof(Object*) * grayCapacity);
+        if (gray == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    gray[grayCount++] = copy;
+    COUNT_PROMOTION(size);
+    return copy;
+}
+
+// si el slot apunta a la nursery lo redirige a la copia (promoviendo el objeto si hace falta).
+static void evacuate(Value* slot) {
+    if (!IS_OBJ(*slot)) return;
+    Object* object = AS_OBJ(*slot);
+    if (!isYoung(object)) return;
+    Object* copy = (object->next != NULL) ? object->next : promote(object);
+    *slot = OBJ_VAL(copy);
+}
+
+/**
+ * Copia lo joven de un Environment joven o apuntado y de su cadena de outer, y
+ * lo deja como viejo. Uno viejo sin apuntar no tiene nada joven, ni sus outer
+ * (que son todavía más viejos).
+ */
+static void evacuateEnvironment(Environment* env) {
+    for (; env != NULL && env->remembered; env = env->outer) {
+        env->remembered = false;
+        for (int i = 0; i < env->count; i++) {
+            evacuate(&env->slots[i]);
+        }
+    }
+}
+
+// los objetos de la nursery que no se copiaron están muertos: solo los closures tienen algo que soltar.
+static void sweepNursery() {
+    char* object = nurseryStart;
+    while (object < nurseryTop) {
+        size_t size = NURSERY_ALIGN(objectSize((Object*)object));
+        if (((Object*)object)->next == NULL) finalizeObject((Object*)object);
+        object += size;
+    }
+    nurseryTop = nurseryStart;
+}
+
+/**
+ * Recolección menor: las raíces son los temporales del tree walker, la pila de
+ * la VM, los Environment de las llamadas en curso y los del remembered set.
+ * Lo viejo no se recorre.
+ */
+static void minorGC() {
+    double start = gcClock();
+    size_t promoted = gcCounters.promoted;
+    size_t promotedBytes = gcCounters.promotedBytes;
+    for (int i = 0; i < rootCount; i++) {
+        evacuate(roots[i]);
+    }
+    for (int i = 0; i < envCount; i++) {
+        evacuateEnvironment(envs[i]);
+    }
+    visitVMRoots(evacuate, evacuateEnvironment);
+    for (int i = 0; i < rememberedCount; i++) {
+        evacuateEnvironment(remembered[i]);
+    }
+    rememberedCount = 0;
+    // los hijos de lo promovido (el valor de un ReturnObj, el Environment de un closure).
+    while (grayCount > 0) {
+        Object* object = gray[--grayCount];
+        if (object->type == RETURN_OBJ) {
+            evacuate(&((ReturnObj*)OBJ_PAYLOAD(object))->value);
+        }
+        if (object->type == FUNCTION_OBJ) {
+            FunctionObj* func = (FunctionObj*)OBJ_PAYLOAD(object);
+            for (int i = 0; i < func->captureCount; i++) {
+                evacuate(&func->captures[i]);
+            }
+            evacuateEnvironment(func->env);
+        }
+    }
+    sweepNursery();
+
+    // lo que sobrevive a una menor son los promovidos.
+    recordCollection(GC_MINOR, gcClock() - start, gcCounters.promoted - promoted,
+        gcCounters.promotedBytes - promotedBytes, nextGC);
+
+    if (heapBytesInUse() >= nextGC) {
+        majorGC();
+    }
+}
+
+/**
+ * Recolección mayor: mark & sweep del heap viejo. La nursery tiene que estar vacía.
+ * Lo que quedó sin barrer del ciclo anterior se barre antes de marcar; del
+ * sweep nuevo solo se hace aquí lo imprescindible (heapStartSweep) y el resto
+ * lo van haciendo las reservas.
+ */
+static void majorGC() {
+    double start = gcClock();
+    heapFinishSweep();
+    markAll(); // apilamos las raíces...
+    int live;
+    size_t liveBytes;
+    markerDrain(heapBytesInUse() >= MARK_PARALLEL_MIN, &live, &liveBytes); // ...y marcamos todo lo alcanzable.
+    markSharedFunctions();
+    int sharedLive;
+    size_t sharedBytes;
+    markerDrain(false, &sharedLive, &sharedBytes); // solo closures compartidos: no tienen hijos sin marcar
+    live += sharedLive;
+    liveBytes += sharedBytes;
+    heapStartSweep(liveBytes); // todos los que no fueron marcados serán eliminados.
+    // el siguiente GC se lanza cuando el heap crezca en proporción a lo que sigue vivo.
+    nextGC = liveBytes * GC_HEAP_GROW_FACTOR;
+    if (nextGC < GC_MIN_HEAP_SIZE) nextGC = GC_MIN_HEAP_SIZE;
+
+    recordCollection(GC_MAJOR, gcClock() - start, live, liveBytes, nextGC);
+}
+
+/**
+ * Después de marcar lo demás: un programa conserva sus closures compartidos
+ * si lo retiene algo más que ellos (el intérprete o un closure normal) o si
+ * alguno es alcanzable. Si no, ya nada puede ejecutar su código: la caché se
+ * vacía y los closures mueren con el barrido, como cualquier otro.
+ * Los closures compartidos nacen en el heap viejo.
+ */
+static void markSharedFunctions() {
+    for (int i = 0; i < sharedCount; i++) {
+        Program* program = sharedFunctions[i]->program;
+        program->keepShared = program->arena->refCount > program->sharedClosures;
+    }
+    for (int i = 0; i < sharedCount; i++) {
+        if (sharedFunctions[i]->shared->marked) sharedFunctions[i]->program->keepShared = true;
+    }
+    int kept = 0;
+    for (int i = 0; i < sharedCount; i++) {
+        FunctionNode* node = sharedFunctions[i];
+        if (node->program->keepShared) {
+            markObject(node->shared);
+            sharedFunctions[kept++] = node;
         } else {
-            // Este objeto sigue activo así que lo marcamos como false para 
-            // chequearlo en la siguiente ronda.
-            (*object)->marked = false;
-            object = &(*object)->next;
+            node->shared = NULL;
+            node->program->sharedClosures -= 1;
         }
     }
+    sharedCount = kept;
 }
 
-void gc() {
-    int curNumObjects = numObjects;
-    markAll(); // marcamos todos los objetos activos en este punto.
-    sweep(); // todos los que no fueron marcados serán eliminados.
-    // maxObjects = (numObjects == 0) ? GC_MAX_OBJECTS : numObjects * 2;
+// vacía la caché sin tocar los closures (los elimina heapFreeAll).
+static void clearSharedFunctions() {
+    for (int i = 0; i < sharedCount; i++) {
+        sharedFunctions[i]->shared = NULL;
+        sharedFunctions[i]->program->sharedClosures = 0;
+    }
+    sharedCount = 0;
+}
 
-    fprintf(stdout, "Collected %d objects, %d remaining.\n", curNumObjects - numObjects, (numObjects-3));
+// recolección completa: vaciar la nursery y después el heap viejo.
+void gc() {
+    int majors = gcCounters.majorCollections;
+    minorGC(); // si el heap viejo pasó del umbral ya hace la mayor
+    if (gcCounters.majorCollections == majors) {
+        majorGC();
+    }
 }
 
 /*================================================================/
 * Funciones factory.
 *=================================================================*/
-static Object* newObject(ObjectType type, void* value) {
-    if (numObjects == maxObjects) {
-        gc();
+// las raíces se guardan en arrays que crecen al doble.
+static void pushRoot(Value* value) {
+    if (rootCapacity < (rootCount + 1)) {
+        rootCapacity = (rootCapacity == 0) ? 256 : rootCapacity * 2;
+        roots = realloc(roots, sizeof(Value*) * rootCapacity);
+        if (roots == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    roots[rootCount++] = value;
+}
+
+static void popRoots(int count) {
+    rootCount -= count;
+}
+
+static void pushEnv(Environment* env, int function) {
+    if (envCapacity < (envCount + 1)) {
+        envCapacity = (envCapacity == 0) ? 256 : envCapacity * 2;
+        envs = realloc(envs, sizeof(Environment*) * envCapacity);
+        // 'calls' la lee el manejador de SIGPROF: el array viejo sigue valiendo hasta que se publica el nuevo.
+        int* grown = malloc(sizeof(int) * envCapacity);
+        if (envs == NULL || grown == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+        if (envCount > 0) memcpy(grown, calls, sizeof(int) * envCount);
+        int* old = calls;
+        calls = grown;
+        free(old);
+    }
+    envs[envCount] = env;
+    calls[envCount] = function;
+    envCount += 1;
+}
+
+static void popEnv() {
+    envCount -= 1;
+}
+
+// los objetos nuevos nacen en la nursery. 'size' incluye la cabecera; el contenido lo rellena quien llama.
+Object* newObject(ObjectType type, size_t size) {
+    if (size > GC_LARGE_OBJECT_SIZE) {
+        return newTenuredObject(type, size);
     }
-    Object* object = createObject(Object);
+    size_t reserved = NURSERY_ALIGN(size);
+#ifdef DEBUG_STRESS_GC
+    gc(); // un GC en cada reserva: cualquier raíz olvidada aparece enseguida.
+#else
+    if (nurseryTop + reserved > nurseryEnd) {
+        minorGC();
+    }
+#endif
+    Object* object = (Object*)nurseryTop;
+    nurseryTop    += reserved;
     object->type   = type;
-    object->next   = firstObject; // apunta al último objeto creado.
-    firstObject    = object; // ahora el último objeto creado es este 'object'.
     object->marked = false;
-    object->value  = value;
+    object->free   = false;
+    object->next   = NULL; // sin copia en el heap viejo todavía
+#ifdef HEAP_PROFILE
+    object->site   = allocationSite;
+#endif
 
-    numObjects += 1; // otro objeto ha sido creado así que incrementamos el número.    
+    COUNT_ALLOCATION(type, size);
 
     return object;
 }
 
-static Object* newBoolean(bool value) {
-    BooleanObj* bo = createObject(BooleanObj);
-    bo->value = value;
+// objetos que van a vivir mucho (las constantes de un programa) o muy grandes van directos al heap viejo.
+Object* newTenuredObject(ObjectType type, size_t size) {
+#ifdef DEBUG_STRESS_GC
+    gc();
+#else
+    if (heapBytesInUse() >= nextGC) {
+        gc();
+    }
+#endif
+    Object* object = heapAlloc(size);
+    object->type   = type;
+    object->marked = false;
+    object->free   = false;
+    object->next   = NULL;
+#ifdef HEAP_PROFILE
+    object->site   = allocationSite;
+#endif
 
-    return newObject(BOOLEAN_OBJ, bo);
-}
+    COUNT_ALLOCATION(type, size);
 
-static Object* newNull() {
-    NullObj* ni_obj = createObject(NullObj);
-    return newObject(NULL_OBJ, ni_obj);
+    return object;
 }
 
-static Object* newError(char* message) {
-    ErrorObj* error = createObject(ErrorObj);
-    strcpy_s(error->message, 1024, message);
+Value newError(char* message) {
+    int length = (int)strlen(message);
+    Object* object = newObject(ERROR_OBJ, sizeof(Object) + sizeof(ErrorObj) + length + 1);
+    ErrorObj* error = (ErrorObj*)OBJ_PAYLOAD(object);
+    error->length = length;
+    memcpy(error->message, message, length + 1);
 
-    return newObject(ERROR_OBJ, error);
+    return OBJ_VAL(object);
 }
 
-static Object* newFunction(FunctionNode* node, Environment* env) {
-    FunctionObj* func = createObject(FunctionObj);
+/**
+ * Closure de 'node' creado en 'env'. Las variables que copia (ver
+ * resolver.h) se leen de 'slots', los locales de la función que lo crea. Si
+ * no copia nada ni necesita 'env' el closure siempre es igual: se crea una
+ * vez, en el heap viejo, y se reutiliza mientras su programa pueda
+ * ejecutarse (ver markSharedFunctions).
+ */
+Value newFunction(FunctionNode* node, Environment* env, const Value* slots) {
+    bool shared = node->captureCount == 0 && !node->keepsEnv;
+    if (shared && node->shared != NULL) {
+        return OBJ_VAL(node->shared);
+    }
+    size_t size = sizeof(Object) + sizeof(FunctionObj) + sizeof(Value) * node->captureCount;
+    Object* object = shared ? newTenuredObject(FUNCTION_OBJ, size) : newObject(FUNCTION_OBJ, size);
+    FunctionObj* func = (FunctionObj*)OBJ_PAYLOAD(object);
 
-    memcpy(func->parameters, node->parameters, sizeof(func->parameters));
+    func->parameters = node->parameters;
     func->arity = node->arity;
+    func->localCount = node->localCount;
+    func->profile = node->profile;
+    func->closures = node->closures;
+    func->locals = node->locals;
     func->body = node->body;
-    func->env = env;
+    func->env = node->keepsEnv ? env : globalEnv;
+    func->program = node->program;
+    func->compiled = NULL; // lo pone la VM si el closure es suyo
+    func->captureCount = node->captureCount;
+    for (int i = 0; i < node->captureCount; i++) {
+        func->captures[i] = slots[node->captures[i]];
+        // copia vacía (un argumento que faltó): la variable se buscará por nombre desde 'env'.
+        if (func->captures[i] == EMPTY_VAL) func->env = env;
+    }
+    if (shared) {
+        if (sharedCount == sharedCapacity) {
+            sharedCapacity = (sharedCapacity == 0) ? FIRST_ARRAY_CAPACITY : sharedCapacity * GROWING_ARRAY_FACTOR;
+            sharedFunctions = realloc(sharedFunctions, sizeof(FunctionNode*) * sharedCapacity);
+            if (sharedFunctions == NULL) {
+                fprintf(stderr, "ERROR: not enough memory.\n");
+                exit(74);
+            }
+        }
+        sharedFunctions[sharedCount++] = node;
+        node->shared = object;
+        node->program->sharedClosures += 1;
+    }
+    retainProgram(node->program);
 
-    return newObject(FUNCTION_OBJ, func);
+    return OBJ_VAL(object);
 }
 
 /*================================================================/
 * Inicializador del evaluador.
 *=================================================================*/
-Object* interpret(const char* source) {
-    initLexer(source);
-    ArrayStmt* program = parseProgram();
+static Value runProgram(Program* program) {
+    Value evaluated = EMPTY_VAL;
     if (program != NULL) {
-        Object* evaluated = evalProgram(program, globalEnv);
-		if (evaluated != NULL) {
+        resolveProgram(program);
+        SET_ALLOCATION_SITE(0); // lo que no sale de un nodo concreto es del runtime
+        reserveGlobals(globalEnv, symbolCount()); // un slot para cada nombre que haya aparecido
+        if (engine == ENGINE_VM) {
+            evaluated = runVM(compileProgram(program), globalEnv);
+        } else {
+            evaluated = evalProgram(program->statements, globalEnv);
+        }
+		if (evaluated != EMPTY_VAL) {
 			fprintf(stdout, "%s\n", inspect(evaluated));
 		}
         // gc();
-        freeProgram(program);
+        releaseProgram(program);
     }
+    return evaluated;
+}
+
+// el parser pide los tokens al lexer de uno en uno (modo REPL).
+Value interpret(const char* source) {
+    initLexer(source);
+    return runProgram(parseProgram());
+}
+
+// tokeniza todo el fuente de una vez (en paralelo si es grande) antes de parsear.
+Value interpretTokens(const char* source, size_t length, int threads) {
+    TokenBuffer* tokens = tokenize(source, length, threads);
+    Program* program = parseTokens(tokens);
+    freeTokenBuffer(tokens);
+    return runProgram(program);
+}
+
+void setEngine(Engine selected) {
+    engine = selected;
 }
 
 void initEvaluator() {
     // ********************************* //
-    firstObject = NULL; // el objeto raíz siempre es NULL.
-    numObjects = 0;
-    maxObjects = GC_MAX_OBJECTS;
+    nextGC = GC_MIN_HEAP_SIZE;
+    rootCount = 0;
+    envCount = 0;
+    nurseryStart = (char*)malloc(GC_NURSERY_SIZE);
+    if (nurseryStart == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    nurseryTop = nurseryStart;
+    nurseryEnd = nurseryStart + GC_NURSERY_SIZE;
+    rememberedCount = 0;
+    grayCount = 0;
+    resetGcStats();
+    resetEvalStats();
+    gcCounters.heapLimit = nextGC;
     // ********************************* //
+    initVM();
     globalEnv = newEnvironment();
-    TrueObj  = newBoolean(true);
-    FalseObj = newBoolean(false);
-    NilObj   = newNull();
+    defineBuiltin("gcStats", builtinGcStats);
+    defineBuiltin("heapSnapshot", builtinHeapSnapshot);
 }
 
 void freeEvaluator() {
-    // liberar los objetos estáticos.
-    // freeObject(TrueObj);
-    // numObjects -= 1;
-    // freeObject(FalseObj);
-    // numObjects -= 1;
-    // freeObject(NilObj);
-    // numObjects -= 1;
-    int curNumObjects = numObjects;
-    sweep(); // eliminar todo sin dejar nada
-    fprintf(stdout, "Collected %d objects, %d remaining.\n", curNumObjects - numObjects, numObjects);
+    sweepNursery();
+    clearSharedFunctions(); // antes de que los programas se liberen con sus closures
+    heapFreeAll(); // eliminar todo sin dejar nada (también los Environment)
+    globalEnv = NULL;
+    freeMarkers();
+    freeVM();
 }
 
-/********************************************************
-* Helper functions
-*********************************************************/
-static Object* newInteger(int value) {
-    IntegerObj* intObj = createObject(IntegerObj);
-    intObj->value = value;
+/*================================================================/
+* Builtins.
+*=================================================================*/
+// un builtin es una variable global más: ocupa el slot de su símbolo en el environment global.
+static void defineBuiltin(const char* name, BuiltinFn function) {
+    int symbol = internSymbol(name, (int)strlen(name));
+    Object* object = newTenuredObject(BUILTIN_OBJ, sizeof(Object) + sizeof(BuiltinObj));
+    BuiltinObj* builtin = (BuiltinObj*)OBJ_PAYLOAD(object);
+    builtin->name = name;
+    builtin->function = function;
+    reserveGlobals(globalEnv, symbol + 1);
+    SET_SLOT(globalEnv, symbol, OBJ_VAL(object));
+}
 
-    return newObject(INTEGER_OBJ, intObj);
+/**
+ * gcStats(): todos los contadores del GC como un string JSON (ver gcstats.c).
+ * gcStats("nombre"): uno solo como entero, p.ej. gcStats("majorCollections").
+ * Los tiempos en microsegundos.
+ */
+static Value builtinGcStats(int argc, Value* args) {
+    if (argc == 0) {
+        char* json = gcStatsJSON();
+        int length = (int)strlen(json);
+        Value result = newString(length);
+        memcpy(AS_STRING(result)->value, json, length);
+        free(json);
+        return result;
+    }
+    if (argc != 1 || valueType(args[0]) != STRING_OBJ) {
+        return newError("wrong arguments for gcStats.");
+    }
+    long long value;
+    if (!gcStatsField(AS_STRING(args[0])->value, &value)) {
+        char msg[1024];
+        sprintf_s(msg, sizeof(msg), "unknown gc counter: %s.", AS_STRING(args[0])->value);
+        return newError(msg);
+    }
+    // los enteros de Monkey son de 32 bits.
+    return INT_VAL((value > INT_MAX) ? INT_MAX : value);
+}
+
+// heapSnapshot("fichero"): escribe el snapshot del heap (ver heapprof.c).
+static Value builtinHeapSnapshot(int argc, Value* args) {
+    if (argc != 1 || valueType(args[0]) != STRING_OBJ) {
+        return newError("wrong arguments for heapSnapshot.");
+    }
+    if (!heapSnapshot(AS_STRING(args[0])->value)) {
+        char msg[1024];
+        sprintf_s(msg, sizeof(msg), "could not write heap snapshot: %s.", AS_STRING(args[0])->value);
+        return newError(msg);
+    }
+    return NULL_VAL;
+}
+
+// snapshot del heap alcanzable desde el environment global. Devuelve false si no se pudo escribir.
+bool heapSnapshot(const char* path) {
+    return writeHeapSnapshot(path, globalEnv);
 }
 
-static Object* newString(char* value) {
-    StringObj* strObj = createObject(StringObj);
-    strObj->value = strdup(value);
+/********************************************************
+* Helper functions
+*********************************************************/
+// un string de 'length' caracteres sin rellenar (el '\0' final ya está puesto).
+static Value newString(int length) {
+    Object* object = newObject(STRING_OBJ, sizeof(Object) + sizeof(StringObj) + length + 1);
+    StringObj* strObj = (StringObj*)OBJ_PAYLOAD(object);
+    strObj->length = length;
+    strObj->value[length] = '\0';
 
-    return newObject(STRING_OBJ, strObj);
+    return OBJ_VAL(object);
 }
 
-static Object* newReturn(Object* value) {
-    ReturnObj* retObj = createObject(ReturnObj);
-    retObj->value = value;
+// el valor se guarda después de reservar: si salta el GC 'value' se actualiza como raíz.
+static Value newReturn(Value value) {
+    pushRoot(&value);
+    Object* object = newObject(RETURN_OBJ, sizeof(Object) + sizeof(ReturnObj));
+    popRoots(1);
+    ((ReturnObj*)OBJ_PAYLOAD(object))->value = value;
 
-    return newObject(RETURN_OBJ, retObj);
+    return OBJ_VAL(object);
 }
 
-static Object* evalBangOperatorExpression(Object* obj) {
-    switch (obj->type) {
+static Value evalBangOperatorExpression(Value value) {
+    switch (valueType(value)) {
     case BOOLEAN_OBJ:
-        return (obj == TrueObj) ? FalseObj : TrueObj; // !true | !false
+        return BOOL_VAL(!AS_BOOL(value)); // !true | !false
     case NULL_OBJ:
-        return TrueObj;
+        return TRUE_VAL;
     default:
-        return FalseObj;
+        return FALSE_VAL;
     }
 }
 
-static Object* nativeBoolToBooleanObject(bool value) {
-    return value ? TrueObj : FalseObj;
-}
-
-static Object* evalMinusPrefixOperatorExpression(Object* obj) {
-    if (obj->type != INTEGER_OBJ) {
+static Value evalMinusPrefixOperatorExpression(Value value) {
+    if (!IS_INT(value)) {
         return newError("Operand must be an integer type.");
     }
-    IntegerObj* integer = (IntegerObj*)obj->value;
-
-    return newInteger(integer->value * -1);
+    return INT_VAL(AS_INT(value) * -1);
 }
 
-static Object* evalPrefixExpression(TokenType ope, Object* right) {
+Value evalPrefixExpression(TokenType ope, Value right) {
     switch (ope) {
     case T_BANG:
         return evalBangOperatorExpression(right);
     case T_MINUS:
         return evalMinusPrefixOperatorExpression(right);
     default:
-        return NilObj;
+        return NULL_VAL;
     }
 }
 
-static Object* evalIntegerInfixExpression(TokenType ope, Object* left, Object* right) {    
-    int leftVal = ((IntegerObj*)left->value)->value;
-    int rightVal = ((IntegerObj*)right->value)->value;
+// los resultados son inmediatos: la aritmética no reserva memoria.
+static Value evalIntegerInfixExpression(TokenType ope, Value left, Value right) {    
+    int leftVal = AS_INT(left);
+    int rightVal = AS_INT(right);
 
     switch (ope) {
         case T_PLUS:
-            return newInteger(leftVal + rightVal);
+            return INT_VAL(leftVal + rightVal);
         case T_MINUS:
-            return newInteger(leftVal - rightVal);
+            return INT_VAL(leftVal - rightVal);
         case T_ASTERISK:
-            return newInteger(leftVal * rightVal);
+            return INT_VAL(leftVal * rightVal);
         case T_SLASH: 
             if (rightVal == 0) {
                 fprintf(stdout, "Division by zero.\n");
                 exit(74);
             }
-            return newInteger(leftVal / rightVal);
+            return INT_VAL(leftVal / rightVal);
         case T_LT:
-            return nativeBoolToBooleanObject(leftVal < rightVal);
+            return BOOL_VAL(leftVal < rightVal);
         case T_GT:
-            return nativeBoolToBooleanObject(leftVal > rightVal);
+            return BOOL_VAL(leftVal > rightVal);
         case T_EQ:
-            return nativeBoolToBooleanObject(leftVal == rightVal);
+            return BOOL_VAL(leftVal == rightVal);
         case T_NOT_EQ:
-            return nativeBoolToBooleanObject(leftVal != rightVal);
+            return BOOL_VAL(leftVal != rightVal);
         default:
             return newError("Unknown operator for integer operands.");
     }
 }
 
-static Object* evalStringInfixExpression(TokenType ope, Object* left, Object* right) {
+static Value evalStringInfixExpression(TokenType ope, Value left, Value right) {
     switch (ope) {
         case T_PLUS: {
-            StringObj* leftStr = (StringObj*)left->value;
-            StringObj* rightStr = (StringObj*)right->value;
-            int len = strlen(leftStr->value) + strlen(rightStr->value);
-            char *str = (char*)malloc(len + 1);
-            if (str == NULL) {
-                fprintf(stderr, "ERROR: out of memory.\n");
-                exit(74);
-            }
-            sprintf_s(str, len+1, "%s%s", leftStr->value, rightStr->value);
-
-            return newString(str);
+            // los operandos son raíces mientras se reserva: el GC puede moverlos.
+            int leftLen = AS_STRING(left)->length;
+            int rightLen = AS_STRING(right)->length;
+            pushRoot(&left);
+            pushRoot(&right);
+            Value result = newString(leftLen + rightLen);
+            popRoots(2);
+            memcpy(AS_STRING(result)->value, AS_STRING(left)->value, leftLen);
+            memcpy(AS_STRING(result)->value + leftLen, AS_STRING(right)->value, rightLen);
+            return result;
         }
         default:
-            return NilObj;
+            return NULL_VAL;
     }
 }
 
-static Object* evalInfixExpression(TokenType ope, Object* left, Object* right) {
-    if (left->type == INTEGER_OBJ && right->type == INTEGER_OBJ)
+Value evalInfixExpression(TokenType ope, Value left, Value right) {
+    ObjectType leftType = valueType(left);
+    ObjectType rightType = valueType(right);
+    if (leftType == INTEGER_OBJ && rightType == INTEGER_OBJ)
         return evalIntegerInfixExpression(ope, left, right);
     
-    if (left->type == STRING_OBJ && right->type == STRING_OBJ)
+    if (leftType == STRING_OBJ && rightType == STRING_OBJ)
         return evalStringInfixExpression(ope, left, right);
 
-    if (left->type != right->type) {
+    if (leftType != rightType) {
         return newError("type mismatch. Operators must have the same type.");
     }
 
+    // booleanos y null son inmediatos; el resto se compara por identidad.
     switch (ope) {
         case T_EQ:
-            return nativeBoolToBooleanObject(left == right);
+            return BOOL_VAL(left == right);
         case T_NOT_EQ:
-            return nativeBoolToBooleanObject(left != right);
+            return BOOL_VAL(left != right);
         default:
             return newError("Not supported operator.");
     }
 }
 
-static Arguments* evalArguments(CallNode* node, Environment* env) {
-    Arguments* args = createObject(Arguments);
-
-    Object* result;
+/**
+ * Una llamada: el Environment de la función se crea antes que los argumentos y
+ * cada argumento se evalúa directamente en el slot de su parámetro. Mientras
+ * tanto el Environment ya está en la pila de raíces (pushEnv), así que los
+ * argumentos ya evaluados siguen vivos si salta el GC.
+ */
+// los argumentos de un builtin van a un array propio, registrado como raíz mientras se usa.
+static Value evalBuiltinCall(CallNode* node, Value builtin, Environment* env) {
+    BuiltinFn function = AS_BUILTIN(builtin)->function;
+    Value* args = (Value*)malloc(sizeof(Value) * (node->argc > 0 ? node->argc : 1));
+    if (args == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
     for (int i = 0; i < node->argc; i++) {
-        result = evalExpression(node->arguments[i], env);
-        if (isError(result)) {
-            args->arguments[0] = result;
-            return args;
+        args[i] = evalExpression(node->arguments[i], env);
+        if (isAbrupt(args[i])) {
+            Value error = args[i];
+            popRoots(i);
+            free(args);
+            return error;
         }
-        args->arguments[i] = result;
+        pushRoot(&args[i]);
     }
+    Value result = function(node->argc, args);
+    popRoots(node->argc);
+    free(args);
 
-    return args;
+    return result;
 }
 
-static Object* applyFunction(Object* function, Arguments* args) {
-    if (function->type != FUNCTION_OBJ) {
+static Value evalCallExpression(CallNode* node, Environment* env) {
+    Value function = evalExpression(node->function, env);
+    return evalCall(node, function, env);
+}
+
+// la llamada con la función ya evaluada. La primera vez el nodo se especializa según lo que llama.
+static Value evalCall(CallNode* node, Value function, Environment* env) {
+    if (isAbrupt(function)) return function;
+    ObjectType type = valueType(function);
+    if (node->type == NT_CALL) {
+        node->type = (type == FUNCTION_OBJ) ? NT_CALL_FUNCTION : NT_CALL_GENERIC;
+        node->target = (type == FUNCTION_OBJ) ? AS_FUNCTION(function)->body : NULL;
+    }
+    if (type == BUILTIN_OBJ) return evalBuiltinCall(node, function, env);
+    if (type != FUNCTION_OBJ) {
+        // un error en los argumentos se informa antes que este.
+        for (int i = 0; i < node->argc; i++) {
+            Value arg = evalExpression(node->arguments[i], env);
+            if (isAbrupt(arg)) return arg;
+        }
         return newError("not a function.");
     }
-    FunctionObj* funObj = (FunctionObj*)function->value;
+    return applyFunction(node, function, env);
+}
 
-    Environment* extendedEnv = extendFunctionEnv(funObj, args);
-    Object* evaluated = evalBlockStatements(funObj->body, extendedEnv);
+// las variables copiadas por el closure van a los últimos slots de la llamada.
+static void bindCaptures(Environment* callEnv, FunctionObj* funObj) {
+    int first = funObj->localCount - funObj->captureCount;
+    for (int i = 0; i < funObj->captureCount; i++) {
+        SET_SLOT(callEnv, first + i, funObj->captures[i]);
+    }
+}
 
-    return unwrapReturnValue(evaluated);
+/**
+ * Llamada de cola (CallNode.tail, ver resolver.c): en lugar de ejecutar el
+ * cuerpo deja preparado el Environment de la llamada en 'tailFunction' y
+ * 'tailEnv' y devuelve TAIL_CALL_VAL. Ese valor sube por el return, el if y
+ * el bloque hasta applyFunction(), que ejecuta ahí el cuerpo nuevo en lugar
+ * del que acaba: la pila de C no crece. Por el camino no se reserva nada, así
+ * que ni la función ni el Environment necesitan ser raíces hasta entonces.
+ * Si se llama a la misma función que se está ejecutando y esta no crea
+ * closures (nadie más puede tener su Environment) se reutiliza el
+ * Environment: los argumentos se evalúan aparte y después se vacían los slots
+ * y se escriben los parámetros.
+ */
+static Value tailCall(CallNode* node, Value function, Environment* env) {
+    FunctionObj* funObj = AS_FUNCTION(function);
+    IdentifierNode** parameters = funObj->parameters;
+    int arity = funObj->arity;
+    int profile = funObj->profile; // el closure se puede mover en cuanto se reserve algo
+    pushRoot(&function);
+
+    if (env->symbols == funObj->locals && env->outer == funObj->env && !funObj->closures
+        && node->argc <= TAIL_CALL_ARGS) {
+        Value args[TAIL_CALL_ARGS];
+        for (int i = 0; i < node->argc; i++) {
+            args[i] = evalExpression(node->arguments[i], env);
+            if (isAbrupt(args[i])) {
+                Value error = args[i];
+                popRoots(i + 1);
+                return error;
+            }
+            pushRoot(&args[i]);
+        }
+        for (int i = 0; i < env->count; i++) {
+            env->slots[i] = EMPTY_VAL;
+        }
+        for (int i = 0; i < node->argc && i < arity; i++) {
+            SET_SLOT(env, parameters[i]->slot, args[i]);
+        }
+        bindCaptures(env, AS_FUNCTION(function));
+        popRoots(node->argc + 1);
+        tailFunction = function;
+        tailEnv = env;
+        return TAIL_CALL_VAL;
+    }
+
+    SET_ALLOCATION_SITE(node->site);
+    Environment* callEnv = newEnclosedEnvironment(funObj->env, funObj->localCount, funObj->locals);
+    bindCaptures(callEnv, AS_FUNCTION(function)); // el closure pudo moverse con la reserva
+    pushEnv(callEnv, profile);
+    for (int i = 0; i < node->argc; i++) {
+        Value arg = evalExpression(node->arguments[i], env);
+        if (isAbrupt(arg)) {
+            popEnv();
+            popRoots(1);
+            return arg;
+        }
+        if (i < arity) {
+            SET_SLOT(callEnv, parameters[i]->slot, arg);
+        }
+    }
+    popEnv();
+    popRoots(1);
+    tailFunction = function;
+    tailEnv = callEnv;
+    return TAIL_CALL_VAL;
 }
 
-static Environment* extendFunctionEnv(FunctionObj* funObj, Arguments* args) {
-    Environment* env = newEnclosedEnvironment(funObj->env);
-    for (int i = 0; i < funObj->arity; i++) {
-        char* name = extractLiteral(funObj->parameters[i]->token.position);
-        set(env, name, args->arguments[i]);        
-        free(name);
+// 'function' es un FunctionObj: evalúa los argumentos en su Environment nuevo y el cuerpo.
+static Value applyFunction(CallNode* node, Value function, Environment* env) {
+    if (node->tail) return tailCall(node, function, env);
+    // un closure de la nursery se mueve si la reserva lanza el GC: sus campos se leen antes.
+    FunctionObj* funObj = AS_FUNCTION(function);
+    IdentifierNode** parameters = funObj->parameters;
+    int arity = funObj->arity;
+    int profile = funObj->profile;
+    ArrayStmt* body = funObj->body;
+    pushRoot(&function); // mantiene vivo el closure (y su programa) durante la llamada
+    SET_ALLOCATION_SITE(node->site);
+    Environment* callEnv = newEnclosedEnvironment(funObj->env, funObj->localCount, funObj->locals);
+    bindCaptures(callEnv, AS_FUNCTION(function)); // el closure pudo moverse con la reserva
+    pushEnv(callEnv, profile);
+
+    for (int i = 0; i < node->argc; i++) {
+        Value arg = evalExpression(node->arguments[i], env);
+        if (isAbrupt(arg)) {
+            popEnv();
+            popRoots(1);
+            return arg;
+        }
+        if (i < arity) {
+            SET_SLOT(callEnv, parameters[i]->slot, arg);
+        }
+    }
+    Value evaluated = evalBlockStatements(body, callEnv);
+    while (evaluated == TAIL_CALL_VAL) {
+        // la llamada de cola ocupa el sitio de esta (ver tailCall).
+        function = tailFunction;
+        callEnv = tailEnv;
+        envs[envCount - 1] = callEnv;
+        calls[envCount - 1] = AS_FUNCTION(function)->profile;
+        evaluated = evalBlockStatements(AS_FUNCTION(function)->body, callEnv);
     }
-    return env;
+    popEnv();
+    popRoots(1);
+
+    return unwrapReturnValue(evaluated);
 }
 
-static Object* unwrapReturnValue(Object* evaluated) {
-    if (evaluated->type == RETURN_OBJ) {
-        return ((ReturnObj*)evaluated->value)->value;
+static Value unwrapReturnValue(Value evaluated) {
+    if (valueType(evaluated) == RETURN_OBJ) {
+        return AS_RETURN(evaluated)->value;
     }
     return evaluated;
 }
 
-static bool isTruthy(Object* object) {
-    return (object == FalseObj || object == NilObj) ? false : true;
+bool isTruthy(Value value) {
+    return (value == FALSE_VAL || value == NULL_VAL) ? false : true;
 }
 
-static bool isError(Object* object) {
-    if (object != NULL) {
-        return (object->type == ERROR_OBJ) ? true : false;
+// un error o un return: cortan la expresión que los contiene, igual que en la VM.
+static bool isAbrupt(Value value) {
+    if (IS_OBJ(value)) {
+        ObjectType type = AS_OBJ(value)->type;
+        return (type == ERROR_OBJ || type == RETURN_OBJ) ? true : false;
     }
     return false;
 }
 
-Object* evalIfExpression(IfNode* node, Environment* env) {
-    Object* condition = evalExpression(node->condition, env);
-    if (isError(condition)) {
+Value evalIfExpression(IfNode* node, Environment* env) {
+    Value condition = evalExpression(node->condition, env);
+    if (isAbrupt(condition)) {
         return condition;
     }
     if (isTruthy(condition)) {
@@ -393,122 +1002,320 @@ Object* evalIfExpression(IfNode* node, Environment* env) {
     if (node->alternative != NULL) {
         return evalBlockStatements(node->alternative, env);
     }
-    return NilObj;
+    return NULL_VAL;
 }
 
-Object* evalIdentifier(IdentifierNode* node,Environment* env) {
-    char* literal = extractLiteral(node->token.position);
-    Object* val = get(env, literal);
-    if (val == NULL) {
+Value evalIdentifier(IdentifierNode* node,Environment* env) {
+    Value val;
+    COUNT_SCOPE_HOPS(node->depth);
+    if (node->depth == GLOBAL_DEPTH) {
+        val = globalEnv->slots[node->slot];
+    } else {
+        Environment* scope = env;
+        for (int depth = node->depth; depth > 0; depth--) {
+            scope = scope->outer;
+        }
+        val = scope->slots[node->slot];
+    }
+    if (val == EMPTY_VAL) {
+        // el slot aún no tiene valor: puede estar definido en un scope de fuera.
+        val = get(env, node->symbol);
+    }
+    if (val == EMPTY_VAL) {
         char msg[1024];
-        sprintf_s(msg, strlen(msg), "identifier not found: %s.", literal);
+        sprintf_s(msg, sizeof(msg), "identifier not found: %s.", symbolName(node->symbol));
         return newError(msg);
     }
-    free(literal);
     return val;
 }
 
+/**************************************************************************
+* Nodos especializados
+***************************************************************************/
+/**
+ * La primera evaluación de un identificador, prefix, infix o llamada elige
+ * su variante (ver ast.h). Cada variante tiene su caso en
+ * dispatchExpression() sin volver a mirar el operador, y comprueba con una
+ * guarda barata que sigue viendo lo mismo: los tipos de los operandos o el
+ * cuerpo de la función llamada. Si la guarda falla el nodo pasa a la variante
+ * genérica, que evalúa como el nodo original, y ya no se vuelve a especializar.
+ */
+static NodeType intInfixTypes[T_NOT_EQ + 1] = {
+    [T_PLUS]     = NT_INFIX_ADD_INT,
+    [T_MINUS]    = NT_INFIX_SUB_INT,
+    [T_ASTERISK] = NT_INFIX_MUL_INT,
+    [T_SLASH]    = NT_INFIX_DIV_INT,
+    [T_LT]       = NT_INFIX_LT_INT,
+    [T_GT]       = NT_INFIX_GT_INT,
+    [T_EQ]       = NT_INFIX_EQ_INT,
+    [T_NOT_EQ]   = NT_INFIX_NOT_EQ_INT,
+};
+
+// los identificadores solo dependen de lo que resolvió el resolver.
+static void specializeIdentifier(IdentifierNode* node) {
+    if (node->depth == GLOBAL_DEPTH) node->type = NT_IDENT_GLOBAL;
+    else if (node->depth == 0) node->type = NT_IDENT_LOCAL;
+    else node->type = NT_IDENT_OUTER;
+}
+
+static void specializePrefix(PrefixNode* node, Value right) {
+    if (node->operator == T_MINUS && IS_INT(right)) node->type = NT_PREFIX_MINUS_INT;
+    else if (node->operator == T_BANG && IS_BOOL(right)) node->type = NT_PREFIX_BANG_BOOL;
+    else node->type = NT_PREFIX_GENERIC;
+}
+
+static void specializeInfix(InfixNode* node, Value left, Value right) {
+    if (IS_INT(left) && IS_INT(right)) {
+        node->type = intInfixTypes[node->operator];
+    } else if (node->operator == T_PLUS && valueType(left) == STRING_OBJ && valueType(right) == STRING_OBJ) {
+        node->type = NT_INFIX_ADD_STRING;
+    } else {
+        node->type = NT_INFIX_GENERIC;
+    }
+}
+
+// el infix genérico con el lado izquierdo ya evaluado (y que no es un error ni un return).
+static Value evalInfixRight(InfixNode* node, Value left, Environment* env) {
+    pushRoot(&left); // el lado derecho puede lanzar un GC
+    Value right = evalExpression(node->right, env);
+    popRoots(1);
+    if (isAbrupt(right)) {
+        return right;
+    }
+    if (node->type == NT_INFIX) specializeInfix(node, left, right);
+
+    // evalInfixExpression lee los operandos antes de reservar el resultado.
+    SET_ALLOCATION_SITE(node->site);
+    return evalInfixExpression(node->operator, left, right);
+}
+
 /**************************************************************************
 * Evaluador de expresiones
 ***************************************************************************/
-Object* evalExpression(Expression* exp, Environment* env) {
+/**
+ * Variante de un infix para dos enteros: un entero no es raíz (no hay que
+ * registrarlo) y el resultado no reserva. Si un lado no es entero el nodo pasa
+ * a NT_INFIX_GENERIC y termina de evaluarse como tal.
+ */
+#define INT_INFIX(exp, intResult) \
+    do { \
+        InfixNode* infix_ = (InfixNode*)(exp); \
+        Value left_ = evalExpression(infix_->left, env); \
+        if (!IS_INT(left_)) { \
+            infix_->type = NT_INFIX_GENERIC; \
+            if (isAbrupt(left_)) return left_; \
+            return evalInfixRight(infix_, left_, env); \
+        } \
+        Value right_ = evalExpression(infix_->right, env); \
+        if (!IS_INT(right_)) { \
+            infix_->type = NT_INFIX_GENERIC; \
+            if (isAbrupt(right_)) return right_; \
+            SET_ALLOCATION_SITE(infix_->site); \
+            return evalInfixExpression(infix_->operator, left_, right_); \
+        } \
+        int a = AS_INT(left_); \
+        int b = AS_INT(right_); \
+        return (intResult); \
+    } while (false)
+
+// el switch de evalExpression(); con EVAL_STATS se mide cada evaluación (ver evalstats.h).
+static Value dispatchExpression(Expression* exp, Environment* env) {
     switch (exp->type) {
-    case NT_INTEGER: {
-        char* literal = extractLiteral(((IntegerNode*)exp->node)->token.position);
-        int value = atoi(literal);
-        free(literal);
-        return newInteger(value);
-    }
+    case NT_INTEGER:
+        return ((IntegerNode*)exp)->constant;
     case NT_STRING:
-        char* literal = extractLiteral(((StringNode*)exp->node)->token.position);
-        return newString(literal);
+        return ((StringNode*)exp)->constant;
     case NT_NULL:
-        return NilObj;
+        return NULL_VAL;
     case NT_BOOLEAN:
-        return nativeBoolToBooleanObject(((BooleanNode*)exp->node)->value);        
+        return BOOL_VAL(((BooleanNode*)exp)->value);        
     case NT_PREFIX:
+    case NT_PREFIX_GENERIC:
+        {
+            PrefixNode* prefix = (PrefixNode*)exp;
+            Value right = evalExpression(prefix->right, env);
+            if (isAbrupt(right)) {
+                return right;
+            }
+            if (prefix->type == NT_PREFIX) specializePrefix(prefix, right);
+            SET_ALLOCATION_SITE(prefix->site);
+            return evalPrefixExpression(prefix->operator, right);
+        }
+    case NT_PREFIX_MINUS_INT:
+    case NT_PREFIX_BANG_BOOL:
         {
-            PrefixNode* prefix = (PrefixNode*)exp->node;
-            Object* right = evalExpression(prefix->right, env);
-            if (isError(right)) {
+            PrefixNode* prefix = (PrefixNode*)exp;
+            Value right = evalExpression(prefix->right, env);
+            if (prefix->type == NT_PREFIX_MINUS_INT && IS_INT(right)) return INT_VAL(AS_INT(right) * -1);
+            if (prefix->type == NT_PREFIX_BANG_BOOL && IS_BOOL(right)) return BOOL_VAL(!AS_BOOL(right));
+            prefix->type = NT_PREFIX_GENERIC;
+            if (isAbrupt(right)) {
                 return right;
             }
+            SET_ALLOCATION_SITE(prefix->site);
             return evalPrefixExpression(prefix->operator, right);
         }
     case NT_INFIX:
+    case NT_INFIX_GENERIC:
         {
-            InfixNode* infix = (InfixNode*)exp->node;            
-            Object* left = evalExpression(infix->left, env);
-            if (isError(left)) {
+            InfixNode* infix = (InfixNode*)exp;
+            Value left = evalExpression(infix->left, env);
+            if (isAbrupt(left)) {
                 return left;
             }
-
-            Object* right = evalExpression(infix->right, env);
-            if (isError(right)) {
+            return evalInfixRight(infix, left, env);
+        }
+    case NT_INFIX_ADD_INT: INT_INFIX(exp, INT_VAL(a + b));
+    case NT_INFIX_SUB_INT: INT_INFIX(exp, INT_VAL(a - b));
+    case NT_INFIX_MUL_INT: INT_INFIX(exp, INT_VAL(a * b));
+    case NT_INFIX_DIV_INT: INT_INFIX(exp, evalIntegerInfixExpression(T_SLASH, INT_VAL(a), INT_VAL(b))); // división por cero
+    case NT_INFIX_LT_INT: INT_INFIX(exp, BOOL_VAL(a < b));
+    case NT_INFIX_GT_INT: INT_INFIX(exp, BOOL_VAL(a > b));
+    case NT_INFIX_EQ_INT: INT_INFIX(exp, BOOL_VAL(a == b));
+    case NT_INFIX_NOT_EQ_INT: INT_INFIX(exp, BOOL_VAL(a != b));
+    case NT_INFIX_ADD_STRING:
+        {
+            InfixNode* infix = (InfixNode*)exp;
+            Value left = evalExpression(infix->left, env);
+            if (valueType(left) != STRING_OBJ) {
+                infix->type = NT_INFIX_GENERIC;
+                if (isAbrupt(left)) {
+                    return left;
+                }
+                return evalInfixRight(infix, left, env);
+            }
+            pushRoot(&left);
+            Value right = evalExpression(infix->right, env);
+            popRoots(1);
+            SET_ALLOCATION_SITE(infix->site);
+            if (valueType(right) == STRING_OBJ) {
+                return evalStringInfixExpression(T_PLUS, left, right);
+            }
+            infix->type = NT_INFIX_GENERIC;
+            if (isAbrupt(right)) {
                 return right;
             }
-
             return evalInfixExpression(infix->operator, left, right);
         }
     case NT_IF:
-        return evalIfExpression((IfNode*)exp->node, env);
+        return evalIfExpression((IfNode*)exp, env);
     case NT_FUNCTION:
-        return newFunction((FunctionNode*)exp->node, env);
+        SET_ALLOCATION_SITE(((FunctionNode*)exp)->site);
+        return newFunction((FunctionNode*)exp, env, env->slots);
     case NT_IDENT:
-        return evalIdentifier(((IdentifierNode*)exp->node), env);
+        specializeIdentifier((IdentifierNode*)exp);
+        return evalIdentifier(((IdentifierNode*)exp), env);
+    case NT_IDENT_GLOBAL:
+        {
+            // un slot vacío (todavía sin definir) va por evalIdentifier(), que da el error.
+            Value val = globalEnv->slots[((IdentifierNode*)exp)->slot];
+            if (val == EMPTY_VAL) return evalIdentifier(((IdentifierNode*)exp), env);
+            COUNT_SCOPE_HOPS(GLOBAL_DEPTH);
+            return val;
+        }
+    case NT_IDENT_LOCAL:
+        {
+            Value val = env->slots[((IdentifierNode*)exp)->slot];
+            if (val == EMPTY_VAL) return evalIdentifier(((IdentifierNode*)exp), env);
+            COUNT_SCOPE_HOPS(0);
+            return val;
+        }
+    case NT_IDENT_OUTER:
+        return evalIdentifier(((IdentifierNode*)exp), env);
     case NT_CALL:
-        Object* function = evalExpression(((CallNode*)exp->node)->function, env);
-        if (isError(function)) return function;
-        Arguments* args = evalArguments((CallNode*)exp->node, env);
-        if (isError(args->arguments[0])) return args->arguments[0];
-
-        return applyFunction(function, args);
+    case NT_CALL_GENERIC:
+        return evalCallExpression((CallNode*)exp, env);
+    case NT_CALL_FUNCTION:
+        {
+            CallNode* call = (CallNode*)exp;
+            Value function = evalExpression(call->function, env);
+            if (IS_OBJ(function) && AS_OBJ(function)->type == FUNCTION_OBJ && AS_FUNCTION(function)->body == call->target) {
+                return applyFunction(call, function, env);
+            }
+            call->type = NT_CALL_GENERIC;
+            return evalCall(call, function, env);
+        }
     default:
-        return NilObj;
+        return NULL_VAL;
     }
 }
 
-Object* evalBlockStatements(ArrayStmt* stmts, Environment* env) {
-    Object* result;
+#undef INT_INFIX
+
+Value evalExpression(Expression* exp, Environment* env) {
+    if (exp == NULL) return NULL_VAL; // expresión vacía ('return;'): null, igual que en la VM
+#ifdef EVAL_STATS
+    EvalTimer timer;
+    EVAL_ENTER(timer);
+    Value result = dispatchExpression(exp, env);
+    EVAL_LEAVE(timer, exp);
+    return result;
+#else
+    return dispatchExpression(exp, env);
+#endif
+}
+
+Value evalBlockStatements(ArrayStmt* stmts, Environment* env) {
+    Value result = NULL_VAL; // un bloque vacío vale null
     for (int i = 0; i < stmts->count; i++) {
         result = evalStatements(stmts->statements[i], env);
+        if (result == TAIL_CALL_VAL) {
+            return result;
+        }
 
-        if (result->type == RETURN_OBJ || result->type == ERROR_OBJ) {
+        ObjectType type = valueType(result);
+        if (type == RETURN_OBJ || type == ERROR_OBJ) {
             return result;
         }
     }
     return result;
 }
 
-Object* evalStatements(Statement* stmt, Environment* env) {
+static Value dispatchStatement(Statement* stmt, Environment* env) {
     switch (stmt->type) {
     case NT_LET: {
-        Object* val = evalExpression(((LetStatement*)stmt->node)->value, env);
-        if (isError(val)) return val;
-        char* literal = extractLiteral(((LetStatement*)stmt->node)->name->token.position);
-        Object* res = set(env, literal, val);
-        free(literal);
-        return res;
+        Value val = evalExpression(((LetStatement*)stmt)->value, env);
+        if (isAbrupt(val)) return val;
+        IdentifierNode* name = ((LetStatement*)stmt)->name;
+        if (name->depth == GLOBAL_DEPTH) {
+            SET_SLOT(globalEnv, name->slot, val);
+        } else {
+            SET_SLOT(env, name->slot, val);
+        }
+        return val;
     }    
     case NT_RETURN: {
-        Object* val = evalExpression(((ReturnStatement*)stmt->node)->value, env);
-        if (isError(val)) return val;
+        Value val = evalExpression(((ReturnStatement*)stmt)->value, env);
+        if (isAbrupt(val) || val == TAIL_CALL_VAL) return val;
+        SET_ALLOCATION_SITE(((ReturnStatement*)stmt)->site);
         return newReturn(val);
     }
     case NT_EXPR:
-        return evalExpression(((ExpressionStatement*)stmt->node)->expression, env);
+        return evalExpression(((ExpressionStatement*)stmt)->expression, env);
     default:
-        return NilObj;
+        return NULL_VAL;
     }
 }
 
-Object* evalProgram(ArrayStmt* program, Environment* env) {
-    Object* result = NilObj;
+Value evalStatements(Statement* stmt, Environment* env) {
+#ifdef EVAL_STATS
+    EvalTimer timer;
+    EVAL_ENTER(timer);
+    Value result = dispatchStatement(stmt, env);
+    EVAL_LEAVE(timer, stmt);
+    return result;
+#else
+    return dispatchStatement(stmt, env);
+#endif
+}
+
+Value evalProgram(ArrayStmt* program, Environment* env) {
+    Value result = NULL_VAL;
     for (int i = 0; i < program->count; i++) {
         result = evalStatements(program->statements[i], env);
-        switch (result->type) {
+        switch (valueType(result)) {
             case RETURN_OBJ:
-                return ((ReturnObj*)result->value)->value;
+                return AS_RETURN(result)->value;
             case ERROR_OBJ:
                 return result;
         }
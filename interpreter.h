@@ -1,22 +1,50 @@
 #ifndef cmonk_interpreter_h
 #define cmonk_interpreter_h
 
-#define GC_MAX_OBJECTS 1024 * 1024
+#define GC_MIN_HEAP_SIZE (4 * 1024 * 1024) // umbral inicial (y mínimo) de bytes ocupados en el heap viejo para lanzar el GC
+#define GC_HEAP_GROW_FACTOR 2 // tras un GC el umbral pasa a ser lo que sobrevivió por este factor
+#define GC_NURSERY_SIZE (256 * 1024) // bytes de la generación joven (se vacía en cada recolección menor)
+#define GC_LARGE_OBJECT_SIZE (16 * 1024) // objetos más grandes nacen en el heap viejo
+#define TAIL_CALL_ARGS 8 // argumentos de una llamada de cola que reutiliza su Environment
+#define NURSERY_ALIGN(size) (((size) + 7) & ~(size_t)7)
 
 #include <stdarg.h>
 #include "parser.h"
+#include "resolver.h"
 #include "object.h"
+#include "gcstats.h"
+
+// motores de ejecución: el tree walker (ast) o el compilador a bytecode + VM (vm).
+typedef enum {
+    ENGINE_AST,
+    ENGINE_VM,
+} Engine;
 
 void initEvaluator();
 void freeEvaluator();
+void setEngine(Engine selected);
 void gc();
 
 /*================================================================/
 * PUBLIC INTERPRETER API
 *=================================================================*/
-Object* interpret(const char* source);
-Object* evalProgram(ArrayStmt* program, Environment* env);
-Object* evalStatements(Statement* stmt, Environment* env);
-Object* evalExpression(Expression* exp, Environment* env);
+Value interpret(const char* source);
+Value interpretTokens(const char* source, size_t length, int threads);
+Value evalProgram(ArrayStmt* program, Environment* env);
+Value evalStatements(Statement* stmt, Environment* env);
+Value evalExpression(Expression* exp, Environment* env);
+
+// compartido con la VM: objetos, operadores y marcado del GC.
+Value newError(char* message);
+Value newFunction(FunctionNode* node, Environment* env, const Value* slots);
+Value evalPrefixExpression(TokenType ope, Value right);
+Value evalInfixExpression(TokenType ope, Value left, Value right);
+bool isTruthy(Value value);
+void markValue(Value value);
+void markObject(Object* object);
+void markEnvironment(Environment* env);
+void visitStackRoots(void (*visitValue)(Value*), void (*visitEnv)(Environment*));
+bool heapSnapshot(const char* path);
+int sampleCallStack(int* out, int max);
 
 #endif
\ No newline at end of file
@@ -4,43 +4,94 @@
 * Forwarded declarations.
 *=================================================================*/
 void initLexer(const char* input);
+void initLexerN(const char* input, size_t length);
+void initLexerChunk(const char* input, size_t length);
 char* substr(const char* source, int start, int endPos);
 char* extractLiteral(Position pos);
+const char* sourceAt(int position);
+void sourcePosition(int position, int* line, int* column);
 void readChar();
+static void seek(size_t pos);
 static char peekChar();
 static Token newTokenSymbol(TokenType type);
 static TokenType lookupIdent(Position pos);
-static bool isAlpha(char ch);
 static bool isLetter(char ch);
 static Position readIdentifier();
 static bool isDigit(char ch);
 static Position readNumber();
 static Position readString();
-static bool isSpace(char ch);
 static void skipWhitespace();
 Token nextToken();
 void freeLexer();
 
-Lexer l;
+// un lexer por hilo: tokens.c lexea trozos del fuente en paralelo.
+_Thread_local Lexer l;
+// para calcular líneas sin recorrer el fuente desde el principio cada vez (ver sourcePosition)
+static const char* lineInput;
+static int linePosition;
+static int lineNumber;
+static int lineStart;
+
+/**
+ * Hash perfecto para las palabras reservadas, calculado de antemano:
+ * (primer char + segundo char + longitud) & 15 no colisiona para
+ * fn/let/true/false/null/if/else/return, así que basta una comparación.
+ */
+#define KEYWORD_HASH(word, len) (((unsigned char)(word)[0] + (unsigned char)(word)[1] + (len)) & 15)
+
+typedef struct {
+    const char* word;
+    int length;
+    TokenType type;
+} Keyword;
+
+static const Keyword keywords[16] = {
+    [1]  = {"if",     2, T_IF},
+    [4]  = {"let",    3, T_LET},
+    [5]  = {"else",   4, T_ELSE},
+    [6]  = {"fn",     2, T_FUNCTION},
+    [7]  = {"null",   4, T_NULL},
+    [10] = {"true",   4, T_TRUE},
+    [12] = {"false",  5, T_FALSE},
+    [13] = {"return", 6, T_RETURN},
+};
 
 /*================================================================/
 * Implementation
 *=================================================================*/
 void initLexer(const char* input) {
+    initLexerN(input, strlen(input));
+}
+
+// el buffer no necesita terminar en '\0': el lexer se detiene en 'length'.
+void initLexerN(const char* input, size_t length) {
+    if (length > INT_MAX) {
+        fprintf(stderr, "ERROR: source too large.\n");
+        exit(74);
+    }
     l.position = 0;
     l.readPosition = 0;
     l.ch = 0;
-    l.input = NULL;
     l.input = input;
+    l.length = length;
+    l.intern = true;
+    initScanner();
     readChar(); // prime character.
 }
 
+// igual que initLexerN pero sin tocar la tabla de símbolos (que no es thread-safe):
+// los T_IDENT salen con NO_SYMBOL y quien llama se encarga de internarlos.
+void initLexerChunk(const char* input, size_t length) {
+    initLexerN(input, length);
+    l.intern = false;
+}
+
 char* extractLiteral(Position pos) {
     if (pos.start + pos.end == 0)
         return NULL;
     
     int len = pos.end - pos.start;
-    char* literal = (char*)malloc(len);
+    char* literal = (char*)malloc(len + 1);
     if (literal == NULL) {
         fprintf(stderr, "ERROR: not enough memory.\n");
         exit(74);
@@ -54,6 +105,32 @@ char* extractLiteral(Position pos) {
     return literal; // the caller is responsible for freeing this variable.    
 }
 
+// puntero al fuente que se está lexeando (sin copiar).
+const char* sourceAt(int position) {
+    return l.input + position;
+}
+
+/**
+ * Línea y columna (desde 1) de un byte del fuente. Pensado para el parser,
+ * que pregunta por posiciones crecientes: se avanza desde la anterior.
+ */
+void sourcePosition(int position, int* line, int* column) {
+    if (l.input != lineInput || position < linePosition) {
+        lineInput = l.input;
+        linePosition = 0;
+        lineNumber = 1;
+        lineStart = 0;
+    }
+    for (; linePosition < position; linePosition++) {
+        if (lineInput[linePosition] == '\n') {
+            lineNumber += 1;
+            lineStart = linePosition + 1;
+        }
+    }
+    *line = lineNumber;
+    *column = position - lineStart + 1;
+}
+
 char* substr(const char* source, int start, int endPos) {
     char* result = (char*)malloc(endPos + 1);
     if (result == NULL) {
@@ -70,7 +147,7 @@ char* substr(const char* source, int start, int endPos) {
 }
 
 void readChar() {
-    if (l.readPosition > strlen(l.input)) {
+    if ((size_t)l.readPosition >= l.length) {
         l.ch = '\0';
     } else {
         l.ch = l.input[l.readPosition];
@@ -79,8 +156,15 @@ void readChar() {
     l.readPosition += 1;
 }
 
+// salta directamente a 'pos' (equivale a llamar readChar() hasta llegar allí).
+static void seek(size_t pos) {
+    l.position = (int)pos;
+    l.readPosition = (int)pos + 1;
+    l.ch = (pos < l.length) ? l.input[pos] : '\0';
+}
+
 static char peekChar() {
-    if (l.readPosition >= strlen(l.input)) {
+    if ((size_t)l.readPosition >= l.length) {
         return 0;
     }
     return l.input[l.readPosition];
@@ -89,41 +173,27 @@ static char peekChar() {
 static Token newTokenSymbol(TokenType type) {
     Token t;
     t.type = type;
-    t.position.start = 0;
-    t.position.end = 0;
+    t.position.start = l.position;
+    t.position.end = l.position + 1;
+    t.symbol = NO_SYMBOL;
 
     return t;
 }
 
+// determinar si la palabra es una palabra reservada o identificador.
 static TokenType lookupIdent(Position pos) {
     int len = pos.end - pos.start;
-    
-    // construir la palabra
-    char word[len];
-    int j=0;
-    for (int i=pos.start; i < pos.end; i++) {
-        word[j] = l.input[i];
-        j++;
+    if (len < 2 || len > 6) {
+        return T_IDENT; // ninguna palabra reservada tiene esa longitud.
+    }
+    const char* word = l.input + pos.start;
+    const Keyword* kw = &keywords[KEYWORD_HASH(word, len)];
+    if (kw->length == len && memcmp(kw->word, word, len) == 0) {
+        return kw->type;
     }
-    word[len] = '\0';
-
-    // determinar si word es una palabra reservada o identificador
-    if (strcmp(word, "fn") == 0) return T_FUNCTION;
-    if (strcmp(word, "let") == 0) return T_LET;
-    if (strcmp(word, "true") == 0) return T_TRUE;
-    if (strcmp(word, "false") == 0) return T_FALSE;
-    if (strcmp(word, "null") == 0) return T_NULL;
-    if (strcmp(word, "if") == 0) return T_IF;
-    if (strcmp(word, "else") == 0) return T_ELSE;
-    if (strcmp(word, "return") == 0) return T_RETURN;
-
     return T_IDENT;
 }
 
-static bool isAlpha(char ch) {
-    return isLetter(ch) || isDigit(ch);
-}
-
 static bool isLetter(char ch) {
     return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_';
 }
@@ -131,12 +201,9 @@ static bool isLetter(char ch) {
 static Position readIdentifier() {
     Position pos;
     pos.start = l.position;
-    do {
-        readChar();
-    } while (isAlpha(l.ch));
+    seek(scanner.identifier(l.input, l.position + 1, l.length));
     pos.end = l.position;
 
-    //return substr(l.input, position, l.position - position);
     return pos;
 }
 
@@ -147,39 +214,26 @@ static bool isDigit(char ch) {
 static Position readNumber() {
     Position pos;
     pos.start = l.position;
-    do {
-        readChar();
-    } while (isDigit(l.ch));
-
+    seek(scanner.digits(l.input, l.position + 1, l.length));
     pos.end = l.position;
 
     return pos;
-    // return substr(l.input, position, l.position - position);
 }
 
 static Position readString() {
     Position pos;    
     pos.start = l.position + 1; // pasada la comilla doble
 
-    for (;;) {
-        readChar();
-        if (l.ch == '"' || l.ch == 0) {
-            break;
-        }
-    }
+    // se detiene en la comilla de cierre, en un '\0' o al final del input.
+    seek(scanner.stringBody(l.input, pos.start, l.length));
     pos.end = l.position;
 
     return pos;
-    // return substr(l.input, position, (l.position) - position);
-}
-
-static bool isSpace(char ch) {
-    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
 }
 
 static void skipWhitespace() {
-    while (isSpace(l.ch)) {
-        readChar();
+    if (l.ch == ' ' || l.ch == '\t' || l.ch == '\n' || l.ch == '\r') {
+        seek(scanner.whitespace(l.input, l.position + 1, l.length));
     }
 }
 
@@ -187,13 +241,15 @@ Token nextToken() {
     Token tok;
     tok.position.start = 0;
     tok.position.end = 0;
+    tok.symbol = NO_SYMBOL;
 
     skipWhitespace();
     switch (l.ch) {
     case '=':
         if (peekChar() == '=') {
             readChar();
-            tok.type = T_EQ;
+            tok = newTokenSymbol(T_EQ);
+            tok.position.start -= 1;
         } else {
             tok = newTokenSymbol(T_ASSIGN);
         }
@@ -205,7 +261,8 @@ Token nextToken() {
     case '!':
         if (peekChar() == '=') {
             readChar();
-            tok.type = T_NOT_EQ;            
+            tok = newTokenSymbol(T_NOT_EQ);
+            tok.position.start -= 1;
         } else {
             tok = newTokenSymbol(T_BANG);
         }
@@ -235,12 +292,16 @@ Token nextToken() {
         tok.position = readString();
         break;
     case 0: 
-        tok.type = T_EOF;
+        tok = newTokenSymbol(T_EOF);
+        tok.position.end = tok.position.start;
         break;    
     default:
         if (isLetter(l.ch)) {
             tok.position = readIdentifier();
             tok.type = lookupIdent(tok.position);
+            if (tok.type == T_IDENT && l.intern) {
+                tok.symbol = internSymbol(l.input + tok.position.start, tok.position.end - tok.position.start);
+            }
             return tok;
         } else if (isDigit(l.ch)) {
             tok.type = T_INT;
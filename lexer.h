@@ -2,6 +2,8 @@
 #define cmonk_lexer_h
 
 #include "headers.h"
+#include "symbol.h"
+#include "scan.h"
 
 typedef enum {
     T_ILLEGAL,
@@ -95,21 +97,27 @@ typedef struct {
 typedef struct {
     TokenType type;
     Position position;
-    //void* literal;
+    int symbol; // id en la tabla de símbolos (sólo T_IDENT, si no NO_SYMBOL)
 } Token;
 
 typedef struct {    
     const char* input;
+    size_t length; // input length (input does not need to be NUL-terminated)
     int position; // current position in input (points to current char)
     int readPosition; // current readint position in input (after current char)
     char ch; // current char under examination
+    bool intern; // internar los identificadores en la tabla de símbolos
 } Lexer;
 
 /*================================================================/
 * PUBLIC LEXER API
 *=================================================================*/
 void initLexer(const char* input);
+void initLexerN(const char* input, size_t length);
+void initLexerChunk(const char* input, size_t length);
 char* extractLiteral(Position pos);
+const char* sourceAt(int position);
+void sourcePosition(int position, int* line, int* column);
 Token nextToken();
 
 #endif
\ No newline at end of file
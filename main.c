@@ -1,24 +1,76 @@
+#include <errno.h>
+#include <stdint.h>
 #include "interpreter.h"
+#include "profiler.h"
+#include "evalstats.h"
+#include "vm.h"
 
 static void repl();
 static void test();
-static char* readFile(const char* path);
+static char* readFile(const char* path, size_t* length);
 static void runFile(const char* path);
+static void dumpGcStats(const char* path);
+static bool parseStackLimit(const char* text, size_t* bytes);
 
 int main(int argc, const char* argv[]) {
     initEvaluator();
 
-    if (argc == 1) {
+    const char* path = NULL;
+    const char* statsPath = NULL; // --gc-stats: "" para stderr
+    const char* snapshotPath = NULL; // --heap-snapshot=file: el heap al terminar
+    const char* profilePath = NULL; // --profile: "" solo el resumen; =file además las pilas para flamegraph.pl
+    size_t stackLimit;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine=ast") == 0) {
+            setEngine(ENGINE_AST);
+        } else if (strcmp(argv[i], "--engine=vm") == 0) {
+            setEngine(ENGINE_VM);
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            statsPath = "";
+        } else if (strncmp(argv[i], "--gc-stats=", 11) == 0) {
+            statsPath = argv[i] + 11;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profilePath = "";
+        } else if (strncmp(argv[i], "--profile=", 10) == 0 && argv[i][10] != '\0') {
+            profilePath = argv[i] + 10;
+        } else if (strncmp(argv[i], "--heap-snapshot=", 16) == 0 && argv[i][16] != '\0') {
+            snapshotPath = argv[i] + 16;
+        } else if (strncmp(argv[i], "--stack-limit=", 14) == 0 && parseStackLimit(argv[i] + 14, &stackLimit)) {
+            setStackLimit(stackLimit);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: cmonk [--engine=ast|vm] [--gc-stats[=file]] [--heap-snapshot=file] [--profile[=file]] [--stack-limit=MB] [path]\n");
+            exit(74);
+        }
+    }
+
+    if (profilePath != NULL && !startProfiler()) {
+        fprintf(stderr, "Could not start the profiler.\n");
+        exit(74);
+    }
+    if (path == NULL) {
         // test();
         repl();
-    }
-    else if (argc == 2) {
-        runFile(argv[1]);
     } else {
-        fprintf(stderr, "Usage: cmonk [path]\n");
-        exit(74);
+        runFile(path);
     }
 
+    if (profilePath != NULL) {
+        stopProfiler();
+        if (!writeProfile((profilePath[0] == '\0') ? NULL : profilePath, stderr)) {
+            fprintf(stderr, "Could not open file \"%s\".\n", profilePath);
+            exit(74);
+        }
+    }
+    if (statsPath != NULL) dumpGcStats(statsPath);
+#ifdef EVAL_STATS
+    writeEvalStats(stderr);
+#endif
+    if (snapshotPath != NULL && !heapSnapshot(snapshotPath)) {
+        fprintf(stderr, "Could not open file \"%s\".\n", snapshotPath);
+        exit(74);
+    }
     freeEvaluator();
     return 0;
 }
@@ -48,10 +100,62 @@ static void test() {
     // fprintf(stdout, "\n");
 }
 
-static char* readFile(const char* path) {
-    return NULL;
+static char* readFile(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "ERROR: not enough memory to read \"%s\".\n", path);
+        exit(74);
+    }
+    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+    if (bytesRead < fileSize) {
+        fprintf(stderr, "Could not read file \"%s\".\n", path);
+        exit(74);
+    }
+    buffer[bytesRead] = '\0';
+    *length = bytesRead;
+
+    fclose(file);
+    return buffer;
 }
 
 static void runFile(const char* path) {
-    return;
-}
\ No newline at end of file
+    size_t length;
+    char* source = readFile(path, &length);
+    interpretTokens(source, length, cpuCount());
+    free(source);
+}
+
+// los contadores del GC en JSON al terminar (ver gcstats.c).
+static void dumpGcStats(const char* path) {
+    if (path[0] == '\0') {
+        writeGcStatsJSON(stderr);
+        return;
+    }
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        exit(74);
+    }
+    writeGcStatsJSON(file);
+    fclose(file);
+}
+
+// --stack-limit=MB: un número de MB mayor que 0 cuyos bytes quepan en un size_t.
+static bool parseStackLimit(const char* text, size_t* bytes) {
+    if (*text < '0' || *text > '9') return false; // strtoull aceptaría espacios y el signo
+    char* end;
+    errno = 0;
+    unsigned long long mb = strtoull(text, &end, 10);
+    if (errno != 0 || *end != '\0' || mb == 0 || mb > SIZE_MAX / (1024 * 1024)) return false;
+    *bytes = (size_t)mb * 1024 * 1024;
+    return true;
+}
@@ -0,0 +1,302 @@
+#include <sched.h>
+#include "marker.h"
+#include "heap.h"
+#include "tokens.h"
+
+/**
+ * El bit de marca se pone con un intercambio atómico: si dos marcadores llegan
+ * al mismo objeto solo uno lo apila. Sin los atómicos de GCC se marca en un solo hilo.
+ */
+#if defined(__GNUC__)
+#define TRY_MARK(object) (!__atomic_exchange_n(&(object)->marked, true, __ATOMIC_RELAXED))
+#define ATOMIC_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define ATOMIC_ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_ACQ_REL)
+#else
+#define MARK_SINGLE_THREAD
+#define TRY_MARK(object) ((object)->marked ? false : ((object)->marked = true))
+#define ATOMIC_LOAD(var) (var)
+#define ATOMIC_ADD(var, n) ((var) += (n))
+#endif
+
+static Marker markers[MARK_MAX_THREADS];
+static int markerCount = 1; // marcadores del marcado en curso
+static int requestedThreads = 0; // 0: uno por CPU (hasta MARK_MAX_THREADS)
+
+// hilos auxiliares: esperan entre un GC y otro a que empiece el siguiente marcado.
+static pthread_t helpers[MARK_MAX_THREADS];
+static int helperCount;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+static bool poolStarted;
+static int cycle; // número del marcado en curso
+static int baseCycle; // 'cycle' cuando se arrancaron los auxiliares
+static int finished; // auxiliares que ya terminaron este marcado
+static bool shutdownPool;
+static int offered; // marcadores que se ofrecieron a terminar
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void pushLocal(Marker* marker, Object* object);
+static void pushValue(Marker* marker, Value value);
+static void pushEnvironment(Marker* marker, Environment* env);
+static void scanObject(Marker* marker, Object* object);
+static void publish(Marker* marker, int count);
+static bool take(Marker* thief, Marker* victim);
+static bool refill(int index);
+static bool anyShared();
+static bool offerTermination();
+static void drain(int index, bool parallel);
+static void* helperMain(void* arg);
+static void startHelpers();
+void setMarkerThreads(int threads);
+void markerPush(Object* object);
+void markerDrain(bool parallel, int* liveObjects, size_t* liveBytes);
+void freeMarkers();
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void pushLocal(Marker* marker, Object* object) {
+    if (marker->localCapacity < (marker->localCount + 1)) {
+        marker->localCapacity = (marker->localCapacity == 0) ? 4 * MARK_CHUNK : marker->localCapacity * 2;
+        marker->local = realloc(marker->local, sizeof(Object*) * marker->localCapacity);
+        if (marker->local == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    marker->local[marker->localCount++] = object;
+}
+
+static void pushValue(Marker* marker, Value value) {
+    if (IS_OBJ(value) && TRY_MARK(AS_OBJ(value))) pushLocal(marker, AS_OBJ(value));
+}
+
+static void pushEnvironment(Marker* marker, Environment* env) {
+    if (env != NULL && TRY_MARK(ENV_OBJECT(env))) pushLocal(marker, ENV_OBJECT(env));
+}
+
+// visita los hijos de un objeto gris. Los objetos no cambian mientras dura el marcado.
+static void scanObject(Marker* marker, Object* object) {
+    marker->liveObjects += 1;
+    marker->liveBytes += heapSlotSize(objectSize(object));
+    switch (object->type) {
+    case FUNCTION_OBJ: {
+        FunctionObj* func = (FunctionObj*)OBJ_PAYLOAD(object);
+        for (int i = 0; i < func->captureCount; i++) {
+            pushValue(marker, func->captures[i]);
+        }
+        pushEnvironment(marker, func->env);
+        break;
+    }
+    case RETURN_OBJ:
+        pushValue(marker, ((ReturnObj*)OBJ_PAYLOAD(object))->value);
+        break;
+    case ENVIRONMENT_OBJ: {
+        Environment* env = (Environment*)OBJ_PAYLOAD(object);
+        for (int i = 0; i < env->count; i++) {
+            pushValue(marker, env->slots[i]);
+        }
+        pushEnvironment(marker, env->outer);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// pasa los 'count' objetos más antiguos de la pila privada (los de más arriba del grafo) a la cola compartida.
+static void publish(Marker* marker, int count) {
+    pthread_mutex_lock(&marker->lock);
+    while (marker->sharedCapacity < (marker->sharedCount + count)) {
+        marker->sharedCapacity = (marker->sharedCapacity == 0) ? 4 * MARK_CHUNK : marker->sharedCapacity * 2;
+        marker->shared = realloc(marker->shared, sizeof(Object*) * marker->sharedCapacity);
+        if (marker->shared == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    memcpy(marker->shared + marker->sharedCount, marker->local, sizeof(Object*) * count);
+    ATOMIC_ADD(marker->sharedCount, count);
+    pthread_mutex_unlock(&marker->lock);
+
+    marker->localCount -= count;
+    memmove(marker->local, marker->local + count, sizeof(Object*) * marker->localCount);
+}
+
+// mueve hasta MARK_CHUNK objetos de la cola compartida de 'victim' a la pila de 'thief'.
+static bool take(Marker* thief, Marker* victim) {
+    if (ATOMIC_LOAD(victim->sharedCount) == 0) return false;
+    pthread_mutex_lock(&victim->lock);
+    int count = (victim->sharedCount < MARK_CHUNK) ? victim->sharedCount : MARK_CHUNK;
+    ATOMIC_ADD(victim->sharedCount, -count);
+    for (int i = 0; i < count; i++) {
+        pushLocal(thief, victim->shared[victim->sharedCount + i]);
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    return count > 0;
+}
+
+// primero la cola propia y después la de los demás.
+static bool refill(int index) {
+    Marker* marker = &markers[index];
+    for (int i = 0; i < markerCount; i++) {
+        if (take(marker, &markers[(index + i) % markerCount])) return true;
+    }
+    return false;
+}
+
+static bool anyShared() {
+    for (int i = 0; i < markerCount; i++) {
+        if (ATOMIC_LOAD(markers[i].sharedCount) > 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Un marcador sin trabajo se ofrece a terminar. Solo el dueño publica en su
+ * cola y solo se ofrece con ella vacía, así que cuando todos se han ofrecido
+ * no queda trabajo en ninguna parte. Si aparece trabajo retira la oferta.
+ */
+static bool offerTermination() {
+    ATOMIC_ADD(offered, 1);
+    for (;;) {
+        if (ATOMIC_LOAD(offered) == markerCount) return true;
+        if (anyShared()) {
+            ATOMIC_ADD(offered, -1);
+            return false;
+        }
+        sched_yield();
+    }
+}
+
+static void drain(int index, bool parallel) {
+    Marker* marker = &markers[index];
+    for (;;) {
+        while (marker->localCount > 0) {
+            Object* object = marker->local[--marker->localCount];
+            scanObject(marker, object);
+            // se reparte en cuanto la cola propia se queda vacía: recorriendo en profundidad la
+            // pila no crece mucho y los demás marcadores estarían esperando.
+            if (parallel && marker->localCount >= MARK_PUBLISH_MIN && ATOMIC_LOAD(marker->sharedCount) == 0) {
+                int count = marker->localCount / 2;
+                publish(marker, (count < MARK_CHUNK) ? count : MARK_CHUNK);
+            }
+        }
+        if (!parallel) return;
+        if (refill(index)) continue;
+        if (offerTermination()) return;
+    }
+}
+
+static void* helperMain(void* arg) {
+    int index = (int)(intptr_t)arg;
+    pthread_mutex_lock(&poolLock);
+    int seen = baseCycle;
+    for (;;) {
+        while (cycle == seen && !shutdownPool) {
+            pthread_cond_wait(&poolStart, &poolLock);
+        }
+        if (shutdownPool) break;
+        seen = cycle;
+        pthread_mutex_unlock(&poolLock);
+
+        drain(index, true);
+
+        pthread_mutex_lock(&poolLock);
+        finished += 1;
+        pthread_cond_signal(&poolDone);
+    }
+    pthread_mutex_unlock(&poolLock);
+    return NULL;
+}
+
+static void startHelpers() {
+    static bool locksReady = false;
+    if (!locksReady) {
+        for (int i = 0; i < MARK_MAX_THREADS; i++) {
+            pthread_mutex_init(&markers[i].lock, NULL);
+        }
+        locksReady = true;
+    }
+#ifndef MARK_SINGLE_THREAD
+    int threads = (requestedThreads > 0) ? requestedThreads : cpuCount();
+    if (threads > MARK_MAX_THREADS) threads = MARK_MAX_THREADS;
+    pthread_mutex_lock(&poolLock);
+    baseCycle = cycle;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&helpers[helperCount], NULL, helperMain, (void*)(intptr_t)i) != 0) break;
+        helperCount += 1;
+    }
+    pthread_mutex_unlock(&poolLock);
+#endif
+    poolStarted = true;
+}
+
+// número de hilos de marcado (1: sin paralelismo, 0: uno por CPU). Se aplica en el siguiente GC.
+void setMarkerThreads(int threads) {
+    freeMarkers();
+    requestedThreads = (threads < 0) ? 0 : threads;
+}
+
+// una raíz: se marca y queda gris en la pila del marcador 0.
+void markerPush(Object* object) {
+    if (TRY_MARK(object)) pushLocal(&markers[0], object);
+}
+
+/**
+ * Recorre todo lo alcanzable desde las raíces apiladas con markerPush. Devuelve
+ * cuántos objetos quedaron marcados y cuántos bytes ocupan en el heap viejo.
+ */
+void markerDrain(bool parallel, int* liveObjects, size_t* liveBytes) {
+    if (!poolStarted) startHelpers();
+    for (int i = 0; i < MARK_MAX_THREADS; i++) {
+        markers[i].liveObjects = 0;
+        markers[i].liveBytes = 0;
+    }
+
+    if (parallel && helperCount > 0) {
+        pthread_mutex_lock(&poolLock);
+        markerCount = helperCount + 1;
+        offered = 0;
+        finished = 0;
+        cycle += 1;
+        pthread_cond_broadcast(&poolStart);
+        pthread_mutex_unlock(&poolLock);
+
+        drain(0, true);
+
+        pthread_mutex_lock(&poolLock);
+        while (finished < helperCount) {
+            pthread_cond_wait(&poolDone, &poolLock);
+        }
+        pthread_mutex_unlock(&poolLock);
+    } else {
+        markerCount = 1;
+        drain(0, false);
+    }
+
+    *liveObjects = 0;
+    *liveBytes = 0;
+    for (int i = 0; i < markerCount; i++) {
+        *liveObjects += markers[i].liveObjects;
+        *liveBytes += markers[i].liveBytes;
+    }
+}
+
+// para los hilos auxiliares (se vuelven a crear en el siguiente marcado).
+void freeMarkers() {
+    pthread_mutex_lock(&poolLock);
+    shutdownPool = true;
+    pthread_cond_broadcast(&poolStart);
+    pthread_mutex_unlock(&poolLock);
+    for (int i = 0; i < helperCount; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+    helperCount = 0;
+    shutdownPool = false;
+    poolStarted = false;
+}
@@ -0,0 +1,40 @@
+#ifndef cmonk_marker_h
+#define cmonk_marker_h
+
+#include <pthread.h>
+#include "object.h"
+
+#define MARK_MAX_THREADS 8
+#define MARK_CHUNK 256 // máximo de objetos que se pasan de golpe de un marcador a otro
+#define MARK_PUBLISH_MIN 8 // objetos en la pila privada para empezar a repartir
+#define MARK_PARALLEL_MIN (1024 * 1024) // bytes ocupados en el heap viejo para marcar en paralelo
+
+/**
+ * Fase de marcado del GC mayor, sin recursión en C: cada objeto gris (marcado
+ * pero con los hijos sin visitar) va a una pila explícita.
+ * En paralelo hay un marcador por hilo (el que lanza el GC es el 0). Cada uno
+ * trabaja sobre su pila privada y, cuando tiene de sobra, pasa un trozo a su cola
+ * compartida, de donde los marcadores sin trabajo roban. El marcado termina
+ * cuando todos se ofrecen a terminar a la vez (con todas las colas vacías).
+ */
+typedef struct {
+    Object** local; // pila privada
+    int localCount;
+    int localCapacity;
+    pthread_mutex_t lock; // protege 'shared'
+    Object** shared; // trabajo que otros marcadores pueden robar
+    int sharedCount;
+    int sharedCapacity;
+    int liveObjects; // objetos recorridos en este marcado
+    size_t liveBytes; // y los bytes que ocupan en el heap viejo
+} Marker;
+
+/*================================================================/
+* PUBLIC MARKER API
+*=================================================================*/
+void setMarkerThreads(int threads);
+void markerPush(Object* object);
+void markerDrain(bool parallel, int* liveObjects, size_t* liveBytes);
+void freeMarkers();
+
+#endif
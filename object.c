@@ -1,115 +1,176 @@
 #include "object.h"
+#include "evalstats.h"
 
-void freeObject(Object* obj) {
-    if (obj->type == STRING_OBJ)
-        free(((StringObj*)obj->value)->value);
+// bytes de la reserva de un objeto: cabecera más el objeto envuelto.
+size_t objectSize(Object* obj) {
+    switch (obj->type) {
+    case STRING_OBJ:
+        return sizeof(Object) + sizeof(StringObj) + ((StringObj*)OBJ_PAYLOAD(obj))->length + 1;
+    case ERROR_OBJ:
+        return sizeof(Object) + sizeof(ErrorObj) + ((ErrorObj*)OBJ_PAYLOAD(obj))->length + 1;
+    case RETURN_OBJ:
+        return sizeof(Object) + sizeof(ReturnObj);
+    case FUNCTION_OBJ:
+        return sizeof(Object) + sizeof(FunctionObj) + sizeof(Value) * ((FunctionObj*)OBJ_PAYLOAD(obj))->captureCount;
+    case BUILTIN_OBJ:
+        return sizeof(Object) + sizeof(BuiltinObj);
+    case ENVIRONMENT_OBJ: {
+        Environment* env = (Environment*)OBJ_PAYLOAD(obj);
+        // el global guarda sus slots aparte (crecen con reserveGlobals)
+        return sizeof(Object) + sizeof(Environment) + ((env->slots == (Value*)(env + 1)) ? sizeof(Value) * env->count : 0);
+    }
+    default:
+        return sizeof(Object);
+    }
+}
 
-    free(obj->value);
-    free(obj);
+// lo que hay que soltar cuando un objeto muere (la memoria la recupera el GC).
+void finalizeObject(Object* obj) {
+    if (obj->type == FUNCTION_OBJ)
+        releaseProgram(((FunctionObj*)OBJ_PAYLOAD(obj))->program);
+    if (obj->type == ENVIRONMENT_OBJ) {
+        Environment* env = (Environment*)OBJ_PAYLOAD(obj);
+        if (env->slots != (Value*)(env + 1)) free(env->slots); // los del global
+    }
 }
 
-// para imprimir los objetos
-char* inspect(Object* obj) {
-    char* out = (char*)malloc(sizeof(char) * 1024);
+// tipo de un valor: los inmediatos se reconocen por su etiqueta.
+ObjectType valueType(Value value) {
+    if (IS_INT(value)) return INTEGER_OBJ;
+    if (IS_BOOL(value)) return BOOLEAN_OBJ;
+    if (IS_NULL(value)) return NULL_OBJ;
+    return AS_OBJ(value)->type;
+}
+
+// nombre de cada tipo para las estadísticas del GC y los snapshots del heap.
+const char* objectTypeName(ObjectType type) {
+    static const char* names[OBJECT_TYPES] = {
+        "integer",
+        "string",
+        "boolean",
+        "null",
+        "return",
+        "error",
+        "function",
+        "builtin",
+        "environment",
+    };
+    return names[type];
+}
+
+// para imprimir los valores
+char* inspect(Value value) {
+    // un string puede ser más largo que el buffer (p.ej. el JSON de gcStats()).
+    size_t size = (valueType(value) == STRING_OBJ && AS_STRING(value)->length >= 1024) ? AS_STRING(value)->length + 1 : 1024;
+    char* out = (char*)malloc(sizeof(char) * size);
     if (out == NULL) {
         fprintf(stderr, "ERROR: not enough memory.\n");
         exit(74);
     }
-    switch (obj->type) {
+    out[0] = '\0';
+    switch (valueType(value)) {
     case INTEGER_OBJ:
-        sprintf_s(out, 1024, "%i", ((IntegerObj*)obj->value)->value);
+        sprintf_s(out, 1024, "%i", AS_INT(value));
         break;
     case STRING_OBJ: 
-        sprintf_s(out, 1024, "%s", ((StringObj*)obj->value)->value);
+        sprintf_s(out, size, "%s", AS_STRING(value)->value);
         break;
     case BOOLEAN_OBJ:
-        sprintf_s(out, 1024, "%s", (((BooleanObj*)obj->value)->value == true) ? "true" : "false");
+        sprintf_s(out, 1024, "%s", AS_BOOL(value) ? "true" : "false");
         break;
     case NULL_OBJ:
         sprintf_s(out, 1024, "%s", "null");
         break;
     case RETURN_OBJ:
         {
-            ReturnObj* retObj = ((ReturnObj*)obj->value);
-            if (retObj->value != NULL) {
-                sprintf_s(out, 1024, "%s", inspect(((ReturnObj*)obj->value)->value));
-            }
+            char* inner = inspect(AS_RETURN(value)->value);
+            sprintf_s(out, 1024, "%s", inner);
+            free(inner);
             break;
         }
     case ERROR_OBJ:
-        sprintf_s(out, 1024, "RUNTIME ERROR: %s", ((ErrorObj*)obj->value)->message);
+        sprintf_s(out, 1024, "RUNTIME ERROR: %s", AS_ERROR(value)->message);
+        break;
+    case FUNCTION_OBJ:
+        sprintf_s(out, 1024, "fn(%d)", AS_FUNCTION(value)->arity);
+        break;
+    case BUILTIN_OBJ:
+        sprintf_s(out, 1024, "builtin %s", AS_BUILTIN(value)->name);
+        break;
+    default:
         break;
     }
     return out;
 }
 
 // environment
-// función hash original del libro K&R
-unsigned hash(char *s){
-    unsigned hashval;
-    for (hashval = 0; *s != '\0'; s++)
-        hashval = *s + 31 * hashval;
-    return hashval % HASHSIZE;
-}
-
-static HashTable* newHashTable() {
-    HashTable* ht = createObject(HashTable);
-    ht->capacity = 0;
-    ht->count = 0;
-    ht->items = NULL;
-
-    return ht;
-}
-
-static void setKey(HashTable* ht, char* key, Object* obj) {
-    if (ht->capacity < (ht->count + 1)) {
-        ht->capacity = (ht->capacity == 0) ? 8 : ht->capacity * 2; // factor de 2
-        ht->items = realloc(ht->items, sizeof(Package) * ht->capacity);
-    }
-    // crear el paquete
-    Package* pkg = createObject(Package);
-    pkg->hashCode = hash(key);
-    pkg->value = obj;
-
-    // guardamos el paquete
-    ht->items[ht->count] = pkg;
-    ht->count += 1;
-}
-
-Object* getValue(HashTable* ht, char* key) {
-    unsigned hashCode = hash(key);
-    for (int i = 0; i < ht->count; i++) {
-        if (((Package*)ht->items[i])->hashCode == hashCode) {
-            return ht->items[i]->value;
-        }
-    }
-    return NULL;
-}
-
+// el environment global: crece con reserveGlobals() a medida que aparecen símbolos.
 Environment* newEnvironment() {
-    Environment* env = createObject(Environment);
-    env->store = newHashTable();
+    Environment* env = (Environment*)OBJ_PAYLOAD(newTenuredObject(ENVIRONMENT_OBJ, sizeof(Object) + sizeof(Environment)));
+    env->count = 0;
+    env->slots = NULL;
+    env->symbols = NULL;
     env->outer = NULL;
+    env->remembered = false;
 
     return env;
 }
 
-Environment* newEnclosedEnvironment(Environment* outer) {
-    Environment* env = newEnvironment();
+/**
+ * El environment de una llamada: el struct y sus slots en un solo objeto.
+ * Puede lanzar el GC, así que 'outer' tiene que ser alcanzable desde las raíces
+ * (normalmente a través del closure que se está llamando).
+ */
+Environment* newEnclosedEnvironment(Environment* outer, int count, const int* symbols) {
+    Object* object = newTenuredObject(ENVIRONMENT_OBJ, sizeof(Object) + sizeof(Environment) + sizeof(Value) * count);
+    Environment* env = (Environment*)OBJ_PAYLOAD(object);
+    env->count = count;
+    env->slots = (Value*)(env + 1);
+    env->symbols = symbols;
     env->outer = outer;
+    env->remembered = true; // joven: la recolección menor lo encuentra desde las raíces
+    memset(env->slots, 0, sizeof(Value) * count); // todos EMPTY_VAL
+
     return env;
 }
 
-Object* get(Environment* env, char* name) {
-    Object* obj = getValue(env->store, name);
-    if (obj == NULL && env->outer != NULL) {        
-        return get(env->outer, name);
+// garantiza un slot global para cada uno de los primeros 'count' símbolos.
+void reserveGlobals(Environment* env, int count) {
+    if (env->count >= count) return;
+    int capacity = (env->count == 0) ? 64 : env->count;
+    while (capacity < count) capacity *= 2;
+    env->slots = realloc(env->slots, sizeof(Value) * capacity);
+    if (env->slots == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
     }
-    return obj;
+    memset(env->slots + env->count, 0, sizeof(Value) * (capacity - env->count));
+    env->count = capacity;
 }
 
-Object* set(Environment* env, char* name, Object* value) {
-    setKey(env->store, name, value);
-    return value;
+/**
+ * Búsqueda por nombre, para cuando el slot que eligió el resolver está vacío
+ * (p.ej. un 'let' que todavía no se ejecutó): recorre la cadena de scopes como
+ * lo haría una tabla de nombres y devuelve la primera definición que encuentre.
+ */
+Value get(Environment* env, int symbol) {
+    int hops = 0;
+    for (; env != NULL; env = env->outer, hops++) {
+        if (env->symbols == NULL) {
+            if (symbol < env->count && env->slots[symbol] != EMPTY_VAL) {
+                COUNT_GET_HOPS(hops);
+                return env->slots[symbol];
+            }
+            continue;
+        }
+        for (int i = 0; i < env->count; i++) {
+            if (env->symbols[i] == symbol && env->slots[i] != EMPTY_VAL) {
+                COUNT_GET_HOPS(hops);
+                return env->slots[i];
+            }
+        }
+    }
+    COUNT_GET_HOPS(hops);
+    return EMPTY_VAL;
 }
-// environment
\ No newline at end of file
+// environment
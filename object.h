@@ -1,17 +1,17 @@
 #ifndef cmonk_object_h
 #define cmonk_object_h
 
-// hash
-#define HASHSIZE 101
-// hash
-
 #include "headers.h"
 #include "ast.h"
 
 /**
  * Funcionamiento del sistema de objetos.
- * Cada objeto del programa será envuelto en un wrapper tipo Object cuyo campo 'value'
- * contiene el objeto real.
+ * Los valores del programa son Value (ver value.h): enteros, booleanos y null
+ * van dentro de la propia palabra. El resto es una cabecera Object seguida, en
+ * la misma reserva, del objeto real (ver OBJ_PAYLOAD).
+ * INTEGER_OBJ, BOOLEAN_OBJ y NULL_OBJ solo se usan como tipo de un Value
+ * (ver valueType), nunca como tipo de un Object. ENVIRONMENT_OBJ es al revés:
+ * los Environment viven en el heap del GC pero nunca son un Value.
  */
 
 typedef enum {
@@ -22,81 +22,122 @@ typedef enum {
     RETURN_OBJ,
     ERROR_OBJ,
     FUNCTION_OBJ,
+    BUILTIN_OBJ,
+    ENVIRONMENT_OBJ,
 } ObjectType;
 
-typedef struct {
-    int value;
-} IntegerObj;
+#define OBJECT_TYPES (ENVIRONMENT_OBJ + 1)
 
+// los caracteres van dentro del propio objeto.
 typedef struct {
-    char* value;
+    int length;
+    char value[];
 } StringObj;
 
 typedef struct {
-    bool value;
-} BooleanObj;
-
-typedef struct {
-    char dummy;
-} NullObj;
-
-typedef struct {
-    void* value;
+    Value value;
 } ReturnObj;
 
 typedef struct {
-    char message[1024];    
+    int length;
+    char message[];
 } ErrorObj;
 
+/**
+ * Los Object nacen en la nursery del GC (interpreter.c), un bloque donde se
+ * reservan avanzando un puntero. Los que sobreviven a una recolección menor se
+ * copian al heap viejo (heap.c). En la nursery 'next' vale NULL hasta que el
+ * objeto se copia; después apunta a la copia. En el heap viejo solo lo usan
+ * los huecos libres.
+ */
 typedef struct sObject {
-    bool marked; // para el GC
-    struct sObject* next; // el siguiente objeto
     ObjectType type;
-    void* value;
+    bool marked; // para el GC
+    bool free; // hueco libre del heap viejo
+    struct sObject* next;
+#ifdef HEAP_PROFILE
+    int site; // sitio de reserva (ver heapprof.h)
+#endif
 } Object;
 
-// environment
-// Package
-typedef struct {
-    unsigned hashCode;
-    Object* value;
-} Package;
-
-// HashTable
-typedef struct {
-    int count;
-    int capacity;
-    Package** items;
-} HashTable;
+#define OBJ_PAYLOAD(object) ((void*)((Object*)(object) + 1))
+#define AS_STRING(value)   ((StringObj*)OBJ_PAYLOAD(AS_OBJ(value)))
+#define AS_RETURN(value)   ((ReturnObj*)OBJ_PAYLOAD(AS_OBJ(value)))
+#define AS_ERROR(value)    ((ErrorObj*)OBJ_PAYLOAD(AS_OBJ(value)))
+#define AS_FUNCTION(value) ((FunctionObj*)OBJ_PAYLOAD(AS_OBJ(value)))
+#define AS_BUILTIN(value)  ((BuiltinObj*)OBJ_PAYLOAD(AS_OBJ(value)))
+#define ENV_OBJECT(env)    ((Object*)(env) - 1)
 
+// environment
+/**
+ * Environment: un array de slots por scope. El resolver (resolver.c) ya dejó
+ * en cada identificador a qué scope y a qué slot se refiere, así que leer una
+ * variable es indexar un array. Un slot en EMPTY_VAL es una variable que todavía
+ * no se definió. En el global el slot de un nombre es su id de símbolo.
+ * Es un objeto del GC (ENVIRONMENT_OBJ) que nace directamente en el heap viejo:
+ * el evaluador pasa punteros a Environment por la pila de C y no se pueden mover.
+ */
 typedef struct _Environment {
-    HashTable* store;
+    int count; // número de slots
+    Value* slots;
+    const int* symbols; // símbolo de cada slot (NULL en el global: slot == símbolo)
     struct _Environment* outer;
+    bool remembered; // joven o ya en el remembered set: la barrera no hace falta
 } Environment;
+
+/**
+ * Barrera de escritura: toda escritura en un slot de un Environment pasa por
+ * aquí. Si el Environment es viejo y el valor es un objeto de la nursery se
+ * apunta en el remembered set, que la recolección menor usa como raíz.
+ */
+#define SET_SLOT(env, slot, value) \
+    do { \
+        Environment* env_ = (env); \
+        Value value_ = (value); \
+        env_->slots[(slot)] = value_; \
+        if (!env_->remembered && IS_OBJ(value_)) writeBarrier(env_, value_); \
+    } while (false)
 // environment
 
 typedef struct {
-    IdentifierNode* parameters[255];
+    IdentifierNode** parameters; // los del FunctionNode (la arena sigue viva)
     ArrayStmt* body;
     int arity;
+    int localCount; // slots del environment de cada llamada
+    int profile; // id de la función en el profiler (ver profiler.h)
+    bool closures; // el cuerpo crea funciones: sus Environment pueden quedar capturados
+    const int* locals; // símbolo de cada slot
     Environment* env;
+    Program* program; // retenido mientras viva el closure
+    struct sCompiledFunction* compiled; // código de la VM (NULL en el tree walker)
+    int captureCount;
+    Value captures[]; // variables copiadas: van a los últimos slots de cada llamada (ver resolver.h)
 } FunctionObj;
 
-// Array de argumentos evaluados.
+// función de C que el programa ve como una variable global (ver initEvaluator).
+typedef Value (*BuiltinFn)(int argc, Value* args);
+
 typedef struct {
-    Object* arguments[255];
-} Arguments;
+    const char* name;
+    BuiltinFn function;
+} BuiltinObj;
 
 /*================================================================/
 * PUBLIC OBJECT API
 *=================================================================*/
-void freeObject(Object* obj);
-char* inspect(Object* obj);
+Object* newObject(ObjectType type, size_t size);
+Object* newTenuredObject(ObjectType type, size_t size);
+void writeBarrier(Environment* env, Value value);
+size_t objectSize(Object* obj);
+void finalizeObject(Object* obj);
+ObjectType valueType(Value value);
+const char* objectTypeName(ObjectType type);
+char* inspect(Value value);
 
 // environment API
 Environment* newEnvironment();
-Environment* newEnclosedEnvironment(Environment* outer);
-Object* get(Environment* env, char* name);
-Object* set(Environment* env, char* name, Object* value);
+Environment* newEnclosedEnvironment(Environment* outer, int count, const int* symbols);
+void reserveGlobals(Environment* env, int count);
+Value get(Environment* env, int symbol);
 // environment
 #endif
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "parser.h"
+#include "heapprof.h"
+#include "profiler.h"
+#include "evalstats.h"
 
 /*================================================================/
 * Forwarded declarations.
@@ -7,8 +10,7 @@ static void advance();
 static bool curTokenIs(TokenType t);
 static bool match(TokenType t);
 static ArrayStmt* newArray();
-static Expression* newExpression(NodeType type, void* node);
-static Statement* newStatement(NodeType type, void* node);
+static void* newNode(NodeType type, size_t size);
 Expression* parseIdentifier();
 Expression* parseIntegerLiteral();
 Expression* parseBooleanLiteral();
@@ -30,9 +32,14 @@ static Statement* parseStatement();
 static Expression* parseFunctionLiteral();
 static Expression* parseCallExpression(Expression* function);
 void appendStatement(ArrayStmt* array, Statement* stmt);
-ArrayStmt* parseProgram();
+Program* parseProgram();
+Program* parseTokens(TokenBuffer* tokens);
+static Object* addConstant(ObjectType type, size_t size);
+static Program* parse();
 
 Parser p;
+static Program* program; // programa que se está parseando
+static Arena* arena; // arena de 'program': todos los nodos salen de aquí
 // array de tokens->funciones
 static void* prefixParseFns[] = {
     NULL, // T_ILLEGAL
@@ -138,7 +145,7 @@ static void advance() {
 	// 	free(p.curToken.literal);
 
 	p.curToken = p.peekToken;
-	p.peekToken = nextToken();
+	p.peekToken = (p.tokens != NULL) ? tokenAt(p.tokens, p.cursor++) : nextToken();
 }
 
 static bool curTokenIs(TokenType t) {
@@ -154,7 +161,7 @@ static bool match(TokenType t) {
 }
 
 static ArrayStmt* newArray() {
-	ArrayStmt* array = createObject(ArrayStmt);
+	ArrayStmt* array = createNode(arena, ArrayStmt);
 
 	// Inicializar los campos del array.
 	clearArrayStmt(array);
@@ -162,61 +169,86 @@ static ArrayStmt* newArray() {
 	return array;
 }
 
-static Expression* newExpression(NodeType type, void* node) {
-	Expression* exp = createObject(Expression);	
+// reserva un nodo en la arena con su tipo ya puesto en la cabecera.
+static void* newNode(NodeType type, size_t size) {
+	Node* node = (Node*)arenaAlloc(arena, size);
+	node->type = type;
 
-	exp->type = type;
-	exp->node = node;
-
-	return exp;
-}
-
-static Statement* newStatement(NodeType type, void* node) {
-	Statement* stmt = createObject(Statement);
-	stmt->type = type;
-	stmt->node = node;
-
-	return stmt;
+	return node;
 }
 
 Expression* parseIdentifier() {
-	IdentifierNode* node = createObject(IdentifierNode);
+	IdentifierNode* node = newNode(NT_IDENT, sizeof(IdentifierNode));
 	node->token = p.curToken;
-	// node->value = strdup(p.curToken.literal);
+	node->symbol = p.curToken.symbol;
+	node->depth = GLOBAL_DEPTH; // hasta que lo resuelva el resolver
+	node->slot = p.curToken.symbol;
 
 	advance(); // advance T_IDENT
 
-	return newExpression(NT_IDENT, node);
+	return (Expression*)node;
+}
+
+// agrega un objeto inmutable al pool de constantes del programa; quien llama rellena su contenido.
+static Object* addConstant(ObjectType type, size_t size) {
+	ConstantPool* constants = &program->constants;
+	if (constants->capacity < (constants->count + 1)) {
+		int cap = constants->capacity;
+		constants->capacity = (cap == 0) ? FIRST_ARRAY_CAPACITY : cap * GROWING_ARRAY_FACTOR;
+		constants->objects = arenaGrow(arena, constants->objects, sizeof(Object*) * cap, sizeof(Object*) * constants->capacity);
+	}
+	// el objeto vive en el heap del GC: mientras el programa esté vivo el pool
+	// es una raíz, y si el valor escapa (p.ej. a una variable global) sobrevive al programa.
+	// Nace ya en el heap viejo: el GC no mueve las constantes.
+	Object* constant = newTenuredObject(type, size);
+	constants->objects[constants->count++] = constant;
+
+	return constant;
 }
 
 Expression* parseIntegerLiteral() {
-	IntegerNode* node = createObject(IntegerNode);
+	IntegerNode* node = newNode(NT_INTEGER, sizeof(IntegerNode));
 	node->token = p.curToken;
-	// node->value = atoi(p.curToken.literal);
+	node->value = 0;
+	for (const char* c = sourceAt(p.curToken.position.start); c < sourceAt(p.curToken.position.end); c++) {
+		node->value = node->value * 10 + (*c - '0');
+	}
+
+	node->constant = INT_VAL(node->value); // inmediato: no ocupa el pool
 
 	advance();
 
-	return newExpression(NT_INTEGER, node);
+	return (Expression*)node;
 }
 
 Expression* parseBooleanLiteral() {
-	BooleanNode* node = createObject(BooleanNode);
+	BooleanNode* node = newNode(NT_BOOLEAN, sizeof(BooleanNode));
 	node->token = p.curToken;
 	node->value = p.curToken.type == T_TRUE ? true : false;
 
 	advance();
 
-	return newExpression(NT_BOOLEAN, node);
+	return (Expression*)node;
 }
 
 Expression* parseStringLiteral() {
-	StringNode* node = createObject(StringNode);
+	StringNode* node = newNode(NT_STRING, sizeof(StringNode));
 	node->token = p.curToken;
-	// node->value = strdup(p.curToken.literal);
+	int len = p.curToken.position.end - p.curToken.position.start;
+	node->value = arenaCopyString(arena, sourceAt(p.curToken.position.start), len);
+	NODE_SITE(node, "string", p.curToken.position.start);
+	SET_ALLOCATION_SITE(node->site); // la constante se crea ya
+
+	// el objeto puede sobrevivir a la arena: su string es una copia propia.
+	Object* constant = addConstant(STRING_OBJ, sizeof(Object) + sizeof(StringObj) + len + 1);
+	StringObj* strObj = (StringObj*)OBJ_PAYLOAD(constant);
+	strObj->length = len;
+	memcpy(strObj->value, node->value, len + 1);
+	node->constant = OBJ_VAL(constant);
 
 	advance();
 
-	return newExpression(NT_STRING, node);
+	return (Expression*)node;
 }
 
 static Precedence curPrecedence() {
@@ -242,28 +274,30 @@ static Expression* parseExpression(Precedence pre) {
 }
 
 Expression* parsePrefixExpression() {
-	PrefixNode* node = createObject(PrefixNode);
+	PrefixNode* node = newNode(NT_PREFIX, sizeof(PrefixNode));
 	node->token = p.curToken;
 	node->operator = p.curToken.type;
+	NODE_SITE(node, tokenNames[node->operator] + 2, p.curToken.position.start);
 
 	advance(); // skip the PREFIX token
 
 	node->right = parseExpression(PREFIX);
 
-	return newExpression(NT_PREFIX, node);
+	return (Expression*)node;
 }
 
 Expression* parseInfixExpression(Expression* left) {
-	InfixNode* node = createObject(InfixNode);	
+	InfixNode* node = newNode(NT_INFIX, sizeof(InfixNode));	
 	node->left = left;
 	node->operator = p.curToken.type;
+	NODE_SITE(node, tokenNames[node->operator] + 2, p.curToken.position.start);
 
 	Precedence pre = curPrecedence();
 	advance(); // skip the INFIX token
 
 	node->right = parseExpression(pre);
 
-	return newExpression(NT_INFIX, node);
+	return (Expression*)node;
 }
 
 Expression* parseGroupedExpression() {	
@@ -279,12 +313,12 @@ Expression* parseGroupedExpression() {
 }
 
 Expression* parseNullLiteral() {
-	NullNode* node = createObject(NullNode);
+	NullNode* node = newNode(NT_NULL, sizeof(NullNode));
 	node->token = p.curToken;
 
 	advance(); // skip T_NULL
 
-	return newExpression(NT_NULL, node);
+	return (Expression*)node;
 }
 
 static ArrayStmt* parseBlockStatement() {
@@ -305,7 +339,7 @@ static ArrayStmt* parseBlockStatement() {
 }
 
 static IfNode* newIfNode(Expression* condition, ArrayStmt* consequence, ArrayStmt* alternative) {
-	IfNode* node = createObject(IfNode);	
+	IfNode* node = newNode(NT_IF, sizeof(IfNode));	
 	node->condition = condition;
 	node->consequence = consequence;
 	node->alternative = alternative;
@@ -332,53 +366,76 @@ Expression* parseIfExpression() {
 	IfNode* node = newIfNode(condition, consequence, alternative);
 	node->token = token;
 
-	return newExpression(NT_IF, node);
+	return (Expression*)node;
 }
 
 static Expression* parseFunctionLiteral() {
-	FunctionNode* node = createObject(FunctionNode);
+	IdentifierNode* parameters[MAX_ARGUMENTS];
+	int arity = 0;
+	int start = p.curToken.position.start;
 	advance(); // skip T_FUNCTION
 
-	// parameters
+	// parameters: se juntan aquí y luego se copian al final del nodo.
 	if (!match(T_LPAREN)) return NULL;
 	if (!curTokenIs(T_RPAREN)) {
-		int counter = 0;
-		node->parameters[counter++] = (IdentifierNode*)parseIdentifier()->node;
+		parameters[arity++] = (IdentifierNode*)parseIdentifier();
 		while (!curTokenIs(T_EOF) && curTokenIs(T_COMMA)) {
 			advance(); // T_COMMA
-			if (counter == 255) {
+			if (arity == MAX_ARGUMENTS) {
 				fprintf(stderr, "Can't have more than 255 parameters.");
 				return NULL;
 			}
-			node->parameters[counter++] = (IdentifierNode*)parseIdentifier()->node;
+			parameters[arity++] = (IdentifierNode*)parseIdentifier();
 		}
-		node->arity = counter;
 	}
 	if (!match(T_RPAREN)) return NULL;
 
+	FunctionNode* node = newNode(NT_FUNCTION, sizeof(FunctionNode) + sizeof(IdentifierNode*) * arity);
+	node->arity = arity;
+	node->localCount = arity;
+	node->locals = NULL;
+	node->captureCount = 0;
+	node->captures = NULL;
+	node->shared = NULL;
+	node->program = program;
+	node->profile = newProfiledFunction(start);
+	NODE_SITE(node, "fn", start);
+	memcpy(node->parameters, parameters, sizeof(IdentifierNode*) * arity);
 	node->body = parseBlockStatement();
 	
-	return newExpression(NT_FUNCTION, node);
+	return (Expression*)node;
 }
 
 static Expression* parseCallExpression(Expression* function) {
-	CallNode* node = createObject(CallNode);
-	node->function = function;
+	Expression* arguments[MAX_ARGUMENTS];
+	int argc = 0;
+	int start = p.curToken.position.start;
 
 	advance(); // T_LPAREN
 
 	if (!curTokenIs(T_RPAREN)) {
-		int count = 0;
-		node->arguments[count++] = parseExpression(LOWEST);
+		arguments[argc++] = parseExpression(LOWEST);
 		while (!curTokenIs(T_EOF) && curTokenIs(T_COMMA)) {
 			advance(); // T_COMMA
-			node->arguments[count++] = parseExpression(LOWEST);
+			if (argc == MAX_ARGUMENTS) {
+				fprintf(stderr, "Can't have more than 255 arguments.");
+				return NULL;
+			}
+			arguments[argc++] = parseExpression(LOWEST);
 		}
-		node->argc = count;
 	}
 	match(T_RPAREN);
 
-	return newExpression(NT_CALL, node);
+	CallNode* node = newNode(NT_CALL, sizeof(CallNode) + sizeof(Expression*) * argc);
+	node->function = function;
+	node->argc = argc;
+	node->target = NULL;
+	node->tail = false;
+	NODE_SITE(node, "call", start);
+	NODE_CALL_SITE(node, (function->type == NT_IDENT) ? ((IdentifierNode*)function)->symbol : NO_SYMBOL, start);
+	memcpy(node->arguments, arguments, sizeof(Expression*) * argc);
+
+	return (Expression*)node;
 }
 
 void initParser() {
@@ -393,7 +450,7 @@ static bool peekTokenIs(TokenType t) {
 }
 
 static Statement* parseLetStatement() {	
-	LetStatement* node = createObject(LetStatement);
+	LetStatement* node = newNode(NT_LET, sizeof(LetStatement));
 	advance(); // skip T_LET
 
 	if (!curTokenIs(T_IDENT)) {
@@ -401,9 +458,11 @@ static Statement* parseLetStatement() {
 	}
 	
 	// creamos el nodo Identifier para que forme parte del name de LetStatement
-	IdentifierNode* ident = createObject(IdentifierNode);
+	IdentifierNode* ident = newNode(NT_IDENT, sizeof(IdentifierNode));
 	ident->token = p.curToken;
-	// ident->value = strdup(p.curToken.literal);
+	ident->symbol = p.curToken.symbol;
+	ident->depth = GLOBAL_DEPTH;
+	ident->slot = p.curToken.symbol;
 	
 	advance(); // skip T_IDENT
 
@@ -413,37 +472,41 @@ static Statement* parseLetStatement() {
 
 	node->name = ident;
 	node->value = parseExpression(LOWEST);
+	if (node->value != NULL && node->value->type == NT_FUNCTION) {
+		nameProfiledFunction(((FunctionNode*)node->value)->profile, ident->symbol);
+	}
 
 	if (curTokenIs(T_SEMICOLON)) {
 		advance(); 
 	}
 
-	return newStatement(NT_LET, node);
+	return (Statement*)node;
 }
 
 static Statement* parseReturnStatement() {
-	ReturnStatement* node = createObject(ReturnStatement);
+	ReturnStatement* node = newNode(NT_RETURN, sizeof(ReturnStatement));
 	advance(); // skip RETURN	
 
 	node->token = p.curToken;
+	NODE_SITE(node, "return", p.curToken.position.start);
 	node->value = parseExpression(LOWEST);
 	
 	if (curTokenIs(T_SEMICOLON)) {
 		advance(); 
 	}
 
-	return newStatement(NT_RETURN, node);
+	return (Statement*)node;
 }
 
 static Statement* parseExpressionStatement() {
-	ExpressionStatement* node = createObject(ExpressionStatement);
+	ExpressionStatement* node = newNode(NT_EXPR, sizeof(ExpressionStatement));
 	node->expression = parseExpression(LOWEST);
 
 	if (curTokenIs(T_SEMICOLON)) {
 		advance();
 	}
 
-	return newStatement(NT_EXPR, node);
+	return (Statement*)node;
 }
 
 static Statement* parseStatement() {
@@ -462,23 +525,46 @@ void appendStatement(ArrayStmt* array, Statement* stmt) {
 	if (array->capacity < (array->count+1)) {
 		int cap = array->capacity;
 		array->capacity   = (cap == 0) ? FIRST_ARRAY_CAPACITY : cap * 2;
-		array->statements = realloc(array->statements, sizeof(Statement) * array->capacity);
+		array->statements = arenaGrow(arena, array->statements, sizeof(Statement*) * cap, sizeof(Statement*) * array->capacity);
 	}
 	// agregar la nueva sentencia al array.
 	array->statements[array->count] = stmt;
 	array->count += 1;
 }
 
-ArrayStmt* parseProgram() {
+static Program* parse() {
+	program = newProgram();
+	arena = program->arena;
+
 	initParser();
-	ArrayStmt* program = newArray();
+	program->statements = newArray();
 
 	while (!curTokenIs(T_EOF)) {
 		Statement* stmt = parseStatement();
 		if (stmt != NULL) {
-			appendStatement(program, stmt);
+			appendStatement(program->statements, stmt);
 		}
 	}
+	Program* parsed = program;
+	program = NULL;
+	arena = NULL;
+
+	return parsed;
+}
+
+// parsea pidiendo los tokens al lexer de uno en uno.
+Program* parseProgram() {
+	p.tokens = NULL;
+	return parse();
+}
 
+// parsea un buffer ya tokenizado con tokenize().
+Program* parseTokens(TokenBuffer* tokens) {
+	p.tokens = tokens;
+	p.cursor = 0;
+	// los literales se siguen extrayendo del lexer, que debe apuntar al fuente completo.
+	initLexerN(tokens->input, tokens->length);
+	Program* program = parse();
+	p.tokens = NULL;
 	return program;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define cmonk_parser_h
 
 #include "ast.h"
+#include "tokens.h"
+#include "object.h"
 
 // Orden de precedencia para los operadores
 typedef enum {
@@ -18,6 +20,8 @@ typedef struct {
 	Lexer* l;
 	Token curToken;
 	Token peekToken;
+	TokenBuffer* tokens; // si no es NULL los tokens salen de aquí y no del lexer
+	int cursor; // siguiente token de 'tokens'
 } Parser;
 
 
@@ -28,6 +32,7 @@ typedef Expression* (*infixParseFn)(Expression* left);
 /*================================================================/
 * PUBLIC PARSER API
 *=================================================================*/
-ArrayStmt* parseProgram();
+Program* parseProgram();
+Program* parseTokens(TokenBuffer* tokens);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,261 @@
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+#include "profiler.h"
+#include "interpreter.h"
+#include "symbol.h"
+
+static bool profiling;
+static ProfiledFunction* functions; // el 0 es el nivel superior del programa
+static int functionCount;
+static int functionCapacity;
+
+/**
+ * Muestras: cada una es su número de llamadas seguido de los ids de las
+ * funciones, de la más externa a la más interna (sin el nivel superior, que
+ * está en todas). Solo las escribe el manejador de SIGPROF.
+ */
+static int* samples;
+static volatile int sampleUsed;
+static volatile int sampleCount;
+static volatile int droppedSamples; // no cupieron en el buffer
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void takeSample(int signal);
+static const char* functionName(int function, char* out, size_t size);
+static unsigned hashSample(int offset);
+static bool sameSample(int a, int b);
+static int compareSelf(const void* a, const void* b);
+static void writeFolded(FILE* file);
+static void writeTop(FILE* file);
+bool startProfiler();
+void stopProfiler();
+int newProfiledFunction(int position);
+void nameProfiledFunction(int function, int symbol);
+bool writeProfile(const char* foldedPath, FILE* report);
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+/**
+ * Manejador de SIGPROF: puede interrumpir al intérprete en cualquier punto,
+ * así que solo lee las pilas de llamadas (sampleCallStack) y escribe en el
+ * buffer ya reservado. Nada de malloc ni de stdio.
+ */
+static void takeSample(int signal) {
+    (void)signal;
+    int stack[PROFILE_MAX_DEPTH];
+    int depth = sampleCallStack(stack, PROFILE_MAX_DEPTH);
+    int stored = (depth < PROFILE_MAX_DEPTH) ? depth : PROFILE_MAX_DEPTH;
+    bool truncated = depth > stored;
+    int length = stored + (truncated ? 1 : 0);
+    int used = sampleUsed;
+    if (used + 1 + length > PROFILE_BUFFER_SIZE) {
+        droppedSamples += 1;
+        return;
+    }
+    samples[used++] = length;
+    if (truncated) samples[used++] = PROFILE_TRUNCATED;
+    for (int i = stored - 1; i >= 0; i--) {
+        samples[used++] = stack[i]; // sampleCallStack da primero la más interna
+    }
+    sampleUsed = used;
+    sampleCount += 1;
+}
+
+// "fib (3:5)", o "fn (3:5)" si es anónima.
+static const char* functionName(int function, char* out, size_t size) {
+    if (function == PROFILE_TRUNCATED) return "(truncated)";
+    if (function <= PROFILE_PROGRAM || function >= functionCount) return "(program)";
+    ProfiledFunction* f = &functions[function];
+    const char* name = (f->symbol == NO_SYMBOL) ? "fn" : symbolName(f->symbol);
+    sprintf_s(out, size, "%s (%d:%d)", name, f->line, f->column);
+    return out;
+}
+
+static unsigned hashSample(int offset) {
+    unsigned hash = 2166136261u;
+    for (int i = 0; i <= samples[offset]; i++) {
+        hash = (hash ^ (unsigned)samples[offset + i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool sameSample(int a, int b) {
+    return samples[a] == samples[b] && memcmp(&samples[a + 1], &samples[b + 1], sizeof(int) * samples[a]) == 0;
+}
+
+// pilas agrupadas: "(program);main (1:5);fib (3:5) 42".
+static void writeFolded(FILE* file) {
+    int tableSize = 16;
+    while (tableSize < sampleCount * 2) tableSize *= 2;
+    int* table = malloc(sizeof(int) * tableSize); // offset del primer ejemplar de cada pila
+    int* counts = calloc(tableSize, sizeof(int));
+    if (table == NULL || counts == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    for (int i = 0; i < tableSize; i++) table[i] = -1;
+    for (int offset = 0; offset < sampleUsed; offset += samples[offset] + 1) {
+        unsigned i = hashSample(offset) & (tableSize - 1);
+        while (table[i] != -1 && !sameSample(table[i], offset)) {
+            i = (i + 1) & (tableSize - 1);
+        }
+        table[i] = (table[i] == -1) ? offset : table[i];
+        counts[i] += 1;
+    }
+
+    char name[512];
+    for (int i = 0; i < tableSize; i++) {
+        if (table[i] == -1) continue;
+        fputs("(program)", file);
+        for (int j = 1; j <= samples[table[i]]; j++) {
+            fprintf(file, ";%s", functionName(samples[table[i] + j], name, sizeof(name)));
+        }
+        fprintf(file, " %d\n", counts[i]);
+    }
+    free(table);
+    free(counts);
+}
+
+// para ordenar el resumen: 'self' y 'total' van seguidos por función.
+static int compareSelf(const void* a, const void* b) {
+    const int* x = (const int*)a;
+    const int* y = (const int*)b;
+    if (x[1] != y[1]) return y[1] - x[1];
+    return y[2] - x[2];
+}
+
+/**
+ * Resumen plano: por función, las muestras en las que era la más interna
+ * (self) y en las que estaba en la pila (total, una vez por muestra aunque
+ * sea recursiva).
+ */
+static void writeTop(FILE* file) {
+    int count = functionCount + 1; // y "(truncated)" al final
+    int* rows = calloc((size_t)count * 3, sizeof(int)); // id, self, total
+    int* lastSeen = malloc(sizeof(int) * count);
+    if (rows == NULL || lastSeen == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    for (int i = 0; i < count; i++) {
+        rows[i * 3] = (i == functionCount) ? PROFILE_TRUNCATED : i;
+        lastSeen[i] = -1;
+    }
+    int sample = 0;
+    for (int offset = 0; offset < sampleUsed; offset += samples[offset] + 1, sample++) {
+        int length = samples[offset];
+        for (int j = 0; j <= length; j++) {
+            int function = (j == 0) ? PROFILE_PROGRAM : samples[offset + j];
+            int row = (function == PROFILE_TRUNCATED || function >= functionCount) ? functionCount : function;
+            if (j == length) rows[row * 3 + 1] += 1;
+            if (lastSeen[row] != sample) {
+                lastSeen[row] = sample;
+                rows[row * 3 + 2] += 1;
+            }
+        }
+    }
+    qsort(rows, count, sizeof(int) * 3, compareSelf);
+
+    fprintf(file, "profile: %d samples every %d us", sampleCount, PROFILE_INTERVAL_US);
+    if (droppedSamples > 0) fprintf(file, " (%d dropped, buffer full)", droppedSamples);
+    fprintf(file, "\n%8s %8s %9s  %s\n", "self%", "total%", "samples", "function");
+    char name[512];
+    double total = (sampleCount > 0) ? sampleCount : 1;
+    for (int i = 0; i < count && i < PROFILE_TOP; i++) {
+        int* row = &rows[i * 3];
+        if (row[2] == 0) break;
+        fprintf(file, "%7.2f%% %7.2f%% %9d  %s\n", 100.0 * row[1] / total, 100.0 * row[2] / total,
+            row[1], functionName(row[0], name, sizeof(name)));
+    }
+    free(rows);
+    free(lastSeen);
+}
+
+// activa el registro de funciones en el parser y el temporizador. Devuelve false si no se pudo.
+bool startProfiler() {
+#ifdef _WIN32
+    return false;
+#else
+    samples = malloc(sizeof(int) * PROFILE_BUFFER_SIZE);
+    functions = malloc(sizeof(ProfiledFunction) * 64);
+    if (samples == NULL || functions == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    functionCapacity = 64;
+    functions[0] = (ProfiledFunction){ NO_SYMBOL, 0, 0 };
+    functionCount = 1;
+    sampleUsed = sampleCount = droppedSamples = 0;
+    profiling = true;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = PROFILE_INTERVAL_US;
+    timer.it_value = timer.it_interval;
+    if (sigaction(SIGPROF, &action, NULL) != 0 || setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        profiling = false;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// para el temporizador: las muestras se quedan para writeProfile().
+void stopProfiler() {
+#ifndef _WIN32
+    if (!profiling) return;
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+    profiling = false;
+#endif
+}
+
+/**
+ * El parser da de alta cada FunctionNode. 'position' es el byte del fuente
+ * donde empieza el 'fn'. Sin el profiler activo devuelve PROFILE_PROGRAM.
+ */
+int newProfiledFunction(int position) {
+    if (!profiling) return PROFILE_PROGRAM;
+    if (functionCount == functionCapacity) {
+        functionCapacity *= 2;
+        functions = realloc(functions, sizeof(ProfiledFunction) * functionCapacity);
+        if (functions == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    ProfiledFunction* function = &functions[functionCount];
+    function->symbol = NO_SYMBOL;
+    sourcePosition(position, &function->line, &function->column);
+    return functionCount++;
+}
+
+// let nombre = fn(...) {...}: la función se llama como la variable (la primera vez).
+void nameProfiledFunction(int function, int symbol) {
+    if (function <= PROFILE_PROGRAM || function >= functionCount) return;
+    if (functions[function].symbol == NO_SYMBOL) functions[function].symbol = symbol;
+}
+
+// escribe las pilas en 'foldedPath' (si no es NULL) y el resumen en 'report'.
+bool writeProfile(const char* foldedPath, FILE* report) {
+    if (foldedPath != NULL) {
+        FILE* file = fopen(foldedPath, "w");
+        if (file == NULL) return false;
+        writeFolded(file);
+        fclose(file);
+    }
+    writeTop(report);
+    return true;
+}
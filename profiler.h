@@ -0,0 +1,43 @@
+#ifndef cmonk_profiler_h
+#define cmonk_profiler_h
+
+#include "headers.h"
+
+/**
+ * Profiler por muestreo de las funciones de Monkey.
+ * Con el profiler activo (--profile) un temporizador de CPU (SIGPROF) salta
+ * cada PROFILE_INTERVAL_US y el manejador copia la pila de llamadas de Monkey
+ * (las llamadas en curso del tree walker o los frames de la VM) en un buffer
+ * reservado de antemano: no reserva memoria ni toca el heap del GC.
+ * Cada función se identifica por un id que el parser le da al FunctionNode,
+ * con el nombre del let al que se asigna y su posición en el fuente.
+ * Al terminar se escriben las pilas en formato "folded" (una línea por pila
+ * distinta con su número de muestras, lo que lee flamegraph.pl) y un resumen
+ * con las funciones que más muestras tienen.
+ * Sin --profile no hay temporizador y el parser no registra nada.
+ */
+#define PROFILE_INTERVAL_US 1000 // periodo del muestreo (tiempo de CPU)
+#define PROFILE_MAX_DEPTH 256 // llamadas que se guardan por muestra (las más internas)
+#define PROFILE_BUFFER_SIZE (1 << 21) // ints del buffer de muestras
+#define PROFILE_TOP 20 // funciones del resumen
+
+#define PROFILE_PROGRAM 0 // id del nivel superior del programa (y de lo que no se registró)
+#define PROFILE_TRUNCATED -1 // marca en lugar de las llamadas que no cupieron
+
+// una función de Monkey para el profiler.
+typedef struct {
+    int symbol; // el let al que se asignó (NO_SYMBOL: anónima)
+    int line;
+    int column;
+} ProfiledFunction;
+
+/*================================================================/
+* PUBLIC PROFILER API
+*=================================================================*/
+bool startProfiler();
+void stopProfiler();
+int newProfiledFunction(int position);
+void nameProfiledFunction(int function, int symbol);
+bool writeProfile(const char* foldedPath, FILE* report);
+
+#endif
@@ -0,0 +1,405 @@
+#include "resolver.h"
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static int declare(Scope* scope, int symbol, int kind);
+static int findSlot(Scope* scope, int symbol);
+static void declareStatements(Scope* scope, ArrayStmt* stmts);
+static void declareExpression(Scope* scope, Expression* exp);
+static int capture(Scope* scope, int symbol);
+static void resolveIdentifier(Scope* scope, IdentifierNode* node);
+static void resolveFunction(Scope* outer, FunctionNode* node);
+static void resolveStatements(Scope* scope, ArrayStmt* stmts);
+static void resolveExpression(Scope* scope, Expression* exp);
+static void markTailStatements(ArrayStmt* stmts, bool tail);
+static void markTailExpression(Expression* exp, bool tail);
+static void markIdentifier(Scope* scope, IdentifierNode* node);
+static void markFunction(Scope* outer, FunctionNode* node);
+static void markStatements(Scope* scope, ArrayStmt* stmts);
+static void markExpression(Scope* scope, Expression* exp);
+void resolveProgram(Program* program);
+
+static Arena* arena; // arena del programa que se está resolviendo
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+// devuelve el slot de 'symbol' en el scope, creándolo si no existe. Tras un 'let' el slot puede cambiar.
+static int declare(Scope* scope, int symbol, int kind) {
+	int slot = findSlot(scope, symbol);
+	if (slot != -1) {
+		if (kind == SLOT_LET) {
+			scope->kinds[slot] = SLOT_LET;
+		}
+		return slot; // volver a declarar un nombre reutiliza su slot.
+	}
+	if (scope->capacity < (scope->count + 1)) {
+		scope->capacity = (scope->capacity == 0) ? FIRST_ARRAY_CAPACITY : scope->capacity * GROWING_ARRAY_FACTOR;
+		scope->symbols = realloc(scope->symbols, sizeof(int) * scope->capacity);
+		scope->kinds = realloc(scope->kinds, sizeof(int) * scope->capacity);
+		if (scope->symbols == NULL || scope->kinds == NULL) {
+			fprintf(stderr, "ERROR: not enough memory.\n");
+			exit(74);
+		}
+	}
+	scope->symbols[scope->count] = symbol;
+	scope->kinds[scope->count] = kind;
+	return scope->count++;
+}
+
+static int findSlot(Scope* scope, int symbol) {
+	for (int i = 0; i < scope->count; i++) {
+		if (scope->symbols[i] == symbol) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Primera pasada: todos los 'let' de la función (incluidos los que están dentro
+ * de un if) reciben slot antes de resolver nada, así una función local puede
+ * llamar a otra que se declara más abajo. Si en tiempo de ejecución el slot
+ * todavía está vacío el intérprete busca el nombre en los scopes de fuera.
+ */
+static void declareStatements(Scope* scope, ArrayStmt* stmts) {
+	for (int i = 0; i < stmts->count; i++) {
+		Statement* stmt = stmts->statements[i];
+		switch (stmt->type) {
+		case NT_LET:
+			declare(scope, ((LetStatement*)stmt)->name->symbol, SLOT_LET);
+			declareExpression(scope, ((LetStatement*)stmt)->value);
+			break;
+		case NT_RETURN:
+			declareExpression(scope, ((ReturnStatement*)stmt)->value);
+			break;
+		case NT_EXPR:
+			declareExpression(scope, ((ExpressionStatement*)stmt)->expression);
+			break;
+		}
+	}
+}
+
+static void declareExpression(Scope* scope, Expression* exp) {
+	if (exp == NULL) return;
+	switch (exp->type) {
+	case NT_PREFIX:
+		declareExpression(scope, ((PrefixNode*)exp)->right);
+		break;
+	case NT_INFIX:
+		declareExpression(scope, ((InfixNode*)exp)->left);
+		declareExpression(scope, ((InfixNode*)exp)->right);
+		break;
+	case NT_IF:
+		{
+			IfNode* node = (IfNode*)exp;
+			declareExpression(scope, node->condition);
+			declareStatements(scope, node->consequence);
+			if (node->alternative != NULL) {
+				declareStatements(scope, node->alternative);
+			}
+			break;
+		}
+	case NT_CALL:
+		{
+			CallNode* node = (CallNode*)exp;
+			declareExpression(scope, node->function);
+			for (int i = 0; i < node->argc; i++) {
+				declareExpression(scope, node->arguments[i]);
+			}
+			break;
+		}
+	default:
+		break; // las funciones anidadas tienen su propio scope.
+	}
+}
+
+/**
+ * Copia en 'scope' de la variable 'symbol', que está en alguna función de
+ * fuera: le da un slot y apunta de qué slot de la función de fuera sale (si
+ * esa tampoco la tiene, la copia a su vez). Devuelve el slot, o -1 si la
+ * variable puede cambiar y hay que leerla de su Environment.
+ */
+static int capture(Scope* scope, int symbol) {
+	Scope* outer = scope->outer;
+	if (scope->captureCount == MAX_CAPTURES) return -1;
+	int source = findSlot(outer, symbol);
+	if (source == -1) {
+		source = capture(outer, symbol);
+	} else if (outer->kinds[source] == SLOT_LET) {
+		source = -1;
+	}
+	if (source == -1) return -1;
+	scope->captureCount += 1;
+	return declare(scope, symbol, source);
+}
+
+static void resolveIdentifier(Scope* scope, IdentifierNode* node) {
+	int depth = 0;
+	for (Scope* found = scope; found != NULL; found = found->outer) {
+		int slot = findSlot(found, node->symbol);
+		if (slot != -1) {
+			int copy = (depth > 0) ? capture(scope, node->symbol) : -1;
+			node->depth = (copy != -1) ? 0 : depth;
+			node->slot = (copy != -1) ? copy : slot;
+			return;
+		}
+		depth += 1;
+	}
+	node->depth = GLOBAL_DEPTH;
+	node->slot = node->symbol;
+}
+
+static void resolveFunction(Scope* outer, FunctionNode* node) {
+	Scope scope;
+	scope.function = node;
+	scope.count = 0;
+	scope.capacity = 0;
+	scope.symbols = NULL;
+	scope.kinds = NULL;
+	scope.captureCount = 0;
+	scope.outer = outer;
+	node->closures = false; // lo pone resolveExpression() si encuentra un fn en el cuerpo
+
+	// los parámetros ocupan los primeros slots, en orden; las copias, los últimos.
+	for (int i = 0; i < node->arity; i++) {
+		IdentifierNode* param = node->parameters[i];
+		param->depth = 0;
+		param->slot = declare(&scope, param->symbol, SLOT_PARAMETER);
+	}
+	declareStatements(&scope, node->body);
+	resolveStatements(&scope, node->body);
+	markTailStatements(node->body, true);
+
+	node->localCount = scope.count;
+	node->locals = NULL;
+	if (scope.count > 0) {
+		node->locals = (int*)arenaAlloc(arena, sizeof(int) * scope.count);
+		memcpy(node->locals, scope.symbols, sizeof(int) * scope.count);
+	}
+	node->captureCount = scope.captureCount;
+	node->captures = NULL;
+	if (scope.captureCount > 0) {
+		node->captures = (int*)arenaAlloc(arena, sizeof(int) * scope.captureCount);
+		memcpy(node->captures, scope.kinds + (scope.count - scope.captureCount), sizeof(int) * scope.captureCount);
+	}
+	free(scope.symbols);
+	free(scope.kinds);
+}
+
+static void resolveStatements(Scope* scope, ArrayStmt* stmts) {
+	for (int i = 0; i < stmts->count; i++) {
+		Statement* stmt = stmts->statements[i];
+		switch (stmt->type) {
+		case NT_LET:
+			{
+				LetStatement* let = (LetStatement*)stmt;
+				resolveExpression(scope, let->value);
+				// ya se declaró en el scope actual (depth 0), o es global.
+				resolveIdentifier(scope, let->name);
+				break;
+			}
+		case NT_RETURN:
+			resolveExpression(scope, ((ReturnStatement*)stmt)->value);
+			break;
+		case NT_EXPR:
+			resolveExpression(scope, ((ExpressionStatement*)stmt)->expression);
+			break;
+		}
+	}
+}
+
+static void resolveExpression(Scope* scope, Expression* exp) {
+	if (exp == NULL) return;
+	switch (exp->type) {
+	case NT_IDENT:
+		resolveIdentifier(scope, (IdentifierNode*)exp);
+		break;
+	case NT_PREFIX:
+		resolveExpression(scope, ((PrefixNode*)exp)->right);
+		break;
+	case NT_INFIX:
+		resolveExpression(scope, ((InfixNode*)exp)->left);
+		resolveExpression(scope, ((InfixNode*)exp)->right);
+		break;
+	case NT_IF:
+		{
+			IfNode* node = (IfNode*)exp;
+			resolveExpression(scope, node->condition);
+			resolveStatements(scope, node->consequence);
+			if (node->alternative != NULL) {
+				resolveStatements(scope, node->alternative);
+			}
+			break;
+		}
+	case NT_FUNCTION:
+		if (scope != NULL) {
+			scope->function->closures = true;
+		}
+		resolveFunction(scope, (FunctionNode*)exp);
+		break;
+	case NT_CALL:
+		{
+			CallNode* node = (CallNode*)exp;
+			resolveExpression(scope, node->function);
+			for (int i = 0; i < node->argc; i++) {
+				resolveExpression(scope, node->arguments[i]);
+			}
+			break;
+		}
+	default:
+		break;
+	}
+}
+
+/**
+ * Llamadas de cola: las que dan directamente el valor de la función, que son
+ * la de un 'return f(...)' y la de la última sentencia del cuerpo (también
+ * la última de cada rama de un if que esté en esa posición). Un 'return'
+ * dentro de un if lo es aunque el if no sea la última sentencia. Las del
+ * nivel superior del programa no se marcan.
+ */
+static void markTailStatements(ArrayStmt* stmts, bool tail) {
+	for (int i = 0; i < stmts->count; i++) {
+		Statement* stmt = stmts->statements[i];
+		switch (stmt->type) {
+		case NT_RETURN:
+			markTailExpression(((ReturnStatement*)stmt)->value, true);
+			break;
+		case NT_EXPR:
+			markTailExpression(((ExpressionStatement*)stmt)->expression, tail && i == stmts->count - 1);
+			break;
+		}
+	}
+}
+
+static void markTailExpression(Expression* exp, bool tail) {
+	if (exp == NULL) return;
+	switch (exp->type) {
+	case NT_IF:
+		{
+			IfNode* node = (IfNode*)exp;
+			markTailStatements(node->consequence, tail);
+			if (node->alternative != NULL) {
+				markTailStatements(node->alternative, tail);
+			}
+			break;
+		}
+	case NT_CALL:
+		((CallNode*)exp)->tail = tail;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Segunda pasada, con las copias ya decididas: qué closures guardan el
+ * Environment donde se crean. Lo guardan las funciones por las que sube un
+ * identificador que no se pudo copiar, y las que podría recorrer get() si el
+ * slot está vacío: desde la función donde está la variable (la original, no
+ * una copia) hasta el último scope de fuera que tenga el mismo nombre.
+ */
+static void markIdentifier(Scope* scope, IdentifierNode* node) {
+	if (node->depth == GLOBAL_DEPTH) return;
+	Scope* origin = scope;
+	for (int depth = node->depth; depth > 0; depth--) {
+		origin->function->keepsEnv = true;
+		origin = origin->outer;
+	}
+	// una copia vacía ya hace que su closure guarde el Environment (ver newFunction).
+	while (findSlot(origin, node->symbol) >= origin->count - origin->function->captureCount) {
+		origin = origin->outer;
+	}
+	Scope* last = NULL;
+	for (Scope* outer = origin->outer; outer != NULL; outer = outer->outer) {
+		if (findSlot(outer, node->symbol) != -1) last = outer;
+	}
+	for (Scope* inner = origin; last != NULL && inner != last; inner = inner->outer) {
+		inner->function->keepsEnv = true;
+	}
+}
+
+static void markFunction(Scope* outer, FunctionNode* node) {
+	Scope scope;
+	scope.function = node;
+	scope.count = node->localCount;
+	scope.capacity = 0;
+	scope.symbols = node->locals;
+	scope.kinds = NULL;
+	scope.captureCount = node->captureCount;
+	scope.outer = outer;
+	node->keepsEnv = false;
+	node->needsEnv = false;
+
+	markStatements(&scope, node->body);
+	if (node->keepsEnv && outer != NULL) {
+		outer->function->needsEnv = true;
+	}
+}
+
+static void markStatements(Scope* scope, ArrayStmt* stmts) {
+	for (int i = 0; i < stmts->count; i++) {
+		Statement* stmt = stmts->statements[i];
+		switch (stmt->type) {
+		case NT_LET:
+			markExpression(scope, ((LetStatement*)stmt)->value);
+			break;
+		case NT_RETURN:
+			markExpression(scope, ((ReturnStatement*)stmt)->value);
+			break;
+		case NT_EXPR:
+			markExpression(scope, ((ExpressionStatement*)stmt)->expression);
+			break;
+		}
+	}
+}
+
+static void markExpression(Scope* scope, Expression* exp) {
+	if (exp == NULL) return;
+	switch (exp->type) {
+	case NT_IDENT:
+		markIdentifier(scope, (IdentifierNode*)exp);
+		break;
+	case NT_PREFIX:
+		markExpression(scope, ((PrefixNode*)exp)->right);
+		break;
+	case NT_INFIX:
+		markExpression(scope, ((InfixNode*)exp)->left);
+		markExpression(scope, ((InfixNode*)exp)->right);
+		break;
+	case NT_IF:
+		{
+			IfNode* node = (IfNode*)exp;
+			markExpression(scope, node->condition);
+			markStatements(scope, node->consequence);
+			if (node->alternative != NULL) {
+				markStatements(scope, node->alternative);
+			}
+			break;
+		}
+	case NT_FUNCTION:
+		markFunction(scope, (FunctionNode*)exp);
+		break;
+	case NT_CALL:
+		{
+			CallNode* node = (CallNode*)exp;
+			markExpression(scope, node->function);
+			for (int i = 0; i < node->argc; i++) {
+				markExpression(scope, node->arguments[i]);
+			}
+			break;
+		}
+	default:
+		break;
+	}
+}
+
+// el nivel superior del programa no es un scope: sus 'let' son globales.
+void resolveProgram(Program* program) {
+	arena = program->arena;
+	resolveStatements(NULL, program->statements);
+	markStatements(NULL, program->statements);
+	arena = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef cmonk_resolver_h
+#define cmonk_resolver_h
+
+#include "ast.h"
+
+/**
+ * Resolver: pasada entre el parser y el intérprete que decide a qué variable
+ * se refiere cada identificador. Cada función es un scope (los bloques de un if
+ * no crean scope) y sus parámetros y 'let' ocupan slots consecutivos en el
+ * environment de la llamada. Cada IdentifierNode queda con:
+ * 	depth: cuántos scopes de función hay que subir (0 = el actual), o
+ * 	       GLOBAL_DEPTH si es una variable global.
+ * 	slot:  la posición en ese scope (en el global es el id del símbolo).
+ * Un nombre que no está declarado en ninguna función se toma como global,
+ * aunque todavía no exista: así una línea del REPL puede usar una función o
+ * variable que se defina en una línea posterior.
+ *
+ * Closures planos: si una función usa una variable de una función de fuera
+ * cuyo valor ya no cambia durante la llamada (un parámetro que ningún 'let'
+ * redefine), el closure se queda con una copia al crearse y la variable pasa
+ * a ser un slot local más (los últimos, ver FunctionNode.captures). Si está
+ * varias funciones más arriba, las intermedias la copian también. El closure
+ * solo guarda el Environment donde se crea (keepsEnv) si algo del cuerpo
+ * tiene que subir por él: una variable que no se pudo copiar, o una búsqueda
+ * por nombre (ver get()) que podría encontrar el nombre fuera.
+ */
+#define MAX_CAPTURES 64 // copias de un closure; el resto de variables se leen del Environment
+
+#define SLOT_LET -1 // el slot es de un 'let': puede cambiar
+#define SLOT_PARAMETER -2 // un parámetro sin 'let' que lo redefina
+
+typedef struct sScope {
+	FunctionNode* function;
+	int count;
+	int capacity;
+	int* symbols; // símbolo de cada slot
+	int* kinds; // SLOT_LET, SLOT_PARAMETER o, si es una copia, el slot de fuera que copia
+	int captureCount;
+	struct sScope* outer;
+} Scope;
+
+/*================================================================/
+* PUBLIC RESOLVER API
+*=================================================================*/
+void resolveProgram(Program* program);
+
+#endif
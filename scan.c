@@ -0,0 +1,222 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static size_t whitespaceScalar(const char* input, size_t from, size_t length);
+static size_t identifierScalar(const char* input, size_t from, size_t length);
+static size_t digitsScalar(const char* input, size_t from, size_t length);
+static size_t stringBodyScalar(const char* input, size_t from, size_t length);
+static ScanMode bestScanMode();
+void initScanner();
+ScanMode setScanMode(ScanMode mode);
+const char* scanModeName(ScanMode mode);
+
+Scanner scanner = {
+    SCAN_SCALAR, whitespaceScalar, identifierScalar, digitsScalar, stringBodyScalar
+};
+static bool scannerReady = false;
+
+/*================================================================/
+* Versión escalar (byte a byte)
+*=================================================================*/
+static inline bool isSpaceByte(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline bool isIdentByte(char ch) {
+    return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9') || ch == '_';
+}
+
+static inline bool isDigitByte(char ch) {
+    return '0' <= ch && ch <= '9';
+}
+
+static inline bool isStringByte(char ch) {
+    return ch != '"' && ch != '\0';
+}
+
+static size_t whitespaceScalar(const char* input, size_t from, size_t length) {
+    while (from < length && isSpaceByte(input[from])) from++;
+    return from;
+}
+
+static size_t identifierScalar(const char* input, size_t from, size_t length) {
+    while (from < length && isIdentByte(input[from])) from++;
+    return from;
+}
+
+static size_t digitsScalar(const char* input, size_t from, size_t length) {
+    while (from < length && isDigitByte(input[from])) from++;
+    return from;
+}
+
+static size_t stringBodyScalar(const char* input, size_t from, size_t length) {
+    while (from < length && input[from] != '"' && input[from] != '\0') from++;
+    return from;
+}
+
+#ifdef SCAN_X86
+/*================================================================/
+* Versiones vectoriales.
+* Cada bloque produce una máscara con un bit por byte que pertenece a la
+* clase; el primer bit a 0 marca el final del run. Los bytes >= 0x80 son
+* negativos en las comparaciones con signo y quedan fuera de los rangos.
+* La cola (< 16/32 bytes) se termina con la versión escalar para no leer
+* fuera del buffer.
+*=================================================================*/
+#define SCAN_PROLOGUE_BYTES 8
+
+// los runs cortos (un espacio, identificadores de pocas letras) son los más
+// frecuentes: se resuelven byte a byte antes de cargar un bloque entero.
+#define SCALAR_PROLOGUE(isClass) \
+    for (size_t stop = from + SCAN_PROLOGUE_BYTES; from < stop; from++) { \
+        if (from >= length || !isClass(input[from])) return from; \
+    }
+
+#define SSE_IN_RANGE(v, lo, hi) \
+    _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((lo) - 1)), _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), (v)))
+
+#define AVX_IN_RANGE(v, lo, hi) \
+    _mm256_and_si256(_mm256_cmpgt_epi8((v), _mm256_set1_epi8((lo) - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), (v)))
+
+__attribute__((target("sse2")))
+static inline unsigned sseWhitespace(__m128i v) {
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse2")))
+static inline unsigned sseIdentifier(__m128i v) {
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(SSE_IN_RANGE(v, 'a', 'z'), SSE_IN_RANGE(v, 'A', 'Z')),
+        _mm_or_si128(SSE_IN_RANGE(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse2")))
+static inline unsigned sseDigits(__m128i v) {
+    return (unsigned)_mm_movemask_epi8(SSE_IN_RANGE(v, '0', '9'));
+}
+
+__attribute__((target("sse2")))
+static inline unsigned sseStringBody(__m128i v) {
+    __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    return ~(unsigned)_mm_movemask_epi8(stop) & 0xFFFF;
+}
+
+#define DEFINE_SSE_SCAN(name, classify, scalar, isClass) \
+    __attribute__((target("sse2"))) \
+    static size_t name(const char* input, size_t from, size_t length) { \
+        SCALAR_PROLOGUE(isClass) \
+        while (from + 16 <= length) { \
+            unsigned mask = classify(_mm_loadu_si128((const __m128i*)(input + from))); \
+            if (mask != 0xFFFF) return from + __builtin_ctz(~mask); \
+            from += 16; \
+        } \
+        return scalar(input, from, length); \
+    }
+
+DEFINE_SSE_SCAN(whitespaceSse2, sseWhitespace, whitespaceScalar, isSpaceByte)
+DEFINE_SSE_SCAN(identifierSse2, sseIdentifier, identifierScalar, isIdentByte)
+DEFINE_SSE_SCAN(digitsSse2, sseDigits, digitsScalar, isDigitByte)
+DEFINE_SSE_SCAN(stringBodySse2, sseStringBody, stringBodyScalar, isStringByte)
+
+__attribute__((target("avx2")))
+static inline unsigned avxWhitespace(__m256i v) {
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned avxIdentifier(__m256i v) {
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(AVX_IN_RANGE(v, 'a', 'z'), AVX_IN_RANGE(v, 'A', 'Z')),
+        _mm256_or_si256(AVX_IN_RANGE(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+    return (unsigned)_mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned avxDigits(__m256i v) {
+    return (unsigned)_mm256_movemask_epi8(AVX_IN_RANGE(v, '0', '9'));
+}
+
+__attribute__((target("avx2")))
+static inline unsigned avxStringBody(__m256i v) {
+    __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    return ~(unsigned)_mm256_movemask_epi8(stop);
+}
+
+#define DEFINE_AVX_SCAN(name, classify, sse, isClass) \
+    __attribute__((target("avx2"))) \
+    static size_t name(const char* input, size_t from, size_t length) { \
+        SCALAR_PROLOGUE(isClass) \
+        while (from + 32 <= length) { \
+            unsigned mask = classify(_mm256_loadu_si256((const __m256i*)(input + from))); \
+            if (mask != 0xFFFFFFFFu) return from + __builtin_ctz(~mask); \
+            from += 32; \
+        } \
+        return sse(input, from, length); \
+    }
+
+DEFINE_AVX_SCAN(whitespaceAvx2, avxWhitespace, whitespaceSse2, isSpaceByte)
+DEFINE_AVX_SCAN(identifierAvx2, avxIdentifier, identifierSse2, isIdentByte)
+DEFINE_AVX_SCAN(digitsAvx2, avxDigits, digitsSse2, isDigitByte)
+DEFINE_AVX_SCAN(stringBodyAvx2, avxStringBody, stringBodySse2, isStringByte)
+#endif
+
+/*================================================================/
+* Selección del escáner
+*=================================================================*/
+static ScanMode bestScanMode() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+void initScanner() {
+    if (scannerReady) return;
+    setScanMode(SCAN_AVX2);
+}
+
+// activa 'mode' o, si la CPU no lo soporta, el mejor disponible por debajo.
+ScanMode setScanMode(ScanMode mode) {
+    ScanMode best = bestScanMode();
+    if (mode > best) mode = best;
+    scannerReady = true;
+
+    switch (mode) {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+        scanner = (Scanner){ SCAN_AVX2, whitespaceAvx2, identifierAvx2, digitsAvx2, stringBodyAvx2 };
+        break;
+    case SCAN_SSE2:
+        scanner = (Scanner){ SCAN_SSE2, whitespaceSse2, identifierSse2, digitsSse2, stringBodySse2 };
+        break;
+#endif
+    default:
+        scanner = (Scanner){ SCAN_SCALAR, whitespaceScalar, identifierScalar, digitsScalar, stringBodyScalar };
+        break;
+    }
+    return scanner.mode;
+}
+
+const char* scanModeName(ScanMode mode) {
+    switch (mode) {
+    case SCAN_AVX2: return "avx2";
+    case SCAN_SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef cmonk_scan_h
+#define cmonk_scan_h
+
+#include "headers.h"
+
+/**
+ * Rutinas de escaneo por bloques para el lexer.
+ * Cada rutina recibe el buffer, la posición desde donde empezar y la longitud
+ * total, y devuelve la posición del primer byte que NO pertenece a la clase
+ * (o 'length' si se llega al final):
+ *  - whitespace: ' ', '\t', '\n', '\r'
+ *  - identifier: [a-zA-Z0-9_]
+ *  - digits:     [0-9]
+ *  - stringBody: todo excepto '"' y '\0'
+ * Hay una versión escalar y, en x86 con GCC, versiones SSE2 (16 bytes) y
+ * AVX2 (32 bytes) que se eligen en tiempo de ejecución según la CPU.
+ */
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+} ScanMode;
+
+typedef size_t (*ScanFn)(const char* input, size_t from, size_t length);
+
+typedef struct {
+    ScanMode mode;
+    ScanFn whitespace;
+    ScanFn identifier;
+    ScanFn digits;
+    ScanFn stringBody;
+} Scanner;
+
+extern Scanner scanner;
+
+/*================================================================/
+* PUBLIC SCAN API
+*=================================================================*/
+void initScanner();
+ScanMode setScanMode(ScanMode mode);
+const char* scanModeName(ScanMode mode);
+
+#endif
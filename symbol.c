@@ -0,0 +1,116 @@
+#include "symbol.h"
+
+#define SYMBOLS_FIRST_CAPACITY 64
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static unsigned hashName(const char* name, int length);
+static void growTable();
+int internSymbol(const char* name, int length);
+const char* symbolName(int symbol);
+int symbolCount();
+void freeSymbols();
+
+static Symbol* symbols; // símbolos indexados por id.
+static int count;
+static int capacity;
+static int* table; // open addressing: id del símbolo o NO_SYMBOL si está libre.
+static int tableSize; // siempre potencia de 2.
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+// FNV-1a
+static unsigned hashName(const char* name, int length) {
+    unsigned hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void growTable() {
+    int newSize = (tableSize == 0) ? SYMBOLS_FIRST_CAPACITY * 2 : tableSize * 2;
+    int* newTable = (int*)malloc(sizeof(int) * newSize);
+    if (newTable == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    for (int i = 0; i < newSize; i++) {
+        newTable[i] = NO_SYMBOL;
+    }
+    // reinsertar los símbolos existentes.
+    for (int id = 0; id < count; id++) {
+        unsigned index = symbols[id].hash & (newSize - 1);
+        while (newTable[index] != NO_SYMBOL) {
+            index = (index + 1) & (newSize - 1);
+        }
+        newTable[index] = id;
+    }
+    free(table);
+    table = newTable;
+    tableSize = newSize;
+}
+
+int internSymbol(const char* name, int length) {
+    // mantener el factor de carga por debajo de 1/2.
+    if ((count + 1) * 2 > tableSize) {
+        growTable();
+    }
+    unsigned hash = hashName(name, length);
+    unsigned index = hash & (tableSize - 1);
+    for (;;) {
+        int id = table[index];
+        if (id == NO_SYMBOL) break;
+        Symbol* sym = &symbols[id];
+        if (sym->hash == hash && sym->length == length && memcmp(sym->name, name, length) == 0) {
+            return id; // ya existe
+        }
+        index = (index + 1) & (tableSize - 1);
+    }
+
+    // nuevo símbolo: copiamos el nombre porque el buffer del lexer no es permanente.
+    if (capacity < count + 1) {
+        capacity = (capacity == 0) ? SYMBOLS_FIRST_CAPACITY : capacity * 2;
+        symbols = realloc(symbols, sizeof(Symbol) * capacity);
+        if (symbols == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    Symbol* sym = &symbols[count];
+    sym->name = (char*)malloc(length + 1);
+    if (sym->name == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    memcpy(sym->name, name, length);
+    sym->name[length] = '\0';
+    sym->length = length;
+    sym->hash = hash;
+    table[index] = count;
+
+    return count++;
+}
+
+const char* symbolName(int symbol) {
+    if (symbol < 0 || symbol >= count) return "<unknown>";
+    return symbols[symbol].name;
+}
+
+int symbolCount() {
+    return count;
+}
+
+void freeSymbols() {
+    for (int i = 0; i < count; i++) {
+        free(symbols[i].name);
+    }
+    free(symbols);
+    free(table);
+    symbols = NULL;
+    table = NULL;
+    count = capacity = tableSize = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef cmonk_symbol_h
+#define cmonk_symbol_h
+
+#include "headers.h"
+
+// valor de Token.symbol para los tokens que no son identificadores.
+#define NO_SYMBOL -1
+
+/**
+ * Tabla global de símbolos (interner).
+ * Cada identificador distinto del programa recibe un id entero pequeño y denso
+ * (0, 1, 2, ...) la primera vez que el lexer lo encuentra. A partir de ahí el
+ * parser y el intérprete trabajan sólo con ese id: comparar dos nombres es
+ * comparar dos enteros y no hace falta extraer ni copiar el literal.
+ */
+typedef struct {
+    char* name;
+    int length;
+    unsigned hash;
+} Symbol;
+
+/*================================================================/
+* PUBLIC SYMBOL API
+*=================================================================*/
+int internSymbol(const char* name, int length);
+const char* symbolName(int symbol);
+int symbolCount();
+void freeSymbols();
+
+#endif
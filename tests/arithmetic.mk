@@ -0,0 +1,6 @@
+let a = 10 - 2 * 3 + 8 / 4;
+let b = -a + 20;
+let c = (a + b) * (a - b) / 2;
+let cmp = fn(x, y) { if (x == y) { 0 } else { if (x > y) { 1 } else { -1 } } };
+let flags = fn(x) { if (!x) { 100 } else { 200 } };
+c * 1000 + cmp(a, b) * 10 + cmp(b, b) + flags(false) + flags(1 < 2) + flags(!!true)
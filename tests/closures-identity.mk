@@ -0,0 +1,6 @@
+let mk = fn() { fn() { 1 } };
+let churn = fn(n, s) { if (n == 0) { s } else { churn(n - 1, s + "ab") } };
+let a = mk();
+churn(2000, "");
+let b = mk();
+a == b
@@ -0,0 +1,4 @@
+let f = fn(x) { let x = x + 1; fn() { x } };
+let g = fn(n) { let k = fn() { m * 2 }; let m = n + 1; k() };
+let local = fn(n) { let sum = fn(k) { if (k == 0) { 0 } else { k + sum(k - 1) } }; sum(n) };
+f(4)() * 10000 + g(20) * 100 + local(10)
@@ -0,0 +1,6 @@
+let makeAdder = fn(x) { fn(y) { x + y } };
+let add5 = makeAdder(5);
+let add7 = makeAdder(7);
+let compose = fn(f, g) { fn(v) { g(f(v)) } };
+let three = fn(a) { fn(b) { fn(c) { a * 100 + b * 10 + c } } };
+compose(add5, add7)(1) * 1000 + three(1)(2)(3)
@@ -0,0 +1,4 @@
+let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } };
+let f = fn(n) { if (n == 0) { 0 } else { let g = fn() { n }; g() + f(n - 1) } };
+let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+sum(3000) + f(3000) + fib(20)
@@ -0,0 +1,2 @@
+let div = fn(a, b) { a / b };
+div(1, 0)
@@ -0,0 +1,3 @@
+let x = 5;
+let call = fn(g) { g(1) };
+call(x)
@@ -0,0 +1,2 @@
+let f = fn(b) { -b };
+f(true)
@@ -0,0 +1,3 @@
+let f = fn() { let a = 1 + true; 5 };
+let g = fn() { f(); 7 };
+g()
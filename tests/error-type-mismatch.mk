@@ -0,0 +1,2 @@
+let f = fn(x) { x + 1 };
+f("one")
@@ -0,0 +1,2 @@
+let t = 1 < 2;
+t + t
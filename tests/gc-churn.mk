@@ -0,0 +1,3 @@
+let build = fn(n, s) { if (n == 0) { s } else { build(n - 1, s + "x") } };
+let keep = fn(n, acc) { if (n == 0) { acc } else { let s = build(200, ""); let k = n; keep(n - 1, fn() { k + acc() }) } };
+keep(2000, fn() { 0 })()
@@ -0,0 +1,6 @@
+let x = 100;
+let f = fn(x) { fn() { x } };
+let g = fn(a, b) { if (b == 0) { a } else { a + b } };
+let y = 9;
+let h = fn(y) { let inner = fn(y) { fn() { y } }; inner() };
+f()() + g(1, 2) * 1000 + h(5)() * 100000
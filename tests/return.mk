@@ -0,0 +1,9 @@
+let bare = fn() { return; };
+let early = fn(x) { if (x > 0) { return x * 2; } 0 - x };
+let nested = fn(n) { if (n > 0) { if (n > 10) { return 10; } return n; } return; };
+let after = fn() { return 1; 2 };
+let r = if (bare() == nested(0)) { 1 } else { 0 };
+let g = fn(x) { x * 10 };
+let inner = fn(c) { 1 + if (c) { return g(1); } else { 2 } };
+let bound = fn() { let a = if (true) { return 5; } else { 0 }; a + 100 };
+early(4) * 1000 + early(-3) * 100 + nested(50) + nested(3) + after() + r * 10 + inner(true) * 100000 + inner(false) * 10000000 + bound() * 100000000
@@ -0,0 +1,3 @@
+let greet = fn(name) { "hello, " + name + "!" };
+let twice = fn(s) { s + s };
+twice(greet("monkey")) + " " + twice("")
@@ -0,0 +1,6 @@
+let loop = fn(n, acc) { if (n == 0) { acc } else { loop(n - 1, acc + 1) } };
+let down = fn(n) { if (n == 0) { return 0; } return down(n - 1); };
+let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };
+let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } };
+let r = if (even(300001)) { 1 } else { 2 };
+loop(1000000, 0) + down(500000) + r
@@ -0,0 +1,281 @@
+#include <pthread.h>
+#include "tokens.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * Lexeo en paralelo:
+ * 1. El fuente se parte en tantos trozos como hilos, cortando siempre justo
+ *    después de un '\n' para que ningún identificador, número u operador
+ *    quede partido. Sólo un string literal puede cruzar un corte.
+ * 2. Cada hilo lexea su trozo suponiendo (especulativamente) que empieza
+ *    fuera de un string.
+ * 3. Al unir los trozos en orden, si el trozo anterior terminó con un string
+ *    sin cerrar, la suposición era falsa: se relexea secuencialmente desde la
+ *    comilla de apertura hasta que un token coincide en posición con uno de
+ *    los tokens especulativos; a partir de ahí el resto del trozo es válido.
+ * La tabla de símbolos no es thread-safe, así que los identificadores se
+ * internan durante la unión, que es secuencial.
+ */
+typedef struct {
+    const char* input;
+    int start; // posición absoluta del trozo dentro del fuente
+    int end;
+    TokenBuffer tokens; // tokens especulativos (posiciones absolutas, sin T_EOF)
+    int eof; // posición del T_EOF; si es < end el lexer encontró un '\0'
+} Chunk;
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void initBuffer(TokenBuffer* buffer);
+static void appendToken(TokenBuffer* buffer, Token tok);
+static void copyToken(TokenBuffer* to, TokenBuffer* from, int index);
+static int lexRange(TokenBuffer* buffer, const char* input, int start, int end);
+static void* lexChunk(void* arg);
+static int origin(TokenBuffer* buffer, int index);
+static int findOrigin(TokenBuffer* buffer, int position);
+static int stitch(TokenBuffer* result, Chunk* chunks, int count);
+static void internSymbols(TokenBuffer* buffer);
+TokenBuffer* tokenize(const char* input, size_t length, int threads);
+Token tokenAt(TokenBuffer* buffer, int index);
+void freeTokenBuffer(TokenBuffer* buffer);
+int cpuCount();
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void initBuffer(TokenBuffer* buffer) {
+    buffer->count = 0;
+    buffer->capacity = 0;
+    buffer->types = NULL;
+    buffer->starts = NULL;
+    buffer->ends = NULL;
+    buffer->symbols = NULL;
+    buffer->input = NULL;
+    buffer->length = 0;
+}
+
+static void appendToken(TokenBuffer* buffer, Token tok) {
+    if (buffer->capacity < (buffer->count + 1)) {
+        int cap = buffer->capacity;
+        buffer->capacity = (cap == 0) ? 1024 : cap * 2;
+        buffer->types = realloc(buffer->types, sizeof(unsigned char) * buffer->capacity);
+        buffer->starts = realloc(buffer->starts, sizeof(int) * buffer->capacity);
+        buffer->ends = realloc(buffer->ends, sizeof(int) * buffer->capacity);
+        buffer->symbols = realloc(buffer->symbols, sizeof(int) * buffer->capacity);
+        if (buffer->types == NULL || buffer->starts == NULL || buffer->ends == NULL || buffer->symbols == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+    }
+    int i = buffer->count++;
+    buffer->types[i] = (unsigned char)tok.type;
+    buffer->starts[i] = tok.position.start;
+    buffer->ends[i] = tok.position.end;
+    buffer->symbols[i] = tok.symbol;
+}
+
+static void copyToken(TokenBuffer* to, TokenBuffer* from, int index) {
+    appendToken(to, tokenAt(from, index));
+}
+
+// lexea input[start, end) y agrega los tokens (sin T_EOF) con posiciones absolutas.
+// Devuelve la posición del T_EOF.
+static int lexRange(TokenBuffer* buffer, const char* input, int start, int end) {
+    initLexerChunk(input + start, end - start);
+    for (;;) {
+        Token tok = nextToken();
+        tok.position.start += start;
+        tok.position.end += start;
+        if (tok.type == T_EOF) {
+            return tok.position.start;
+        }
+        appendToken(buffer, tok);
+    }
+}
+
+static void* lexChunk(void* arg) {
+    Chunk* chunk = (Chunk*)arg;
+    chunk->eof = lexRange(&chunk->tokens, chunk->input, chunk->start, chunk->end);
+    return NULL;
+}
+
+// posición donde el lexer empezó el token (en los strings 'start' está pasada la comilla).
+static int origin(TokenBuffer* buffer, int index) {
+    return (buffer->types[index] == T_STRING) ? buffer->starts[index] - 1 : buffer->starts[index];
+}
+
+// índice del primer token especulativo cuyo origen es >= position.
+static int findOrigin(TokenBuffer* buffer, int position) {
+    int lo = 0, hi = buffer->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (origin(buffer, mid) < position) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// devuelve la posición del T_EOF final.
+static int stitch(TokenBuffer* result, Chunk* chunks, int count) {
+    int restart = -1; // comilla de apertura de un string que cruza el corte
+    int k = 0;
+    while (k < count) {
+        int from = 0;
+        if (restart >= 0) {
+            // la especulación falló: relexear secuencialmente hasta sincronizar.
+            initLexerChunk(result->input + restart, result->length - restart);
+            for (;;) {
+                Token tok = nextToken();
+                tok.position.start += restart;
+                tok.position.end += restart;
+                if (tok.type == T_EOF) return tok.position.start; // fin del fuente relexeando.
+                int tokOrigin = (tok.type == T_STRING) ? tok.position.start - 1 : tok.position.start;
+
+                // saltar los trozos que el token ya dejó atrás.
+                while (k < count && tokOrigin >= chunks[k].end) k++;
+                if (k < count && tokOrigin >= chunks[k].start) {
+                    // mismo origen que un token especulativo: desde aquí ambos lexean igual.
+                    from = findOrigin(&chunks[k].tokens, tokOrigin);
+                    if (from < chunks[k].tokens.count && origin(&chunks[k].tokens, from) == tokOrigin) {
+                        break;
+                    }
+                }
+                appendToken(result, tok);
+            }
+            restart = -1;
+        }
+
+        Chunk* chunk = &chunks[k];
+        for (int i = from; i < chunk->tokens.count; i++) {
+            copyToken(result, &chunk->tokens, i);
+        }
+        if (chunk->eof < chunk->end) return chunk->eof; // un '\0' termina el fuente, como en nextToken().
+
+        // ¿el último token es un string que llega al corte sin cerrarse?
+        int last = result->count - 1;
+        if (k + 1 < count && last >= 0 && result->types[last] == T_STRING && result->ends[last] == chunk->end) {
+            restart = result->starts[last] - 1;
+            result->count -= 1;
+        }
+        k++;
+    }
+    return chunks[count - 1].eof;
+}
+
+static void internSymbols(TokenBuffer* buffer) {
+    for (int i = 0; i < buffer->count; i++) {
+        if (buffer->types[i] == T_IDENT) {
+            buffer->symbols[i] = internSymbol(buffer->input + buffer->starts[i], buffer->ends[i] - buffer->starts[i]);
+        }
+    }
+}
+
+TokenBuffer* tokenize(const char* input, size_t length, int threads) {
+    if (length > INT_MAX) {
+        fprintf(stderr, "ERROR: source too large.\n");
+        exit(74);
+    }
+    TokenBuffer* result = createObject(TokenBuffer);
+    initBuffer(result);
+    result->input = input;
+    result->length = length;
+    initScanner(); // detectar la CPU antes de arrancar los hilos.
+
+    int eofPosition;
+    if (threads < 2 || length < TOKENIZE_PARALLEL_THRESHOLD) {
+        eofPosition = lexRange(result, input, 0, (int)length);
+    } else {
+        Chunk* chunks = (Chunk*)calloc(threads, sizeof(Chunk));
+        pthread_t* workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+        if (chunks == NULL || workers == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+        // cortar justo después de un '\n' (o al final si no hay ninguno).
+        int count = 0;
+        int start = 0;
+        size_t step = length / threads;
+        while (start < (int)length && count < threads) {
+            size_t end = (count == threads - 1) ? length : start + step;
+            if (end > length) end = length;
+            const char* nl = (end < length) ? memchr(input + end, '\n', length - end) : NULL;
+            end = (nl != NULL) ? (size_t)(nl - input) + 1 : length;
+
+            Chunk* chunk = &chunks[count++];
+            chunk->input = input;
+            chunk->start = start;
+            chunk->end = (int)end;
+            initBuffer(&chunk->tokens);
+            start = (int)end;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (pthread_create(&workers[i], NULL, lexChunk, &chunks[i]) != 0) {
+                lexChunk(&chunks[i]); // sin hilo disponible: lexear aquí mismo.
+                workers[i] = pthread_self();
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            if (!pthread_equal(workers[i], pthread_self())) {
+                pthread_join(workers[i], NULL);
+            }
+        }
+
+        eofPosition = stitch(result, chunks, count);
+
+        for (int i = 0; i < count; i++) {
+            free(chunks[i].tokens.types);
+            free(chunks[i].tokens.starts);
+            free(chunks[i].tokens.ends);
+            free(chunks[i].tokens.symbols);
+        }
+        free(chunks);
+        free(workers);
+    }
+    internSymbols(result);
+
+    // el T_EOF final.
+    Token eof;
+    eof.type = T_EOF;
+    eof.position.start = eof.position.end = eofPosition;
+    eof.symbol = NO_SYMBOL;
+    appendToken(result, eof);
+
+    return result;
+}
+
+// los índices fuera de rango devuelven el T_EOF final, así el parser puede mirar adelante sin chequear.
+Token tokenAt(TokenBuffer* buffer, int index) {
+    if (index >= buffer->count) index = buffer->count - 1;
+    Token tok;
+    tok.type = (TokenType)buffer->types[index];
+    tok.position.start = buffer->starts[index];
+    tok.position.end = buffer->ends[index];
+    tok.symbol = buffer->symbols[index];
+    return tok;
+}
+
+void freeTokenBuffer(TokenBuffer* buffer) {
+    free(buffer->types);
+    free(buffer->starts);
+    free(buffer->ends);
+    free(buffer->symbols);
+    free(buffer);
+}
+
+int cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef cmonk_tokens_h
+#define cmonk_tokens_h
+
+#include "lexer.h"
+
+// por debajo de este tamaño no compensa repartir el lexeo entre hilos.
+#define TOKENIZE_PARALLEL_THRESHOLD (1024 * 1024)
+
+/**
+ * Buffer de tokens pre-lexeado en formato struct-of-arrays.
+ * Todo el fuente se tokeniza de una vez y el Parser indexa el buffer en vez
+ * de pedirle al lexer un token cada vez. Cada campo vive en su propio array
+ * contiguo, así que recorrer los tipos (lo que más mira el parser) no arrastra
+ * posiciones ni símbolos a la caché. El último token siempre es T_EOF.
+ */
+typedef struct {
+    int count;
+    int capacity;
+    unsigned char* types; // TokenType
+    int* starts;
+    int* ends;
+    int* symbols;
+    const char* input; // fuente al que apuntan starts/ends
+    size_t length;
+} TokenBuffer;
+
+/*================================================================/
+* PUBLIC TOKENS API
+*=================================================================*/
+TokenBuffer* tokenize(const char* input, size_t length, int threads);
+Token tokenAt(TokenBuffer* buffer, int index);
+void freeTokenBuffer(TokenBuffer* buffer);
+int cpuCount();
+
+#endif
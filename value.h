@@ -0,0 +1,42 @@
+#ifndef cmonk_value_h
+#define cmonk_value_h
+
+#include <stdint.h>
+#include "headers.h"
+
+/**
+ * Value: una palabra de 64 bits que guarda directamente los enteros, los
+ * booleanos y null; solo los strings, funciones, errores y returns son
+ * objetos en el heap. La etiqueta está en los bits bajos:
+ * 	...xxxx1  entero (el valor está en los bits 1..63)
+ * 	...00010  null
+ * 	...00110  false
+ * 	...01110  true
+ * 	...xx000  puntero a un Object (malloc devuelve direcciones alineadas a 8)
+ * 	0         EMPTY_VAL: slot de una variable que todavía no se definió
+ * 	...01010  TAIL_CALL_VAL: solo en el tree walker, nunca llega a un slot
+ */
+typedef uint64_t Value;
+
+struct sObject;
+
+#define EMPTY_VAL ((Value)0)
+#define NULL_VAL  ((Value)0x02)
+#define FALSE_VAL ((Value)0x06)
+#define TRUE_VAL  ((Value)0x0e)
+#define TAIL_CALL_VAL ((Value)0x0a) // hay una llamada de cola pendiente (ver interpreter.c)
+
+#define INT_VAL(i)   ((Value)(((uint64_t)(int64_t)(i) << 1) | 1))
+#define BOOL_VAL(b)  ((b) ? TRUE_VAL : FALSE_VAL)
+#define OBJ_VAL(obj) ((Value)(uintptr_t)(obj))
+
+#define IS_INT(v)    (((v) & 1) != 0)
+#define IS_BOOL(v)   ((v) == TRUE_VAL || (v) == FALSE_VAL)
+#define IS_NULL(v)   ((v) == NULL_VAL)
+#define IS_OBJ(v)    (((v) & 7) == 0 && (v) != EMPTY_VAL)
+
+#define AS_INT(v)    ((int)((int64_t)(v) >> 1))
+#define AS_BOOL(v)   ((v) == TRUE_VAL)
+#define AS_OBJ(v)    ((struct sObject*)(uintptr_t)(v))
+
+#endif
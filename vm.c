@@ -0,0 +1,537 @@
+#include "vm.h"
+#include "interpreter.h"
+#include "heapprof.h"
+#include "evalstats.h"
+
+/*================================================================/
+* Forwarded declarations.
+*=================================================================*/
+static void resetStack();
+static Value runtimeError(Value error);
+static Value undefinedError(int symbol);
+static bool growStack(Value* top);
+static bool callFunction(Value callee, int argc);
+static Value run();
+void initVM();
+void freeVM();
+void setStackLimit(size_t bytes);
+Value runVM(CompiledFunction* function, Environment* globals);
+void visitVMRoots(void (*visitValue)(Value* slot), void (*visitEnv)(Environment* env));
+int sampleVMCallStack(int* out, int max);
+
+static VM vm;
+
+/*================================================================/
+* Implementation
+*=================================================================*/
+static void resetStack() {
+    vm.sp = vm.stack;
+    vm.frameCount = 0;
+}
+
+// un error termina la ejecución completa, igual que en el tree walker.
+static Value runtimeError(Value error) {
+    resetStack();
+    return error;
+}
+
+static Value undefinedError(int symbol) {
+    char msg[1024];
+    sprintf_s(msg, sizeof(msg), "identifier not found: %s.", symbolName(symbol));
+    return runtimeError(newError(msg));
+}
+
+/**
+ * Hace sitio para llenar la pila hasta 'top' y para un frame más. La pila se
+ * copia a un array nuevo, así que sp y los slots de los frames se recolocan. Los
+ * frames van a un array nuevo que se publica antes de liberar el viejo: el
+ * profiler los lee desde una señal. Devuelve false si no cabe en stackLimit.
+ */
+static bool growStack(Value* top) {
+    size_t needed = (size_t)(top - vm.stack);
+    size_t stackCapacity = (size_t)(vm.stackEnd - vm.stack);
+    int frameCapacity = vm.frameCapacity;
+    while (stackCapacity < needed) stackCapacity *= 2;
+    if (vm.frameCount == frameCapacity) frameCapacity *= 2;
+    if (sizeof(Value) * stackCapacity + sizeof(Frame) * frameCapacity > vm.stackLimit) {
+        return false;
+    }
+
+    if (stackCapacity != (size_t)(vm.stackEnd - vm.stack)) {
+        Value* stack = malloc(sizeof(Value) * stackCapacity);
+        if (stack == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+        memcpy(stack, vm.stack, sizeof(Value) * (vm.sp - vm.stack));
+        for (int i = 0; i < vm.frameCount; i++) {
+            vm.frames[i].slots = stack + (vm.frames[i].slots - vm.stack);
+        }
+        vm.sp = stack + (vm.sp - vm.stack);
+        free(vm.stack);
+        vm.stack = stack;
+        vm.stackEnd = stack + stackCapacity;
+    }
+    if (frameCapacity != vm.frameCapacity) {
+        Frame* frames = malloc(sizeof(Frame) * frameCapacity);
+        if (frames == NULL) {
+            fprintf(stderr, "ERROR: not enough memory.\n");
+            exit(74);
+        }
+        memcpy(frames, vm.frames, sizeof(Frame) * vm.frameCount);
+        Frame* old = vm.frames;
+        vm.frames = frames;
+        vm.frameCapacity = frameCapacity;
+        free(old);
+    }
+    return true;
+}
+
+/**
+ * Prepara el frame de la llamada: los argumentos ya están en la pila y pasan
+ * a ser los primeros slots. El resto de slots empieza vacío (EMPTY_VAL). Si la
+ * función crea closures los slots se mueven a un Environment nuevo.
+ */
+static bool callFunction(Value callee, int argc) {
+    FunctionObj* funObj = AS_FUNCTION(callee);
+    CompiledFunction* function = funObj->compiled;
+    Value* slots = vm.sp - argc;
+
+    if (vm.frameCount == vm.frameCapacity || slots + function->localCount + function->maxStack > vm.stackEnd) {
+        if (!growStack(slots + function->localCount + function->maxStack)) return false;
+        slots = vm.sp - argc;
+    }
+
+    int bound = (argc < function->arity) ? argc : function->arity;
+    if (function->simpleParams) {
+        for (int i = bound; i < function->localCount; i++) {
+            slots[i] = EMPTY_VAL;
+        }
+    } else {
+        // parámetros con nombre repetido: el último argumento gana.
+        Value args[MAX_ARGUMENTS];
+        memcpy(args, slots, sizeof(Value) * bound);
+        for (int i = 0; i < function->localCount; i++) {
+            slots[i] = EMPTY_VAL;
+        }
+        for (int i = 0; i < bound; i++) {
+            slots[funObj->parameters[i]->slot] = args[i];
+        }
+    }
+    // las variables copiadas por el closure, en los últimos slots.
+    Value* captured = slots + (function->localCount - funObj->captureCount);
+    for (int i = 0; i < funObj->captureCount; i++) {
+        captured[i] = funObj->captures[i];
+    }
+
+    // el Environment se crea antes de apilar el frame (el GC recorre los frames
+    // apilados) y con los slots dentro de la pila, que son raíces.
+    vm.sp = slots + function->localCount;
+    Environment* env = funObj->env;
+    if (function->needsEnv) {
+        env = newEnclosedEnvironment(funObj->env, function->localCount, function->locals);
+        for (int i = 0; i < function->localCount; i++) {
+            SET_SLOT(env, i, slots[i]);
+        }
+    }
+    // el frame se rellena antes de contarlo: el profiler lee los frames desde una señal.
+    Frame* frame = &vm.frames[vm.frameCount];
+    frame->function = function;
+    frame->ip = function->code;
+    frame->slots = slots;
+    frame->env = env;
+    vm.frameCount += 1;
+    if (function->needsEnv) vm.sp = slots;
+    return true;
+}
+
+static Value run() {
+    Frame* frame = &vm.frames[vm.frameCount - 1];
+    uint8_t* ip = frame->ip;
+    int argc; // de OP_CALL, OP_TAIL_CALL y OP_CALL_SUB_LOCAL_CONST
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)(ip[-2] | (ip[-1] << 8)))
+#define READ_LONG() (ip += 4, (uint32_t)ip[-4] | ((uint32_t)ip[-3] << 8) | ((uint32_t)ip[-2] << 16) | ((uint32_t)ip[-1] << 24))
+#define PUSH(value) (*vm.sp++ = (value))
+#define POP() (*--vm.sp)
+#define PEEK(distance) (vm.sp[-1 - (distance)])
+#define BOTH_INTEGERS() (IS_INT(PEEK(0)) && IS_INT(PEEK(1)))
+// un local todavía sin definir en esta función se busca por nombre fuera.
+#define LOAD_LOCAL(value, slot) \
+    do { \
+        (value) = frame->slots[(slot)]; \
+        if ((value) == EMPTY_VAL) { \
+            int symbol_ = frame->function->locals[(slot)]; \
+            (value) = get(frame->env, symbol_); \
+            if ((value) == EMPTY_VAL) return undefinedError(symbol_); \
+        } \
+    } while (false)
+// operadores: caso rápido para dos enteros, el resto lo resuelve el tree walker.
+#define BINARY_OP(tokenType, intResult) \
+    do { \
+        Value result; \
+        if (BOTH_INTEGERS()) { \
+            int a = AS_INT(PEEK(1)); \
+            int b = AS_INT(PEEK(0)); \
+            result = (intResult); \
+        } else { \
+            result = evalInfixExpression((tokenType), PEEK(1), PEEK(0)); \
+            if (IS_OBJ(result) && AS_OBJ(result)->type == ERROR_OBJ) return runtimeError(result); \
+        } \
+        vm.sp -= 1; \
+        PEEK(0) = result; \
+    } while (false)
+// local 'op' constante entera: el local se apila antes de operar, así es raíz si hay que reservar.
+#define LOCAL_CONST_OP(tokenType, intResult) \
+    do { \
+        int slot = READ_SHORT(); \
+        Value constant = frame->function->constants[READ_SHORT()]; \
+        Value value = frame->slots[slot]; \
+        if (IS_INT(value)) { \
+            int a = AS_INT(value); \
+            int b = AS_INT(constant); \
+            PUSH(intResult); \
+        } else { \
+            LOAD_LOCAL(value, slot); \
+            PUSH(value); \
+            Value result = evalInfixExpression((tokenType), PEEK(0), constant); \
+            if (IS_OBJ(result) && AS_OBJ(result)->type == ERROR_OBJ) return runtimeError(result); \
+            PEEK(0) = result; \
+        } \
+    } while (false)
+// comparación y salto: quita los dos operandos y salta si la comparación es falsa.
+#define COMPARE_JUMP(tokenType, intTest) \
+    do { \
+        int offset = READ_SHORT(); \
+        bool test; \
+        if (BOTH_INTEGERS()) { \
+            int a = AS_INT(PEEK(1)); \
+            int b = AS_INT(PEEK(0)); \
+            test = (intTest); \
+        } else { \
+            Value result = evalInfixExpression((tokenType), PEEK(1), PEEK(0)); \
+            if (IS_OBJ(result) && AS_OBJ(result)->type == ERROR_OBJ) return runtimeError(result); \
+            test = isTruthy(result); \
+        } \
+        vm.sp -= 2; \
+        if (!test) ip += offset; \
+    } while (false)
+
+    // antes de cada opcode: su sitio de reserva (HEAP_PROFILE) y los contadores (EVAL_STATS).
+#ifdef HEAP_PROFILE
+#define BEFORE_OPCODE() (SET_ALLOCATION_SITE(frame->function->sites[ip - frame->function->code]), COUNT_OPCODE(*ip))
+#else
+#define BEFORE_OPCODE() COUNT_OPCODE(*ip)
+#endif
+#ifdef VM_THREADED_DISPATCH
+    // las etiquetas de cada opcode, en el orden de OpCode.
+    static void* dispatchTable[] = {
+        [OP_CONSTANT] = &&do_OP_CONSTANT,
+        [OP_CONSTANT_LONG] = &&do_OP_CONSTANT_LONG,
+        [OP_NULL] = &&do_OP_NULL,
+        [OP_TRUE] = &&do_OP_TRUE,
+        [OP_FALSE] = &&do_OP_FALSE,
+        [OP_POP] = &&do_OP_POP,
+        [OP_GET_LOCAL] = &&do_OP_GET_LOCAL,
+        [OP_SET_LOCAL] = &&do_OP_SET_LOCAL,
+        [OP_GET_ENV] = &&do_OP_GET_ENV,
+        [OP_SET_ENV] = &&do_OP_SET_ENV,
+        [OP_GET_GLOBAL] = &&do_OP_GET_GLOBAL,
+        [OP_SET_GLOBAL] = &&do_OP_SET_GLOBAL,
+        [OP_NEGATE] = &&do_OP_NEGATE,
+        [OP_NOT] = &&do_OP_NOT,
+        [OP_ADD] = &&do_OP_ADD,
+        [OP_SUB] = &&do_OP_SUB,
+        [OP_MUL] = &&do_OP_MUL,
+        [OP_DIV] = &&do_OP_DIV,
+        [OP_LT] = &&do_OP_LT,
+        [OP_GT] = &&do_OP_GT,
+        [OP_EQ] = &&do_OP_EQ,
+        [OP_NOT_EQ] = &&do_OP_NOT_EQ,
+        [OP_JUMP] = &&do_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&do_OP_JUMP_IF_FALSE,
+        [OP_CLOSURE] = &&do_OP_CLOSURE,
+        [OP_CALL] = &&do_OP_CALL,
+        [OP_TAIL_CALL] = &&do_OP_TAIL_CALL,
+        [OP_RETURN] = &&do_OP_RETURN,
+        [OP_LT_LOCAL_CONST] = &&do_OP_LT_LOCAL_CONST,
+        [OP_EQ_LOCAL_CONST] = &&do_OP_EQ_LOCAL_CONST,
+        [OP_ADD_LOCAL_CONST] = &&do_OP_ADD_LOCAL_CONST,
+        [OP_SUB_LOCAL_CONST] = &&do_OP_SUB_LOCAL_CONST,
+        [OP_CALL_SUB_LOCAL_CONST] = &&do_OP_CALL_SUB_LOCAL_CONST,
+        [OP_JUMP_IF_NOT_LT] = &&do_OP_JUMP_IF_NOT_LT,
+        [OP_JUMP_IF_NOT_GT] = &&do_OP_JUMP_IF_NOT_GT,
+        [OP_JUMP_IF_NOT_EQ] = &&do_OP_JUMP_IF_NOT_EQ,
+        [OP_JUMP_IF_EQ] = &&do_OP_JUMP_IF_EQ,
+        [OP_ADD_RETURN] = &&do_OP_ADD_RETURN,
+        [OP_SUB_RETURN] = &&do_OP_SUB_RETURN,
+    };
+#define CASE(op) do_##op
+#define DISPATCH() do { BEFORE_OPCODE(); goto *dispatchTable[READ_BYTE()]; } while (false)
+
+    DISPATCH();
+#else
+#define CASE(op) case op
+#define DISPATCH() continue
+
+    for (;;) {
+        BEFORE_OPCODE();
+        switch (READ_BYTE()) {
+#endif
+        CASE(OP_CONSTANT):
+            PUSH(frame->function->constants[READ_SHORT()]);
+            DISPATCH();
+        CASE(OP_CONSTANT_LONG):
+            PUSH(frame->function->constants[READ_LONG()]);
+            DISPATCH();
+        CASE(OP_NULL):
+            PUSH(NULL_VAL);
+            DISPATCH();
+        CASE(OP_TRUE):
+            PUSH(TRUE_VAL);
+            DISPATCH();
+        CASE(OP_FALSE):
+            PUSH(FALSE_VAL);
+            DISPATCH();
+        CASE(OP_POP):
+            vm.sp -= 1;
+            DISPATCH();
+        CASE(OP_GET_LOCAL): {
+            int slot = READ_SHORT();
+            Value value;
+            LOAD_LOCAL(value, slot);
+            PUSH(value);
+            DISPATCH();
+        }
+        CASE(OP_SET_LOCAL):
+            frame->slots[READ_SHORT()] = PEEK(0);
+            DISPATCH();
+        CASE(OP_GET_ENV): {
+            int hops = READ_SHORT();
+            int slot = READ_SHORT();
+            Environment* env = frame->env;
+            while (hops-- > 0) {
+                env = env->outer;
+            }
+            Value value = env->slots[slot];
+            if (value == EMPTY_VAL) {
+                value = get(frame->env, env->symbols[slot]);
+                if (value == EMPTY_VAL) return undefinedError(env->symbols[slot]);
+            }
+            PUSH(value);
+            DISPATCH();
+        }
+        CASE(OP_SET_ENV):
+            SET_SLOT(frame->env, READ_SHORT(), PEEK(0));
+            DISPATCH();
+        CASE(OP_GET_GLOBAL): {
+            uint32_t symbol = READ_LONG();
+            Value value = vm.globals->slots[symbol];
+            if (value == EMPTY_VAL) return undefinedError(symbol);
+            PUSH(value);
+            DISPATCH();
+        }
+        CASE(OP_SET_GLOBAL):
+            SET_SLOT(vm.globals, READ_LONG(), PEEK(0));
+            DISPATCH();
+        CASE(OP_NEGATE): {
+            Value result = evalPrefixExpression(T_MINUS, PEEK(0));
+            if (IS_OBJ(result) && AS_OBJ(result)->type == ERROR_OBJ) return runtimeError(result);
+            PEEK(0) = result;
+            DISPATCH();
+        }
+        CASE(OP_NOT):
+            PEEK(0) = evalPrefixExpression(T_BANG, PEEK(0));
+            DISPATCH();
+        CASE(OP_ADD): BINARY_OP(T_PLUS, INT_VAL(a + b)); DISPATCH();
+        CASE(OP_SUB): BINARY_OP(T_MINUS, INT_VAL(a - b)); DISPATCH();
+        CASE(OP_MUL): BINARY_OP(T_ASTERISK, INT_VAL(a * b)); DISPATCH();
+        CASE(OP_DIV):
+            if (BOTH_INTEGERS() && AS_INT(PEEK(0)) == 0) {
+                fprintf(stdout, "Division by zero.\n");
+                exit(74);
+            }
+            BINARY_OP(T_SLASH, INT_VAL(a / b));
+            DISPATCH();
+        CASE(OP_LT): BINARY_OP(T_LT, BOOL_VAL(a < b)); DISPATCH();
+        CASE(OP_GT): BINARY_OP(T_GT, BOOL_VAL(a > b)); DISPATCH();
+        CASE(OP_EQ): BINARY_OP(T_EQ, BOOL_VAL(a == b)); DISPATCH();
+        CASE(OP_NOT_EQ): BINARY_OP(T_NOT_EQ, BOOL_VAL(a != b)); DISPATCH();
+        CASE(OP_JUMP): {
+            int offset = READ_SHORT();
+            ip += offset;
+            DISPATCH();
+        }
+        CASE(OP_JUMP_IF_FALSE): {
+            int offset = READ_SHORT();
+            if (!isTruthy(POP())) ip += offset;
+            DISPATCH();
+        }
+        CASE(OP_CLOSURE): {
+            CompiledFunction* function = frame->function->functions[READ_SHORT()];
+            Value closure = newFunction(function->node, frame->env,
+                frame->function->needsEnv ? frame->env->slots : frame->slots);
+            AS_FUNCTION(closure)->compiled = function;
+            PUSH(closure);
+            DISPATCH();
+        }
+        CASE(OP_CALL):
+            argc = READ_BYTE();
+        call: {
+            Value callee = PEEK(argc);
+            if (valueType(callee) == BUILTIN_OBJ) {
+                // los argumentos siguen en la pila (son raíces) mientras corre el builtin.
+                Value result = AS_BUILTIN(callee)->function(argc, vm.sp - argc);
+                if (IS_OBJ(result) && AS_OBJ(result)->type == ERROR_OBJ) return runtimeError(result);
+                vm.sp -= argc + 1;
+                PUSH(result);
+                DISPATCH();
+            }
+            if (valueType(callee) != FUNCTION_OBJ) {
+                return runtimeError(newError("not a function."));
+            }
+            frame->ip = ip;
+            if (!callFunction(callee, argc)) {
+                return runtimeError(newError("stack overflow."));
+            }
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            DISPATCH();
+        }
+        CASE(OP_TAIL_CALL): {
+            // la función y los argumentos bajan al sitio del frame que termina, que pasa a ser el de la llamada.
+            argc = READ_BYTE();
+            Value callee = PEEK(argc);
+            if (valueType(callee) != FUNCTION_OBJ) goto call; // el código que sigue vuelve con el resultado
+            Value* base = frame->slots - 1;
+            memmove(base, vm.sp - argc - 1, sizeof(Value) * (argc + 1));
+            vm.sp = base + argc + 1;
+            vm.frameCount -= 1;
+            if (!callFunction(callee, argc)) {
+                return runtimeError(newError("stack overflow."));
+            }
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            DISPATCH();
+        }
+        CASE(OP_RETURN):
+        ret: {
+            Value result = POP();
+            vm.frameCount -= 1;
+            if (vm.frameCount == 0) {
+                resetStack();
+                return result;
+            }
+            vm.sp = frame->slots - 1; // quita también el closure llamado
+            PUSH(result);
+            frame = &vm.frames[vm.frameCount - 1];
+            ip = frame->ip;
+            DISPATCH();
+        }
+        CASE(OP_LT_LOCAL_CONST): LOCAL_CONST_OP(T_LT, BOOL_VAL(a < b)); DISPATCH();
+        CASE(OP_EQ_LOCAL_CONST): LOCAL_CONST_OP(T_EQ, BOOL_VAL(a == b)); DISPATCH();
+        CASE(OP_ADD_LOCAL_CONST): LOCAL_CONST_OP(T_PLUS, INT_VAL(a + b)); DISPATCH();
+        CASE(OP_SUB_LOCAL_CONST): LOCAL_CONST_OP(T_MINUS, INT_VAL(a - b)); DISPATCH();
+        CASE(OP_CALL_SUB_LOCAL_CONST):
+            LOCAL_CONST_OP(T_MINUS, INT_VAL(a - b));
+            argc = 1;
+            goto call;
+        CASE(OP_JUMP_IF_NOT_LT): COMPARE_JUMP(T_LT, a < b); DISPATCH();
+        CASE(OP_JUMP_IF_NOT_GT): COMPARE_JUMP(T_GT, a > b); DISPATCH();
+        CASE(OP_JUMP_IF_NOT_EQ): COMPARE_JUMP(T_EQ, a == b); DISPATCH();
+        CASE(OP_JUMP_IF_EQ): COMPARE_JUMP(T_NOT_EQ, a != b); DISPATCH();
+        CASE(OP_ADD_RETURN):
+            BINARY_OP(T_PLUS, INT_VAL(a + b));
+            goto ret;
+        CASE(OP_SUB_RETURN):
+            BINARY_OP(T_MINUS, INT_VAL(a - b));
+            goto ret;
+#ifndef VM_THREADED_DISPATCH
+        }
+    }
+#endif
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_LONG
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef BOTH_INTEGERS
+#undef LOAD_LOCAL
+#undef BINARY_OP
+#undef LOCAL_CONST_OP
+#undef COMPARE_JUMP
+#undef BEFORE_OPCODE
+#undef CASE
+#undef DISPATCH
+}
+
+void initVM() {
+    vm.stack = malloc(sizeof(Value) * VM_STACK_INITIAL);
+    vm.frames = malloc(sizeof(Frame) * VM_FRAMES_INITIAL);
+    if (vm.stack == NULL || vm.frames == NULL) {
+        fprintf(stderr, "ERROR: not enough memory.\n");
+        exit(74);
+    }
+    vm.stackEnd = vm.stack + VM_STACK_INITIAL;
+    vm.frameCapacity = VM_FRAMES_INITIAL;
+    vm.stackLimit = VM_STACK_LIMIT;
+    resetStack();
+}
+
+void freeVM() {
+    free(vm.stack);
+    free(vm.frames);
+    vm.stack = vm.stackEnd = vm.sp = NULL;
+    vm.frames = NULL;
+    vm.frameCapacity = 0;
+}
+
+// lo que ya está reservado se queda aunque el límite nuevo sea menor.
+void setStackLimit(size_t bytes) {
+    vm.stackLimit = bytes;
+}
+
+// ejecuta el código del nivel superior de un programa.
+Value runVM(CompiledFunction* function, Environment* globals) {
+    resetStack();
+    vm.globals = globals;
+    if (vm.stack + function->maxStack > vm.stackEnd && !growStack(vm.stack + function->maxStack)) {
+        return newError("stack overflow.");
+    }
+
+    Frame* frame = &vm.frames[vm.frameCount];
+    frame->function = function;
+    frame->ip = function->code;
+    frame->slots = vm.stack;
+    frame->env = globals;
+    vm.frameCount += 1;
+
+    return run();
+}
+
+/**
+ * Raíces del GC: todo lo que está en la pila y los Environment de los frames.
+ * Los slots se pasan por dirección porque la recolección menor mueve los
+ * objetos y los actualiza. 'visitEnv' puede ser NULL.
+ */
+void visitVMRoots(void (*visitValue)(Value* slot), void (*visitEnv)(Environment* env)) {
+    for (Value* slot = vm.stack; slot < vm.sp; slot++) {
+        visitValue(slot);
+    }
+    if (visitEnv == NULL) return;
+    for (int i = 0; i < vm.frameCount; i++) {
+        visitEnv(vm.frames[i].env);
+    }
+}
+
+// la pila de llamadas para el profiler (ver sampleCallStack): sin el frame del nivel superior.
+int sampleVMCallStack(int* out, int max) {
+    int depth = 0;
+    for (int i = vm.frameCount - 1; i >= 1; i--, depth++) {
+        if (depth < max) out[depth] = vm.frames[i].function->node->profile;
+    }
+    return depth;
+}
@@ -0,0 +1,62 @@
+#ifndef cmonk_vm_h
+#define cmonk_vm_h
+
+#include "compiler.h"
+
+/**
+ * La pila de valores y la de frames viven en el heap de C y crecen al doble
+ * cuando una llamada no cabe, así que la profundidad de la recursión no
+ * depende de la pila de C sino de 'stackLimit': los bytes que pueden llegar a
+ * ocupar las dos juntas (VM_STACK_LIMIT por defecto, --stack-limit=MB en la
+ * línea de órdenes). Pasado el límite la llamada da "stack overflow.".
+ */
+#define VM_STACK_INITIAL 1024 // Values de la pila al empezar
+#define VM_FRAMES_INITIAL 64 // frames al empezar
+#define VM_STACK_LIMIT ((size_t)256 * 1024 * 1024)
+
+/**
+ * Despacho de opcodes. Con GCC (y clang) cada instrucción salta directamente
+ * a la siguiente con un goto calculado sobre una tabla de etiquetas: un salto
+ * indirecto al final de cada opcode, que el predictor aprende por separado,
+ * en lugar del único salto del switch. Con otros compiladores, o compilando
+ * con -DVM_SWITCH_DISPATCH, el bucle es un switch. El bytecode es el mismo;
+ * 'make bench-dispatch' compara los dos.
+ */
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
+
+/**
+ * Frame: una llamada en curso. 'slots' apunta al primer argumento en la pila
+ * (el closure llamado está justo debajo). 'env' es el Environment donde viven
+ * los locales si la función lo necesita, o el del closure si no.
+ */
+typedef struct {
+    CompiledFunction* function;
+    uint8_t* ip;
+    Value* slots;
+    Environment* env;
+} Frame;
+
+typedef struct {
+    Frame* frames;
+    int frameCount;
+    int frameCapacity;
+    Value* stack;
+    Value* stackEnd; // fin de lo reservado
+    Value* sp; // siguiente hueco libre de la pila
+    size_t stackLimit; // bytes como mucho entre la pila y los frames
+    Environment* globals;
+} VM;
+
+/*================================================================/
+* PUBLIC VM API
+*=================================================================*/
+void initVM();
+void freeVM();
+void setStackLimit(size_t bytes);
+Value runVM(CompiledFunction* function, Environment* globals);
+void visitVMRoots(void (*visitValue)(Value* slot), void (*visitEnv)(Environment* env));
+int sampleVMCallStack(int* out, int max);
+
+#endif